@@ -0,0 +1,86 @@
+// Бенчмарк конвейера MiniGitClient через настоящий сервер на loopback: одни и те же
+// GET_LATEST последовательно (запрос — ответ) и из одного потока с заданным числом запросов в полёте.
+#include "../clients/mini_git_client.h"
+#include "../servers/mini_git_server.h"
+#include <chrono>
+#include <deque>
+#include <iostream>
+
+using deltasync::ClientOptions;
+using deltasync::MiniGitClient;
+using deltasync::MiniGitServer;
+using deltasync::ServerOptions;
+
+namespace {
+
+void report(const std::string& name, size_t requests, std::chrono::steady_clock::time_point start) {
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << name << ": " << requests << " requests in " << seconds * 1000 << " ms, "
+              << static_cast<size_t>(requests / seconds) << " req/s" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t requests = 20000;
+    size_t inFlight = 256;
+    size_t connections = 4;
+    size_t fileSize = 4096;
+    int port = 18081;
+    std::filesystem::path repoPath = "./client_pipeline_bench_repo";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--requests" && i + 1 < argc) {
+            requests = std::stoul(argv[++i]);
+        } else if (arg == "--in-flight" && i + 1 < argc) {
+            inFlight = std::stoul(argv[++i]);
+        } else if (arg == "--connections" && i + 1 < argc) {
+            connections = std::stoul(argv[++i]);
+        } else if (arg == "--size" && i + 1 < argc) {
+            fileSize = std::stoul(argv[++i]);
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (arg == "--repo" && i + 1 < argc) {
+            repoPath = argv[++i];
+        }
+    }
+
+    std::filesystem::remove_all(repoPath);
+    MiniGitServer server(repoPath, port, ServerOptions{});
+    std::thread serverThread([&server] { server.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    {
+        ClientOptions options;
+        options.connections = connections;
+        MiniGitClient client("127.0.0.1", port, options);
+        client.saveFile("bench.bin", "master", "bench", "initial", std::vector<uint8_t>(fileSize, 'a'));
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < requests / 10; i++) {
+            client.getLatest("bench.bin", "master");
+        }
+        report("sequential", requests / 10, start);
+
+        // Окно из inFlight запросов: ответ освобождает место следующему
+        start = std::chrono::steady_clock::now();
+        std::deque<std::future<std::vector<uint8_t>>> window;
+        for (size_t i = 0; i < requests; i++) {
+            if (window.size() == inFlight) {
+                window.front().get();
+                window.pop_front();
+            }
+            window.push_back(client.getLatestAsync("bench.bin", "master"));
+        }
+        for (auto& response : window) {
+            response.get();
+        }
+        report("pipelined (" + std::to_string(inFlight) + " in flight, " + std::to_string(connections) +
+               " connections)", requests, start);
+    }
+
+    server.stop();
+    serverThread.join();
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Микробенчмарк ядер MatchKernels: пропускная способность (байт/с) для каждого уровня ISA,
+// доступного на текущем CPU.
+#include "../engines/match_kernels.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+
+struct Result {
+    double forwardBytesPerSec;
+    double backwardBytesPerSec;
+};
+
+// Совпадения длиной runLength подряд, затем одно несовпадение — как при расширении кандидатов
+Result measure(const std::vector<unsigned char>& a, const std::vector<unsigned char>& b,
+               size_t runLength, int iterations) {
+    volatile size_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t pos = 0; pos + runLength < a.size(); pos += runLength + 1) {
+            sink = sink + MatchKernels::forward(a.data() + pos, b.data() + pos, runLength + 1);
+        }
+    }
+    double forwardSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (size_t pos = a.size(); pos > runLength + 1; pos -= runLength + 1) {
+            sink = sink + MatchKernels::backward(a.data() + pos, b.data() + pos, runLength + 1);
+        }
+    }
+    double backwardSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double bytes = static_cast<double>(a.size()) * iterations;
+    return {bytes / forwardSec, bytes / backwardSec};
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t bufferSize = 64u << 20;
+    int iterations = 10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--size-mb" && i + 1 < argc) {
+            bufferSize = std::stoul(argv[++i]) << 20;
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoi(argv[++i]);
+        }
+    }
+
+    std::vector<unsigned char> a(bufferSize);
+    std::mt19937 rng(42);
+    for (auto& byte : a) byte = static_cast<unsigned char>(rng());
+    std::vector<unsigned char> b = a;
+
+    std::cout << "Detected ISA: " << MatchKernels::isaName(MatchKernels::activeIsa()) << std::endl;
+    std::cout << std::left << std::setw(8) << "isa" << std::setw(10) << "run"
+              << std::setw(16) << "forward GB/s" << "backward GB/s" << std::endl;
+
+    for (size_t runLength : {16u, 256u, 65536u}) {
+        // Несовпадение после каждого участка длиной runLength
+        b = a;
+        for (size_t pos = runLength; pos < b.size(); pos += runLength + 1) b[pos] ^= 0xFF;
+
+        for (auto isa : {MatchKernels::Isa::Scalar, MatchKernels::Isa::SSE2,
+                         MatchKernels::Isa::AVX2, MatchKernels::Isa::AVX512}) {
+            if (!MatchKernels::forceIsa(isa)) continue;
+
+            Result r = measure(a, b, runLength, iterations);
+            std::cout << std::left << std::setw(8) << MatchKernels::isaName(isa)
+                      << std::setw(10) << runLength
+                      << std::setw(16) << std::fixed << std::setprecision(2) << r.forwardBytesPerSec / 1e9
+                      << r.backwardBytesPerSec / 1e9 << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+// Бенчмарк холодного старта: репозиторий с большим числом версий (по умолчанию 1M)
+// в снимке метаданных, измеряется время открытия и первого обращения к истории.
+#include "../engines/repository.h"
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char* argv[]) {
+    size_t fileCount = 10000;
+    size_t versionsPerFile = 100;
+    std::filesystem::path repoPath = "./metadata_bench_repo";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--files" && i + 1 < argc) {
+            fileCount = std::stoul(argv[++i]);
+        } else if (arg == "--versions" && i + 1 < argc) {
+            versionsPerFile = std::stoul(argv[++i]);
+        } else if (arg == "--repo" && i + 1 < argc) {
+            repoPath = argv[++i];
+        }
+    }
+
+    std::filesystem::remove_all(repoPath);
+    std::filesystem::create_directories(repoPath / "meta");
+
+    // Синтетическая история пишется сразу в снимок, без объектов
+    std::map<std::string, std::vector<FileVersion>> files;
+    MetadataIndex::BranchMap branches;
+    auto now = std::chrono::system_clock::now();
+
+    for (size_t f = 0; f < fileCount; f++) {
+        std::string fileName = "dir/file-" + std::to_string(f) + ".cfg";
+        auto& versions = files[fileName];
+        versions.reserve(versionsPerFile);
+
+        for (size_t v = 0; v < versionsPerFile; v++) {
+            FileVersion version;
+            // Уникальный ненулевой дайджест: номер файла и номер версии
+            for (int i = 0; i < 8; i++) {
+                version.hash.bytes[i] = static_cast<uint8_t>(f >> (8 * i));
+                version.hash.bytes[8 + i] = static_cast<uint8_t>((v + 1) >> (8 * i));
+            }
+            version.parentHash = v ? versions.back().hash : Digest{};
+            version.contentHash = version.hash;
+            version.timestamp = now;
+            version.author = "bench";
+            version.message = "revision " + std::to_string(v);
+            version.isDelta = v % 32 != 0;
+            version.chainDepth = static_cast<uint32_t>(v % 32);
+            versions.push_back(std::move(version));
+        }
+        branches["master"][fileName] = versions.back().hash;
+    }
+
+    auto writeStart = std::chrono::steady_clock::now();
+    MetadataIndex::writeSnapshot(repoPath / "meta" / "snapshot", 0, files, branches);
+    double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart).count();
+    files.clear();
+
+    auto openStart = std::chrono::steady_clock::now();
+    Repository repo(repoPath);
+    double openMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - openStart).count();
+
+    auto lookupStart = std::chrono::steady_clock::now();
+    auto history = repo.getFileHistory("dir/file-" + std::to_string(fileCount / 2) + ".cfg");
+    double lookupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - lookupStart).count();
+
+    std::cout << "versions:          " << fileCount * versionsPerFile << std::endl;
+    std::cout << "snapshot write ms: " << writeMs << std::endl;
+    std::cout << "startup ms:        " << openMs << std::endl;
+    std::cout << "first history ms:  " << lookupMs << " (" << history.size() << " versions)" << std::endl;
+
+    std::filesystem::remove_all(repoPath);
+    return 0;
+}
@@ -0,0 +1,95 @@
+// Бенчмарк масштабирования: сжатие и распаковка большого объекта кусками
+// на пуле из 1..N потоков, плюс полное сохранение через Repository::saveFile.
+#include "../engines/repository.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace {
+
+// Полусжимаемые данные, похожие на текстовые артефакты
+std::vector<uint8_t> makeContent(size_t size) {
+    std::mt19937_64 rng(42);
+    std::vector<uint8_t> content;
+    content.reserve(size);
+
+    while (content.size() < size) {
+        std::string line = "entry_" + std::to_string(rng() % 100000) + " = " + std::to_string(rng()) + "\n";
+        content.insert(content.end(), line.begin(), line.end());
+    }
+    content.resize(size);
+    return content;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t sizeMb = 256;
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkBytes = 4u << 20;
+    std::filesystem::path repoPath = "./parallel_bench_repo";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--size-mb" && i + 1 < argc) {
+            sizeMb = std::stoul(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            maxThreads = std::stoul(argv[++i]);
+        } else if (arg == "--chunk-kb" && i + 1 < argc) {
+            chunkBytes = std::stoul(argv[++i]) << 10;
+        } else if (arg == "--repo" && i + 1 < argc) {
+            repoPath = argv[++i];
+        }
+    }
+
+    auto content = makeContent(sizeMb << 20);
+    double mb = static_cast<double>(content.size()) / (1 << 20);
+
+    std::cout << "object: " << sizeMb << " MB, chunk: " << (chunkBytes >> 10) << " KB" << std::endl;
+    std::cout << "threads  encode MB/s  decode MB/s  saveFile MB/s  ratio" << std::endl;
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    for (size_t threads : threadCounts) {
+        WorkerPool pool(threads);
+
+        auto encodeStart = std::chrono::steady_clock::now();
+        auto encoded = ObjectCodec::encodeParallel(content, Compression::Zstd, 0, nullptr, pool, chunkBytes);
+        double encodeSec = secondsSince(encodeStart);
+
+        auto decodeStart = std::chrono::steady_clock::now();
+        auto decoded = ObjectCodec::decode(ObjectData{encoded, nullptr}, {}, &pool);
+        double decodeSec = secondsSince(decodeStart);
+
+        if (!std::equal(decoded.bytes.begin(), decoded.bytes.end(), content.begin(), content.end())) {
+            std::cerr << "roundtrip mismatch" << std::endl;
+            return 1;
+        }
+
+        // Хеш, сжатие и запись в pack одного большого файла
+        std::filesystem::remove_all(repoPath);
+        RepositoryOptions options;
+        options.workerThreads = threads;
+        options.parallelChunkBytes = chunkBytes;
+        double saveSec;
+        {
+            Repository repo(repoPath, options);
+            auto saveStart = std::chrono::steady_clock::now();
+            repo.saveFile("artifact.bin", content, "bench", "large upload", "master");
+            saveSec = secondsSince(saveStart);
+        }
+
+        std::cout << threads << "\t " << mb / encodeSec << "\t      " << mb / decodeSec
+                  << "\t   " << mb / saveSec << "\t  "
+                  << static_cast<double>(content.size()) / encoded.size() << std::endl;
+    }
+
+    std::filesystem::remove_all(repoPath);
+    return 0;
+}
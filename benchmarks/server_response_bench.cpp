@@ -0,0 +1,223 @@
+// Бенчмарк задержки GET_HISTORY и GET_BRANCHES через настоящий сервер на loopback:
+// время от отправки запроса до получения последнего байта ответа.
+// --baseline сначала измеряет прежний путь ответа (каждое поле — отдельный async_write)
+// на тех же данных и той же машине.
+#include "../servers/mini_git_server.h"
+#include <chrono>
+#include <iostream>
+
+using deltasync::MiniGitServer;
+using deltasync::ServerOptions;
+
+namespace {
+
+constexpr uint32_t kGetBranches = 3;
+constexpr uint32_t kGetHistory = 4;
+
+void appendString(std::vector<uint8_t>& out, const std::string& str) {
+    uint32_t length = static_cast<uint32_t>(str.size());
+    const auto* p = reinterpret_cast<const uint8_t*>(&length);
+    out.insert(out.end(), p, p + sizeof(length));
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+// Одиночный режим: сервер закрывает соединение после ответа, ответ читается до EOF
+size_t roundTrip(int port, const std::vector<uint8_t>& request) {
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::socket socket(io);
+    socket.connect({boost::asio::ip::address_v4::loopback(), static_cast<unsigned short>(port)});
+    socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    std::vector<uint8_t> response;
+    boost::system::error_code error;
+    boost::asio::read(socket, boost::asio::dynamic_buffer(response), error);
+    if (error != boost::asio::error::eof || response.empty() || response[0] != 1) {
+        throw std::runtime_error("Request failed");
+    }
+    return response.size();
+}
+
+// Прежний путь ответа сервера, до сборки ответа в одну векторную запись: поля уходят
+// в сокет по одному. Тот же одиночный протокол, запрос выполняется в потоке соединения.
+class LegacyResponder {
+public:
+    LegacyResponder(const std::filesystem::path& repoPath, int port)
+        : repo(repoPath),
+          acceptor(io, {boost::asio::ip::tcp::v4(), static_cast<unsigned short>(port)}) {
+        boost::asio::co_spawn(io, acceptLoop(), boost::asio::detached);
+        thread = std::thread([this] { io.run(); });
+    }
+
+    ~LegacyResponder() {
+        io.stop();
+        thread.join();
+    }
+
+private:
+    using Socket = boost::asio::ip::tcp::socket;
+
+    Repository repo;
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::acceptor acceptor;
+    std::thread thread;
+
+    boost::asio::awaitable<void> acceptLoop() {
+        while (true) {
+            Socket socket = co_await acceptor.async_accept(boost::asio::use_awaitable);
+            boost::asio::co_spawn(io, serve(std::move(socket)), boost::asio::detached);
+        }
+    }
+
+    static boost::asio::awaitable<void> writeString(Socket& socket, const std::string& str) {
+        uint32_t length = static_cast<uint32_t>(str.size());
+        co_await boost::asio::async_write(socket, boost::asio::buffer(&length, sizeof(length)),
+                                          boost::asio::use_awaitable);
+        if (length > 0) {
+            co_await boost::asio::async_write(socket, boost::asio::buffer(str.data(), str.size()),
+                                              boost::asio::use_awaitable);
+        }
+    }
+
+    boost::asio::awaitable<void> serve(Socket socket) {
+        try {
+            uint32_t type;
+            co_await boost::asio::async_read(socket, boost::asio::buffer(&type, sizeof(type)),
+                                             boost::asio::use_awaitable);
+
+            std::vector<std::string> branches;
+            std::vector<FileVersion> history;
+            if (type == kGetHistory) {
+                uint32_t length;
+                co_await boost::asio::async_read(socket, boost::asio::buffer(&length, sizeof(length)),
+                                                 boost::asio::use_awaitable);
+                std::string fileName(length, '\0');
+                co_await boost::asio::async_read(socket, boost::asio::buffer(fileName.data(), length),
+                                                 boost::asio::use_awaitable);
+                history = repo.getFileHistory(fileName);
+            } else {
+                branches = repo.getBranches();
+            }
+
+            uint8_t success = 1;
+            co_await boost::asio::async_write(socket, boost::asio::buffer(&success, sizeof(success)),
+                                              boost::asio::use_awaitable);
+            std::string message = type == kGetHistory ? "History retrieved" : "Branches retrieved";
+            co_await writeString(socket, message);
+
+            uint32_t count = static_cast<uint32_t>(type == kGetHistory ? history.size() : branches.size());
+            co_await boost::asio::async_write(socket, boost::asio::buffer(&count, sizeof(count)),
+                                              boost::asio::use_awaitable);
+            for (const auto& branch : branches) {
+                co_await writeString(socket, branch);
+            }
+            for (const auto& version : history) {
+                // Временные объекты в выражении co_await GCC 12 разрушает неверно — только именованные
+                std::string hash = version.hash.hex();
+                std::string parentHash = version.parentHash.empty() ? std::string() : version.parentHash.hex();
+                co_await writeString(socket, hash);
+                co_await writeString(socket, parentHash);
+
+                auto timestamp = std::chrono::system_clock::to_time_t(version.timestamp);
+                co_await boost::asio::async_write(socket, boost::asio::buffer(&timestamp, sizeof(timestamp)),
+                                                  boost::asio::use_awaitable);
+
+                co_await writeString(socket, version.author);
+                co_await writeString(socket, version.message);
+
+                uint8_t isDelta = version.isDelta ? 1 : 0;
+                co_await boost::asio::async_write(socket, boost::asio::buffer(&isDelta, sizeof(isDelta)),
+                                                  boost::asio::use_awaitable);
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Baseline responder: " << e.what() << std::endl;
+        }
+    }
+};
+
+void measure(const std::string& name, int port, const std::vector<uint8_t>& request, size_t iterations) {
+    roundTrip(port, request);  // прогрев кэшей истории
+
+    std::vector<double> latencies;
+    size_t bytes = 0;
+    for (size_t i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        bytes = roundTrip(port, request);
+        latencies.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << name << ": response " << bytes << " bytes, p50 " << latencies[latencies.size() / 2]
+              << " us, p99 " << latencies[latencies.size() * 99 / 100] << " us" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    size_t versions = 10000;
+    size_t branches = 1000;
+    size_t iterations = 200;
+    int port = 18080;
+    bool baseline = false;
+    std::filesystem::path repoPath = "./server_response_bench_repo";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--versions" && i + 1 < argc) {
+            versions = std::stoul(argv[++i]);
+        } else if (arg == "--branches" && i + 1 < argc) {
+            branches = std::stoul(argv[++i]);
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoul(argv[++i]);
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (arg == "--repo" && i + 1 < argc) {
+            repoPath = argv[++i];
+        } else if (arg == "--baseline") {
+            baseline = true;
+        }
+    }
+
+    std::filesystem::remove_all(repoPath);
+    {
+        Repository repo(repoPath);
+        std::vector<uint8_t> content(256, 'a');
+        for (size_t v = 0; v < versions; v++) {
+            content[v % content.size()] = static_cast<uint8_t>('a' + v % 26);
+            repo.saveFile("history.txt", content, "bench", "revision " + std::to_string(v), "master");
+        }
+    }
+    // Ветка — файл в каталоге branches; репозиторий подхватывает их при загрузке
+    for (size_t b = 0; b < branches; b++) {
+        std::ofstream(repoPath / "branches" / ("feature-" + std::to_string(b)));
+    }
+
+    std::vector<uint8_t> historyRequest;
+    historyRequest.resize(sizeof(kGetHistory));
+    memcpy(historyRequest.data(), &kGetHistory, sizeof(kGetHistory));
+    appendString(historyRequest, "history.txt");
+
+    std::vector<uint8_t> branchesRequest(sizeof(kGetBranches));
+    memcpy(branchesRequest.data(), &kGetBranches, sizeof(kGetBranches));
+
+    std::cout << versions << " versions, " << branches + 1 << " branches, " << iterations << " requests each"
+              << std::endl;
+
+    // Прежний путь работает со своим экземпляром репозитория и завершается до запуска сервера
+    if (baseline) {
+        LegacyResponder legacy(repoPath, port);
+        measure("GET_HISTORY (per-field writes)", port, historyRequest, iterations);
+        measure("GET_BRANCHES (per-field writes)", port, branchesRequest, iterations);
+    }
+
+    MiniGitServer server(repoPath, port, ServerOptions{});
+    std::thread serverThread([&server] { server.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    measure("GET_HISTORY", port, historyRequest, iterations);
+    measure("GET_BRANCHES", port, branchesRequest, iterations);
+
+    server.stop();
+    serverThread.join();
+    return 0;
+}
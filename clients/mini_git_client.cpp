@@ -1,81 +1,825 @@
 #include "mini_git_client.h"
+#include "../engines/diff_engine.h"
 #include <cstring>
+#include <ctime>
+#include <deque>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace deltasync {
 
-MiniGitClient::MiniGitClient(const std::string& serverIp, int port) 
-    : socket(io_context) {
-    boost::asio::ip::tcp::endpoint endpoint(
-        boost::asio::ip::make_address(serverIp), 
-        port
-    );
-    socket.connect(endpoint);
-}
-
-bool MiniGitClient::saveFile(
-    const std::string& fileName,
-    const std::string& branch,
-    const std::string& author,
-    const std::string& message,
-    const std::vector<uint8_t>& content
-) {
-    std::vector<uint8_t> request;
-    uint32_t requestType = 0;
-    
-    request.insert(request.end(), (uint8_t*)&requestType, (uint8_t*)&requestType + sizeof(uint32_t));
-    
-    auto pushStr = [&](const std::string& str) {
-        uint32_t len = str.size();
-        request.insert(request.end(), (uint8_t*)&len, (uint8_t*)&len + sizeof(uint32_t));
-        request.insert(request.end(), str.begin(), str.end());
+// Номера совпадают с MiniGitServer::RequestType
+enum class MiniGitClient::RequestType : uint32_t {
+    SAVE_FILE,
+    GET_LATEST,
+    GET_VERSION,
+    GET_BRANCHES,
+    GET_HISTORY,
+    SAVE_FILE_BEGIN,
+    SAVE_FILE_CHUNK,
+    SAVE_FILE_END,
+    GET_DELTA,
+    SAVE_DELTA,
+    SAVE_BATCH,
+    GET_MANIFEST,
+    GET_CHUNKS
+};
+
+namespace {
+
+// "DSF1": соединение переходит в кадровый режим
+constexpr uint32_t kFramedMagic = 0x31465344;
+
+// Одна запись в сокет собирает не больше стольких кадров
+constexpr size_t kMaxGatherFrames = 256;
+constexpr size_t kMaxGatherBytes = 1u << 20;
+
+template <typename T>
+void appendValue(std::vector<uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void appendString(std::vector<uint8_t>& out, const std::string& str) {
+    appendValue(out, static_cast<uint32_t>(str.size()));
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+// Разбор тела ответа: uint8 успех | строка сообщения | поля запроса
+class ResponseReader {
+public:
+    explicit ResponseReader(std::span<const uint8_t> data) : data(data) {}
+
+    template <typename T>
+    T value() {
+        T result;
+        memcpy(&result, take(sizeof(T)), sizeof(T));
+        return result;
+    }
+
+    std::string string() {
+        auto length = value<uint32_t>();
+        return std::string(reinterpret_cast<const char*>(take(length)), length);
+    }
+
+    // uint32 длина | данные, без копирования
+    std::span<const uint8_t> bytes() {
+        auto length = value<uint32_t>();
+        return {take(length), length};
+    }
+
+    // Пустые содержимое, список веток и история передаются без полей
+    bool atEnd() const { return pos == data.size(); }
+
+    // Сообщение успешного ответа; сообщение неуспешного — исключением
+    std::string success() {
+        bool ok = value<uint8_t>() == 1;
+        std::string message = string();
+        if (!ok) {
+            throw std::runtime_error(message);
+        }
+        return message;
+    }
+
+private:
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+
+    const uint8_t* take(size_t n) {
+        if (n > data.size() - pos) {
+            throw std::runtime_error("Truncated response");
+        }
+        const uint8_t* p = data.data() + pos;
+        pos += n;
+        return p;
+    }
+};
+
+// Хеш из сообщения "File saved with hash: <hex>"
+std::string savedHash(const std::string& message) {
+    auto space = message.rfind(' ');
+    return space == std::string::npos ? std::string() : message.substr(space + 1);
+}
+
+std::vector<uint8_t> readContent(ResponseReader& in) {
+    if (in.atEnd()) return {};
+    auto data = in.bytes();
+    return {data.begin(), data.end()};
+}
+
+// Обработчик ответа, который выполняет обещание результатом parse
+template <typename T, typename Parse>
+auto fulfil(std::shared_ptr<std::promise<T>> promise, Parse parse) {
+    return [promise, parse](std::exception_ptr error, std::span<const uint8_t> body) {
+        if (error) {
+            promise->set_exception(error);
+            return;
+        }
+        try {
+            ResponseReader in(body);
+            promise->set_value(parse(in));
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
     };
-    
-    pushStr(fileName);
-    pushStr(branch);
-    pushStr(author);
-    pushStr(message);
-    request.insert(request.end(), content.begin(), content.end());
-    
-    sendRequest(request);
-    auto response = receiveResponse();
-    
-    return response.size() > 0 && response[0] == 1; // success = true
 }
 
-std::vector<uint8_t> MiniGitClient::getLatest(const std::string& fileName, const std::string& branch) {
-    uint32_t requestType = 1; // GET_LATEST
-    std::vector<uint8_t> request;
-    
-    request.insert(request.end(), (uint8_t*)&requestType, (uint8_t*)&requestType + sizeof(uint32_t));
-    
-    auto pushStr = [&](const std::string& str) {
-        uint32_t len = str.size();
-        request.insert(request.end(), (uint8_t*)&len, (uint8_t*)&len + sizeof(uint32_t));
-        request.insert(request.end(), str.begin(), str.end());
+} // namespace
+
+struct MiniGitClient::Connection {
+    explicit Connection(boost::asio::io_context& io) : socket(io) {}
+
+    Socket socket;
+    bool ready = false;    // соединение установлено и переведено в кадровый режим
+    bool writing = false;
+    bool failed = false;
+    std::deque<Frame> outbox;
+    std::unordered_map<uint64_t, Handler> pending;  // ответы, которых ждём, по id
+};
+
+struct MiniGitClient::ChunkDownload {
+    std::string fileName;
+    ChunkManifest manifest;
+    std::unordered_map<Digest, Content> chunks;  // уже полученные, по идентификатору
+    size_t pendingRequests = 0;
+    bool failed = false;
+};
+
+MiniGitClient::MiniGitClient(const std::string& serverIp, int port, ClientOptions options)
+    : options(options),
+      work(boost::asio::make_work_guard(io_context)),
+      endpoint(boost::asio::ip::make_address(serverIp), port),
+      pool(std::max<size_t>(1, options.connections)) {
+    thread = std::thread([this] { io_context.run(); });
+}
+
+MiniGitClient::~MiniGitClient() {
+    // Незавершённые запросы получают ошибку; корутины соединений выходят, и run() возвращается
+    boost::asio::post(io_context, [this] {
+        closing = true;
+        auto error = std::make_exception_ptr(std::runtime_error("Client is closed"));
+        for (auto& connection : pool) {
+            if (connection) fail(connection, error);
+        }
+    });
+    work.reset();
+    thread.join();
+}
+
+MiniGitClient::Frame MiniGitClient::makeFrame(RequestType type) {
+    Frame frame;
+    frame.id = nextId++;
+    appendValue(frame.head, uint32_t{0});  // длина кадра, заполняется в submit
+    appendValue(frame.head, frame.id);
+    appendValue(frame.head, static_cast<uint32_t>(type));
+    return frame;
+}
+
+void MiniGitClient::submit(Frame frame) {
+    std::vector<Frame> frames;
+    frames.push_back(std::move(frame));
+    submit(std::move(frames));
+}
+
+void MiniGitClient::submit(std::vector<Frame> frames) {
+    for (auto& frame : frames) {
+        uint64_t length = frame.head.size() - sizeof(uint32_t) + frame.payload.size();
+        if (length > UINT32_MAX) {
+            throw std::invalid_argument("Request of " + std::to_string(length) + " bytes does not fit in a frame");
+        }
+        auto length32 = static_cast<uint32_t>(length);
+        memcpy(frame.head.data(), &length32, sizeof(length32));
+    }
+    boost::asio::post(io_context, [this, frames = std::move(frames)]() mutable { dispatch(frames); });
+}
+
+void MiniGitClient::dispatch(std::vector<Frame>& frames) {
+    if (closing) {
+        auto error = std::make_exception_ptr(std::runtime_error("Client is closed"));
+        for (auto& frame : frames) {
+            if (frame.handler) frame.handler(error, {});
+        }
+        return;
+    }
+
+    auto connection = pickConnection();
+    for (auto& frame : frames) {
+        if (frame.handler) {
+            connection->pending.emplace(frame.id, std::move(frame.handler));
+        }
+        connection->outbox.push_back(std::move(frame));
+    }
+
+    if (connection->ready && !connection->writing) {
+        connection->writing = true;
+        boost::asio::co_spawn(io_context, flush(connection), boost::asio::detached);
+    }
+}
+
+// Соединения открываются при первом запросе и после обрыва
+std::shared_ptr<MiniGitClient::Connection> MiniGitClient::pickConnection() {
+    std::shared_ptr<Connection> best;
+    for (auto& slot : pool) {
+        if (!slot || slot->failed) {
+            slot = std::make_shared<Connection>(io_context);
+            boost::asio::co_spawn(io_context, runConnection(slot), boost::asio::detached);
+        }
+        if (!best || slot->pending.size() < best->pending.size()) {
+            best = slot;
+        }
+    }
+    return best;
+}
+
+// Подключение и чтение ответов; ответ передаётся обработчику по id кадра
+boost::asio::awaitable<void> MiniGitClient::runConnection(std::shared_ptr<Connection> connection) {
+    try {
+        co_await connection->socket.async_connect(endpoint, boost::asio::use_awaitable);
+        connection->socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+        uint32_t magic = kFramedMagic;
+        co_await boost::asio::async_write(connection->socket, boost::asio::buffer(&magic, sizeof(magic)),
+                                          boost::asio::use_awaitable);
+        connection->ready = true;
+        if (!connection->outbox.empty() && !connection->writing) {
+            connection->writing = true;
+            boost::asio::co_spawn(io_context, flush(connection), boost::asio::detached);
+        }
+
+        std::vector<uint8_t> body;
+        while (true) {
+            uint32_t length;
+            co_await boost::asio::async_read(connection->socket, boost::asio::buffer(&length, sizeof(length)),
+                                             boost::asio::use_awaitable);
+            if (length < sizeof(uint64_t)) {
+                throw std::runtime_error("Invalid response frame length: " + std::to_string(length));
+            }
+
+            body.resize(length);
+            co_await boost::asio::async_read(connection->socket, boost::asio::buffer(body),
+                                             boost::asio::use_awaitable);
+
+            uint64_t id;
+            memcpy(&id, body.data(), sizeof(id));
+            auto it = connection->pending.find(id);
+            if (it == connection->pending.end()) {
+                // Ошибка части загрузки: она же придёт в ответе на SAVE_FILE_END
+                continue;
+            }
+            Handler handler = std::move(it->second);
+            connection->pending.erase(it);
+            handler(nullptr, std::span<const uint8_t>(body).subspan(sizeof(id)));
+        }
+    } catch (...) {
+        fail(connection, std::current_exception());
+    }
+}
+
+// Накопленные кадры уходят одной записью. Писатель один: флаг writing ставит запустивший его
+boost::asio::awaitable<void> MiniGitClient::flush(std::shared_ptr<Connection> connection) {
+    try {
+        std::vector<Frame> sending;
+        std::vector<boost::asio::const_buffer> buffers;
+        while (!connection->outbox.empty() && !connection->failed) {
+            sending.clear();
+            buffers.clear();
+            size_t bytes = 0;
+            while (!connection->outbox.empty() && sending.size() < kMaxGatherFrames && bytes < kMaxGatherBytes) {
+                sending.push_back(std::move(connection->outbox.front()));
+                connection->outbox.pop_front();
+
+                const Frame& frame = sending.back();
+                buffers.push_back(boost::asio::buffer(frame.head));
+                if (!frame.payload.empty()) {
+                    buffers.push_back(boost::asio::buffer(frame.payload.data(), frame.payload.size()));
+                }
+                bytes += frame.head.size() + frame.payload.size();
+            }
+            co_await boost::asio::async_write(connection->socket, buffers, boost::asio::use_awaitable);
+        }
+    } catch (...) {
+        fail(connection, std::current_exception());
+    }
+    connection->writing = false;
+}
+
+void MiniGitClient::fail(const std::shared_ptr<Connection>& connection, std::exception_ptr error) {
+    connection->failed = true;
+    connection->ready = false;
+    boost::system::error_code ignored;
+    connection->socket.close(ignored);
+    connection->outbox.clear();
+
+    auto pending = std::move(connection->pending);
+    connection->pending.clear();
+    for (auto& [id, handler] : pending) {
+        handler(error, {});
+    }
+}
+
+std::optional<MiniGitClient::SyncedVersion> MiniGitClient::syncedVersion(const std::string& fileName,
+                                                                         const std::string& branch) {
+    std::lock_guard lock(syncedMutex);
+    auto it = syncedVersions.find({fileName, branch});
+    if (it == syncedVersions.end()) return std::nullopt;
+    return it->second;
+}
+
+void MiniGitClient::rememberVersion(const std::string& fileName, const std::string& branch, std::string hash,
+                                    Content content) {
+    std::lock_guard lock(syncedMutex);
+    if (hash.empty()) {
+        syncedVersions.erase({fileName, branch});
+        return;
+    }
+    syncedVersions[{fileName, branch}] = SyncedVersion{std::move(hash), std::move(content)};
+}
+
+std::future<std::string> MiniGitClient::saveFileAsync(const std::string& fileName, const std::string& branch,
+                                                      const std::string& author, const std::string& message,
+                                                      std::vector<uint8_t> content) {
+    auto promise = std::make_shared<std::promise<std::string>>();
+    auto future = promise->get_future();
+    Content data = std::make_shared<const std::vector<uint8_t>>(std::move(content));
+
+    if (auto base = syncedVersion(fileName, branch)) {
+        Content delta = std::make_shared<const std::vector<uint8_t>>(DiffEngine::computeDelta(*base->content, *data));
+        if (delta->size() < data->size()) {
+            Frame frame = makeFrame(RequestType::SAVE_DELTA);
+            appendString(frame.head, fileName);
+            appendString(frame.head, branch);
+            appendString(frame.head, author);
+            appendString(frame.head, message);
+            appendString(frame.head, base->hash);
+            appendString(frame.head, DiffEngine::computeHash(*data));
+            appendValue(frame.head, static_cast<uint32_t>(delta->size()));
+            frame.payload = *delta;
+            frame.payloadOwner = std::move(delta);
+
+            frame.handler = [this, promise, data, fileName, branch, author, message](
+                    std::exception_ptr error, std::span<const uint8_t> body) {
+                if (error) {
+                    promise->set_exception(error);
+                    return;
+                }
+                try {
+                    ResponseReader in(body);
+                    bool ok = in.value<uint8_t>() == 1;
+                    std::string reply = in.string();
+                    if (!ok) {
+                        sendFull(fileName, branch, author, message, data, promise);
+                        return;
+                    }
+                    std::string hash = savedHash(reply);
+                    rememberVersion(fileName, branch, hash, data);
+                    promise->set_value(hash);
+                } catch (...) {
+                    promise->set_exception(std::current_exception());
+                }
+            };
+            submit(std::move(frame));
+            return future;
+        }
+    }
+
+    sendFull(fileName, branch, author, message, std::move(data), promise);
+    return future;
+}
+
+// Файл целиком: одним SAVE_FILE либо, если он больше порога, частями в одном соединении
+void MiniGitClient::sendFull(const std::string& fileName, const std::string& branch, const std::string& author,
+                             const std::string& message, Content content,
+                             std::shared_ptr<std::promise<std::string>> promise) {
+    auto remember = [this, fileName, branch, content](const std::string& reply) {
+        std::string hash = savedHash(reply);
+        rememberVersion(fileName, branch, hash, content);
+        return hash;
     };
-    
-    pushStr(fileName);
-    pushStr(branch);
-    
-    sendRequest(request);
-    return receiveResponse();
+
+    if (content->size() <= options.chunkedUploadThreshold) {
+        Frame frame = makeFrame(RequestType::SAVE_FILE);
+        appendString(frame.head, fileName);
+        appendString(frame.head, branch);
+        appendString(frame.head, author);
+        appendString(frame.head, message);
+        appendValue(frame.head, static_cast<uint32_t>(content->size()));
+        frame.payload = *content;
+        frame.payloadOwner = content;
+        frame.handler = fulfil(promise, [remember](ResponseReader& in) { return remember(in.success()); });
+        submit(std::move(frame));
+        return;
+    }
+
+    std::vector<Frame> frames;
+
+    // Отказ на SAVE_FILE_BEGIN приходит раньше ответа на SAVE_FILE_END и точнее его ("Unknown upload")
+    auto beginError = std::make_shared<std::string>();
+    Frame begin = makeFrame(RequestType::SAVE_FILE_BEGIN);
+    appendString(begin.head, fileName);
+    appendString(begin.head, branch);
+    appendString(begin.head, author);
+    appendString(begin.head, message);
+    appendValue(begin.head, static_cast<uint64_t>(content->size()));
+    begin.handler = [beginError](std::exception_ptr error, std::span<const uint8_t> body) {
+        if (error) return;
+        try {
+            ResponseReader in(body);
+            if (in.value<uint8_t>() != 1) *beginError = in.string();
+        } catch (const std::exception& e) {
+            *beginError = e.what();
+        }
+    };
+    uint64_t uploadId = begin.id;
+    frames.push_back(std::move(begin));
+
+    size_t chunkBytes = std::max<size_t>(1, options.uploadChunkBytes);
+    for (size_t pos = 0; pos < content->size(); pos += chunkBytes) {
+        Frame chunk = makeFrame(RequestType::SAVE_FILE_CHUNK);
+        appendValue(chunk.head, uploadId);
+        chunk.payload = std::span<const uint8_t>(*content).subspan(pos, std::min(chunkBytes, content->size() - pos));
+        chunk.payloadOwner = content;
+        frames.push_back(std::move(chunk));
+    }
+
+    Frame end = makeFrame(RequestType::SAVE_FILE_END);
+    appendValue(end.head, uploadId);
+    appendString(end.head, DiffEngine::computeHash(*content));
+    end.handler = fulfil(promise, [remember, beginError](ResponseReader& in) {
+        bool ok = in.value<uint8_t>() == 1;
+        std::string reply = in.string();
+        if (!ok) {
+            throw std::runtime_error(beginError->empty() ? reply : *beginError);
+        }
+        return remember(reply);
+    });
+    frames.push_back(std::move(end));
+
+    submit(std::move(frames));
+}
+
+std::future<std::vector<uint8_t>> MiniGitClient::getLatestAsync(const std::string& fileName,
+                                                                const std::string& branch) {
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    auto future = promise->get_future();
+
+    Frame frame = makeFrame(RequestType::GET_LATEST);
+    appendString(frame.head, fileName);
+    appendString(frame.head, branch);
+    frame.handler = fulfil(promise, [](ResponseReader& in) {
+        in.success();
+        return readContent(in);
+    });
+    submit(std::move(frame));
+    return future;
+}
+
+std::future<std::vector<uint8_t>> MiniGitClient::getVersionAsync(const std::string& fileName,
+                                                                 const std::string& hash) {
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    auto future = promise->get_future();
+    requestVersion(fileName, hash, promise);
+    return future;
+}
+
+void MiniGitClient::requestVersion(const std::string& fileName, const std::string& hash,
+                                   std::shared_ptr<std::promise<std::vector<uint8_t>>> promise) {
+    Frame frame = makeFrame(RequestType::GET_VERSION);
+    appendString(frame.head, fileName);
+    appendString(frame.head, hash);
+    frame.handler = fulfil(promise, [](ResponseReader& in) {
+        in.success();
+        return readContent(in);
+    });
+    submit(std::move(frame));
+}
+
+std::future<std::vector<uint8_t>> MiniGitClient::getVersionByChunksAsync(const std::string& fileName,
+                                                                         const std::string& hash) {
+    auto promise = std::make_shared<std::promise<std::vector<uint8_t>>>();
+    auto future = promise->get_future();
+
+    Frame frame = makeFrame(RequestType::GET_MANIFEST);
+    appendString(frame.head, fileName);
+    appendString(frame.head, hash);
+    frame.handler = [this, promise, fileName, hash](std::exception_ptr error, std::span<const uint8_t> body) {
+        if (error) {
+            promise->set_exception(error);
+            return;
+        }
+        try {
+            ResponseReader in(body);
+            in.success();
+            if (in.value<uint8_t>() != 1) {
+                requestVersion(fileName, hash, promise);
+                return;
+            }
+
+            auto download = std::make_shared<ChunkDownload>();
+            download->fileName = fileName;
+            download->manifest.totalSize = in.value<uint64_t>();
+            uint32_t count = in.value<uint32_t>();
+            uint64_t total = 0;
+            for (uint32_t i = 0; i < count; i++) {
+                ChunkManifest::Entry chunk;
+                chunk.hash = Digest::fromHex(in.string());
+                chunk.length = in.value<uint64_t>();
+                total += chunk.length;
+                download->manifest.chunks.push_back(chunk);
+            }
+            if (total != download->manifest.totalSize) {
+                throw std::runtime_error("Chunk manifest size mismatch for " + fileName);
+            }
+            requestChunks(std::move(download), promise);
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    };
+    submit(std::move(frame));
+    return future;
+}
+
+void MiniGitClient::requestChunks(std::shared_ptr<ChunkDownload> download,
+                                  std::shared_ptr<std::promise<std::vector<uint8_t>>> promise) {
+    auto assemble = [download] {
+        std::vector<uint8_t> content;
+        content.reserve(download->manifest.totalSize);
+        for (const auto& chunk : download->manifest.chunks) {
+            const auto& data = *download->chunks.at(chunk.hash);
+            content.insert(content.end(), data.begin(), data.end());
+        }
+        return content;
+    };
+
+    // Недостающие куски делятся на запросы не больше chunkRequestBytes; повторы в списке запрашиваются один раз
+    std::vector<std::vector<ChunkManifest::Entry>> requests;
+    std::unordered_set<Digest> requested;
+    uint64_t requestBytes = 0;
+    for (const auto& chunk : download->manifest.chunks) {
+        if (download->chunks.contains(chunk.hash) || requested.contains(chunk.hash)) continue;
+
+        auto cached = chunkCache.find(chunk.hash);
+        if (cached != chunkCache.end() && cached->second->size() == chunk.length) {
+            download->chunks.emplace(chunk.hash, cached->second);
+            continue;
+        }
+
+        if (requests.empty() || (requestBytes + chunk.length > options.chunkRequestBytes && !requests.back().empty())) {
+            requests.emplace_back();
+            requestBytes = 0;
+        }
+        requests.back().push_back(chunk);
+        requested.insert(chunk.hash);
+        requestBytes += chunk.length;
+    }
+
+    if (requests.empty()) {
+        promise->set_value(assemble());
+        return;
+    }
+
+    download->pendingRequests = requests.size();
+    for (auto& chunks : requests) {
+        Frame frame = makeFrame(RequestType::GET_CHUNKS);
+        appendValue(frame.head, static_cast<uint32_t>(chunks.size()));
+        for (const auto& chunk : chunks) {
+            appendString(frame.head, chunk.hash.hex());
+            appendValue(frame.head, chunk.length);
+        }
+
+        // Обработчики выполняются в потоке клиента, общее состояние загрузки без блокировок
+        frame.handler = [this, download, promise, assemble, chunks = std::move(chunks)](
+                std::exception_ptr error, std::span<const uint8_t> body) {
+            if (download->failed) return;
+            try {
+                if (error) std::rethrow_exception(error);
+                ResponseReader in(body);
+                in.success();
+                std::span<const uint8_t> data = in.atEnd() ? std::span<const uint8_t>() : in.bytes();
+
+                size_t pos = 0;
+                for (const auto& chunk : chunks) {
+                    if (chunk.length > data.size() - pos) {
+                        throw std::runtime_error("Truncated chunk response for " + download->fileName);
+                    }
+                    auto piece = data.subspan(pos, static_cast<size_t>(chunk.length));
+                    pos += piece.size();
+                    // Идентификатор куска — быстрый хеш либо SHA-256, смотря по ChunkIdentity сервера
+                    if (FastHash::chunkId(piece) != chunk.hash && DiffEngine::computeDigest(piece) != chunk.hash) {
+                        throw std::runtime_error("Chunk hash mismatch: " + chunk.hash.hex());
+                    }
+                    Content content = std::make_shared<const std::vector<uint8_t>>(piece.begin(), piece.end());
+                    download->chunks.emplace(chunk.hash, content);
+                    rememberChunk(chunk.hash, std::move(content));
+                }
+
+                if (--download->pendingRequests == 0) {
+                    promise->set_value(assemble());
+                }
+            } catch (...) {
+                download->failed = true;
+                promise->set_exception(std::current_exception());
+            }
+        };
+        submit(std::move(frame));
+    }
+}
+
+void MiniGitClient::rememberChunk(const Digest& hash, Content chunk) {
+    if (chunk->size() > options.chunkCacheBytes || chunkCache.contains(hash)) return;
+
+    chunkCacheBytes += chunk->size();
+    chunkCache.emplace(hash, std::move(chunk));
+    chunkOrder.push_back(hash);
+    while (chunkCacheBytes > options.chunkCacheBytes) {
+        auto oldest = chunkCache.find(chunkOrder.front());
+        chunkCacheBytes -= oldest->second->size();
+        chunkCache.erase(oldest);
+        chunkOrder.pop_front();
+    }
+}
+
+std::future<MiniGitClient::FileSnapshot> MiniGitClient::getLatestDeltaAsync(const std::string& fileName,
+                                                                            const std::string& branch) {
+    auto promise = std::make_shared<std::promise<FileSnapshot>>();
+    auto future = promise->get_future();
+
+    auto base = syncedVersion(fileName, branch);
+    requestDelta(fileName, branch, base ? std::move(*base) : SyncedVersion{}, promise);
+    return future;
+}
+
+std::future<MiniGitClient::FileSnapshot> MiniGitClient::getLatestDeltaAsync(const std::string& fileName,
+                                                                            const std::string& branch,
+                                                                            FileSnapshot base) {
+    auto promise = std::make_shared<std::promise<FileSnapshot>>();
+    auto future = promise->get_future();
+
+    SyncedVersion version{std::move(base.hash), std::make_shared<const std::vector<uint8_t>>(std::move(base.content))};
+    requestDelta(fileName, branch, std::move(version), promise);
+    return future;
+}
+
+void MiniGitClient::requestDelta(const std::string& fileName, const std::string& branch, SyncedVersion base,
+                                 std::shared_ptr<std::promise<FileSnapshot>> promise) {
+    Frame frame = makeFrame(RequestType::GET_DELTA);
+    appendString(frame.head, fileName);
+    appendString(frame.head, branch);
+    appendString(frame.head, base.hash);
+
+    // Дельта применяется в потоке клиента при разборе ответа
+    frame.handler = fulfil(promise, [this, fileName, branch, base](ResponseReader& in) {
+        in.success();
+        bool isDelta = in.value<uint8_t>() == 1;
+        std::string versionHash = in.string();
+        std::string contentHash = in.string();
+        auto payload = in.bytes();
+
+        FileSnapshot snapshot;
+        snapshot.hash = versionHash;
+        if (isDelta) {
+            if (!base.content) {
+                throw std::runtime_error("Unexpected delta for " + fileName);
+            }
+            snapshot.content = DiffEngine::applyDeltaBounded(*base.content,
+                                                             std::vector<uint8_t>(payload.begin(), payload.end()),
+                                                             options.maxDeltaResultBytes);
+        } else {
+            snapshot.content.assign(payload.begin(), payload.end());
+        }
+
+        if (DiffEngine::computeHash(snapshot.content) != contentHash) {
+            throw std::runtime_error("Content hash mismatch for " + fileName);
+        }
+
+        rememberVersion(fileName, branch, versionHash, std::make_shared<const std::vector<uint8_t>>(snapshot.content));
+        return snapshot;
+    });
+    submit(std::move(frame));
 }
 
-void MiniGitClient::sendRequest(const std::vector<uint8_t>& requestData) {
-    boost::asio::write(socket, boost::asio::buffer(requestData));
+std::future<std::vector<std::string>> MiniGitClient::getBranchesAsync() {
+    auto promise = std::make_shared<std::promise<std::vector<std::string>>>();
+    auto future = promise->get_future();
+
+    Frame frame = makeFrame(RequestType::GET_BRANCHES);
+    frame.handler = fulfil(promise, [](ResponseReader& in) {
+        in.success();
+        std::vector<std::string> branches;
+        if (in.atEnd()) return branches;
+
+        uint32_t count = in.value<uint32_t>();
+        for (uint32_t i = 0; i < count; i++) {
+            branches.push_back(in.string());
+        }
+        return branches;
+    });
+    submit(std::move(frame));
+    return future;
+}
+
+std::future<std::vector<FileVersion>> MiniGitClient::getHistoryAsync(const std::string& fileName) {
+    auto promise = std::make_shared<std::promise<std::vector<FileVersion>>>();
+    auto future = promise->get_future();
+
+    Frame frame = makeFrame(RequestType::GET_HISTORY);
+    appendString(frame.head, fileName);
+    frame.handler = fulfil(promise, [](ResponseReader& in) {
+        in.success();
+        std::vector<FileVersion> history;
+        if (in.atEnd()) return history;
+
+        uint32_t count = in.value<uint32_t>();
+        for (uint32_t i = 0; i < count; i++) {
+            Digest hash = Digest::fromHex(in.string());
+            Digest parentHash = Digest::fromHex(in.string());
+            auto timestamp = std::chrono::system_clock::from_time_t(in.value<std::time_t>());
+            std::string author = in.string();
+            std::string message = in.string();
+            bool isDelta = in.value<uint8_t>() == 1;
+            history.emplace_back(hash, parentHash, timestamp, std::move(author), std::move(message), isDelta);
+        }
+        return history;
+    });
+    submit(std::move(frame));
+    return future;
 }
 
-std::vector<uint8_t> MiniGitClient::receiveResponse() {
-    std::vector<uint8_t> buffer(1024);
-    boost::system::error_code error;
-    size_t len = socket.read_some(boost::asio::buffer(buffer), error);
-    
-    if (error) {
-        throw boost::system::system_error(error);
+std::future<MiniGitClient::BatchResult> MiniGitClient::saveBatchAsync(const std::string& branch,
+                                                                      const std::string& author,
+                                                                      const std::string& message,
+                                                                      std::vector<BatchFile> files) {
+    auto promise = std::make_shared<std::promise<BatchResult>>();
+    auto future = promise->get_future();
+
+    Frame frame = makeFrame(RequestType::SAVE_BATCH);
+    appendString(frame.head, branch);
+    appendString(frame.head, author);
+    appendString(frame.head, message);
+    appendValue(frame.head, static_cast<uint32_t>(files.size()));
+    for (const auto& file : files) {
+        appendString(frame.head, file.fileName);
+        appendValue(frame.head, static_cast<uint32_t>(file.content.size()));
+        frame.head.insert(frame.head.end(), file.content.begin(), file.content.end());
     }
-    
-    buffer.resize(len);
-    return buffer;
+
+    frame.handler = fulfil(promise, [](ResponseReader& in) {
+        BatchResult result;
+        result.committed = in.value<uint8_t>() == 1;
+        result.message = in.string();
+
+        // Без списка файлов: пакет отклонён целиком (например, файл в нём повторяется)
+        if (in.atEnd()) return result;
+
+        uint32_t count = in.value<uint32_t>();
+        for (uint32_t i = 0; i < count; i++) {
+            bool saved = in.value<uint8_t>() == 1;
+            std::string text = in.string();
+            result.files.push_back(saved ? BatchFileResult{std::move(text), {}} : BatchFileResult{{}, std::move(text)});
+        }
+        return result;
+    });
+    submit(std::move(frame));
+    return future;
+}
+
+std::string MiniGitClient::saveFile(const std::string& fileName, const std::string& branch, const std::string& author,
+                                    const std::string& message, std::vector<uint8_t> content) {
+    return saveFileAsync(fileName, branch, author, message, std::move(content)).get();
+}
+
+std::vector<uint8_t> MiniGitClient::getLatest(const std::string& fileName, const std::string& branch) {
+    return getLatestAsync(fileName, branch).get();
+}
+
+std::vector<uint8_t> MiniGitClient::getVersion(const std::string& fileName, const std::string& hash) {
+    return getVersionAsync(fileName, hash).get();
+}
+
+std::vector<uint8_t> MiniGitClient::getVersionByChunks(const std::string& fileName, const std::string& hash) {
+    return getVersionByChunksAsync(fileName, hash).get();
+}
+
+MiniGitClient::FileSnapshot MiniGitClient::getLatestDelta(const std::string& fileName, const std::string& branch) {
+    return getLatestDeltaAsync(fileName, branch).get();
+}
+
+MiniGitClient::FileSnapshot MiniGitClient::getLatestDelta(const std::string& fileName, const std::string& branch,
+                                                          FileSnapshot base) {
+    return getLatestDeltaAsync(fileName, branch, std::move(base)).get();
+}
+
+std::vector<std::string> MiniGitClient::getBranches() {
+    return getBranchesAsync().get();
+}
+
+std::vector<FileVersion> MiniGitClient::getHistory(const std::string& fileName) {
+    return getHistoryAsync(fileName).get();
+}
+
+MiniGitClient::BatchResult MiniGitClient::saveBatch(const std::string& branch, const std::string& author,
+                                                    const std::string& message, std::vector<BatchFile> files) {
+    return saveBatchAsync(branch, author, message, std::move(files)).get();
 }
 
 } // namespace deltasync
\ No newline at end of file
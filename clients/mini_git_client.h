@@ -1,37 +1,208 @@
 #ifndef DELTASYNC_MINI_GIT_CLIENT_H
 #define DELTASYNC_MINI_GIT_CLIENT_H
 
+#include "../servers/file_version.h"
+#include "../engines/chunk_manifest.h"
+
 #include <boost/asio.hpp>
+#include <atomic>
 #include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
-#include <iostream>
 
 namespace deltasync {
 
+struct ClientOptions {
+    // Соединений в пуле; запрос уходит в то, где меньше всего ожидающих ответов
+    size_t connections = 4;
+
+    // Файлы больше порога загружаются частями (SAVE_FILE_BEGIN/CHUNK/END);
+    // порог должен быть меньше ServerOptions::maxFrameBytes
+    uint64_t chunkedUploadThreshold = 64u << 20;
+    size_t uploadChunkBytes = 4u << 20;
+
+    // Предельный размер файла, собираемого из дельты сервера (целиком сервер
+    // больше не отдаёт); защищает от дельты, объявляющей огромный результат
+    uint64_t maxDeltaResultBytes = UINT32_MAX;
+
+    // Куски, полученные getVersionByChunks, хранятся в памяти клиента до этого объёма
+    // (вытесняются самые старые); один запрос GET_CHUNKS — не больше chunkRequestBytes
+    uint64_t chunkCacheBytes = 256u << 20;
+    uint64_t chunkRequestBytes = 16u << 20;
+};
+
+// Клиент кадрового режима MiniGitServer (протокол — в mini_git_server.h).
+// Сокеты обслуживает собственный поток клиента; методы *Async можно вызывать из любых
+// потоков, они не ждут сети и возвращают std::future. Запросы конвейеризуются:
+// в соединении пула их сколько угодно, ответы сопоставляются по id кадра.
+// Ошибка сервера или соединения приходит исключением из future::get();
+// синхронные методы — обёртки над *Async(...).get().
 class MiniGitClient {
 public:
-    MiniGitClient(const std::string& serverIp, int port);
-    
-    bool saveFile(
-        const std::string& fileName,
-        const std::string& branch,
-        const std::string& author,
-        const std::string& message,
-        const std::vector<uint8_t>& content
-    );
-    
+    struct FileSnapshot {
+        std::string hash;  // hex-хеш версии
+        std::vector<uint8_t> content;
+    };
+
+    struct BatchFile {
+        std::string fileName;
+        std::vector<uint8_t> content;
+    };
+
+    struct BatchFileResult {
+        std::string hash;   // hex-хеш версии, если файл сохранён
+        std::string error;  // иначе причина
+    };
+
+    struct BatchResult {
+        bool committed = false;
+        std::string message;
+        std::vector<BatchFileResult> files;  // в порядке запроса
+    };
+
+    MiniGitClient(const std::string& serverIp, int port, ClientOptions options = {});
+    ~MiniGitClient();
+
+    MiniGitClient(const MiniGitClient&) = delete;
+    MiniGitClient& operator=(const MiniGitClient&) = delete;
+
+    // Хеш новой версии. Если у клиента есть последняя синхронизированная версия файла
+    // в ветке, отправляется дельта от неё; сервер не принял дельту (ветка ушла вперёд) —
+    // файл отправляется целиком
+    std::future<std::string> saveFileAsync(const std::string& fileName, const std::string& branch,
+                                           const std::string& author, const std::string& message,
+                                           std::vector<uint8_t> content);
+
+    std::future<std::vector<uint8_t>> getLatestAsync(const std::string& fileName, const std::string& branch);
+
+    std::future<std::vector<uint8_t>> getVersionAsync(const std::string& fileName, const std::string& hash);
+
+    // Версия, которую сервер хранит списком кусков, собирается из кусков: запрашиваются
+    // только отсутствующие в кэше кусков клиента. Версия, хранимая иначе, приходит целиком
+    std::future<std::vector<uint8_t>> getVersionByChunksAsync(const std::string& fileName, const std::string& hash);
+
+    // Последняя версия по дельте от последней синхронизированной версии; без неё — целиком
+    std::future<FileSnapshot> getLatestDeltaAsync(const std::string& fileName, const std::string& branch);
+
+    // То же от версии base, содержимое которой уже есть у вызывающего.
+    // Результат сверяется с SHA-256 из ответа
+    std::future<FileSnapshot> getLatestDeltaAsync(const std::string& fileName, const std::string& branch,
+                                                  FileSnapshot base);
+
+    std::future<std::vector<std::string>> getBranchesAsync();
+
+    // Версии файла во всех ветках; contentHash, chainDepth и chainBytes сервер не передаёт
+    std::future<std::vector<FileVersion>> getHistoryAsync(const std::string& fileName);
+
+    // Отказ пакета — не исключение: committed == false, причины по файлам в BatchResult::files
+    // (пустом, если пакет отклонён до сохранения файлов)
+    std::future<BatchResult> saveBatchAsync(const std::string& branch, const std::string& author,
+                                            const std::string& message, std::vector<BatchFile> files);
+
+    std::string saveFile(const std::string& fileName, const std::string& branch, const std::string& author,
+                         const std::string& message, std::vector<uint8_t> content);
     std::vector<uint8_t> getLatest(const std::string& fileName, const std::string& branch);
+    std::vector<uint8_t> getVersion(const std::string& fileName, const std::string& hash);
+    std::vector<uint8_t> getVersionByChunks(const std::string& fileName, const std::string& hash);
+    FileSnapshot getLatestDelta(const std::string& fileName, const std::string& branch);
+    FileSnapshot getLatestDelta(const std::string& fileName, const std::string& branch, FileSnapshot base);
     std::vector<std::string> getBranches();
-    std::vector<std::string> getHistory(const std::string& fileName, const std::string& branch);
+    std::vector<FileVersion> getHistory(const std::string& fileName);
+    BatchResult saveBatch(const std::string& branch, const std::string& author, const std::string& message,
+                          std::vector<BatchFile> files);
 
 private:
+    enum class RequestType : uint32_t;
+
+    using Socket = boost::asio::ip::tcp::socket;
+    template <typename T>
+    using Awaitable = boost::asio::awaitable<T>;
+    using Content = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // Тело ответа после id либо ошибка соединения; вызывается в потоке клиента
+    using Handler = std::function<void(std::exception_ptr error, std::span<const uint8_t> body)>;
+
+    // Кадр запроса: head — длина, id, тип и поля; payload — данные без копирования
+    struct Frame {
+        uint64_t id = 0;
+        std::vector<uint8_t> head;
+        Content payloadOwner;
+        std::span<const uint8_t> payload;
+        Handler handler;  // пустой — ответ не ждём (SAVE_FILE_CHUNK отвечает только ошибкой)
+    };
+
+    // Последняя версия, о которой клиент знает, что она есть на сервере
+    struct SyncedVersion {
+        std::string hash;
+        Content content;
+    };
+
+    struct Connection;
+
+    // Сборка версии из кусков
+    struct ChunkDownload;
+
+    ClientOptions options;
     boost::asio::io_context io_context;
-    boost::asio::ip::tcp::socket socket;
-    
-    void connect();
-    void sendRequest(const std::vector<uint8_t>& requestData);
-    std::vector<uint8_t> receiveResponse();
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work;
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::atomic<uint64_t> nextId{1};
+    std::vector<std::shared_ptr<Connection>> pool;  // только в потоке клиента
+    bool closing = false;                           // только в потоке клиента
+
+    std::mutex syncedMutex;
+    std::map<std::pair<std::string, std::string>, SyncedVersion> syncedVersions;  // (файл, ветка) -> версия
+
+    // Кэш кусков; только в потоке клиента
+    std::unordered_map<Digest, Content> chunkCache;
+    std::deque<Digest> chunkOrder;  // порядок добавления, для вытеснения
+    uint64_t chunkCacheBytes = 0;
+
+    std::thread thread;
+
+    Frame makeFrame(RequestType type);
+
+    // Кадры уходят подряд в одно соединение
+    void submit(std::vector<Frame> frames);
+    void submit(Frame frame);
+
+    // В потоке клиента
+    void dispatch(std::vector<Frame>& frames);
+    std::shared_ptr<Connection> pickConnection();
+
+    Awaitable<void> runConnection(std::shared_ptr<Connection> connection);
+    Awaitable<void> flush(std::shared_ptr<Connection> connection);
+    void fail(const std::shared_ptr<Connection>& connection, std::exception_ptr error);
+
+    void sendFull(const std::string& fileName, const std::string& branch, const std::string& author,
+                  const std::string& message, Content content,
+                  std::shared_ptr<std::promise<std::string>> promise);
+
+    void requestVersion(const std::string& fileName, const std::string& hash,
+                        std::shared_ptr<std::promise<std::vector<uint8_t>>> promise);
+
+    // В потоке клиента: запросы GET_CHUNKS на куски, которых нет в кэше
+    void requestChunks(std::shared_ptr<ChunkDownload> download,
+                       std::shared_ptr<std::promise<std::vector<uint8_t>>> promise);
+    void rememberChunk(const Digest& hash, Content chunk);
+
+    void requestDelta(const std::string& fileName, const std::string& branch, SyncedVersion base,
+                      std::shared_ptr<std::promise<FileSnapshot>> promise);
+
+    std::optional<SyncedVersion> syncedVersion(const std::string& fileName, const std::string& branch);
+    void rememberVersion(const std::string& fileName, const std::string& branch, std::string hash, Content content);
 };
 
 } // namespace deltasync
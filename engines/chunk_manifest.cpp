@@ -0,0 +1,55 @@
+#include "chunk_manifest.h"
+#include "delta_format.h"
+#include <cstring>
+#include <stdexcept>
+
+std::vector<uint8_t> ChunkManifest::encode() const {
+    std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+    out.reserve(sizeof(kMagic) + 20 + chunks.size() * (Digest::kSize + 4));
+
+    DeltaFormat::putVarint(out, totalSize);
+    DeltaFormat::putVarint(out, chunks.size());
+
+    for (const auto& chunk : chunks) {
+        out.insert(out.end(), chunk.hash.bytes.begin(), chunk.hash.bytes.end());
+        DeltaFormat::putVarint(out, chunk.length);
+    }
+
+    return out;
+}
+
+ChunkManifest ChunkManifest::decode(std::span<const uint8_t> data) {
+    if (data.size() < sizeof(kMagic) || memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) {
+        throw std::runtime_error("Invalid chunk manifest");
+    }
+
+    ChunkManifest manifest;
+    size_t pos = sizeof(kMagic);
+    uint64_t count = 0;
+    if (!DeltaFormat::getVarint(data.data(), data.size(), pos, manifest.totalSize) ||
+        !DeltaFormat::getVarint(data.data(), data.size(), pos, count) ||
+        count > (data.size() - pos) / (Digest::kSize + 1)) {
+        throw std::runtime_error("Invalid chunk manifest");
+    }
+
+    manifest.chunks.resize(count);
+    uint64_t total = 0;
+
+    for (auto& chunk : manifest.chunks) {
+        if (data.size() - pos < Digest::kSize) {
+            throw std::runtime_error("Invalid chunk manifest");
+        }
+        chunk.hash = Digest::fromBytes(data.data() + pos);
+        pos += Digest::kSize;
+
+        if (!DeltaFormat::getVarint(data.data(), data.size(), pos, chunk.length)) {
+            throw std::runtime_error("Invalid chunk manifest");
+        }
+        total += chunk.length;
+    }
+
+    if (total != manifest.totalSize) {
+        throw std::runtime_error("Invalid chunk manifest");
+    }
+    return manifest;
+}
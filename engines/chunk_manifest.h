@@ -0,0 +1,31 @@
+#ifndef DELTASYNC_CHUNK_MANIFEST_H
+#define DELTASYNC_CHUNK_MANIFEST_H
+
+#include "digest.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Объект-список кусков вместо содержимого большого файла:
+//   "DSCM" | varint размер содержимого | varint число кусков |
+//   для каждого куска: 32 байта идентификатора | varint длина
+// Куски хранятся обычными объектами под своим хешем и общие для всего репозитория.
+struct ChunkManifest {
+    struct Entry {
+        Digest hash;        // ключ объекта куска
+        uint64_t length = 0;
+    };
+
+    static constexpr unsigned char kMagic[4] = {'D', 'S', 'C', 'M'};
+
+    uint64_t totalSize = 0;
+    std::vector<Entry> chunks;
+
+    std::vector<uint8_t> encode() const;
+
+    // Исключение, если данные не являются корректным списком кусков
+    static ChunkManifest decode(std::span<const uint8_t> data);
+};
+
+#endif //DELTASYNC_CHUNK_MANIFEST_H
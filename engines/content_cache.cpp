@@ -0,0 +1,86 @@
+#include "content_cache.h"
+#include <cstring>
+#include <functional>
+
+ContentCache::ContentCache(size_t byteBudget, size_t shardCount)
+    : shardBudget(byteBudget / (shardCount ? shardCount : 1)) {
+    if (shardCount == 0) shardCount = 1;
+
+    shards.reserve(shardCount);
+    for (size_t i = 0; i < shardCount; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+// Шард выбирается по другим байтам дайджеста, чем бакет внутри шарда
+ContentCache::Shard& ContentCache::shardFor(const Digest& key) {
+    uint64_t value;
+    memcpy(&value, key.bytes.data() + 8, sizeof(value));
+    return *shards[value % shards.size()];
+}
+
+ContentCache::Content ContentCache::get(const Digest& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->second;
+}
+
+void ContentCache::put(const Digest& key, Content content) {
+    if (!content || content->size() > shardBudget) return;
+
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    if (auto it = shard.index.find(key); it != shard.index.end()) {
+        // Содержимое адресуется хешем, поэтому достаточно обновить позицию
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    shard.bytes += content->size();
+    shard.lru.emplace_front(key, std::move(content));
+    shard.index[key] = shard.lru.begin();
+
+    while (shard.bytes > shardBudget && !shard.lru.empty()) {
+        auto& victim = shard.lru.back();
+        shard.bytes -= victim.second->size();
+        shard.index.erase(victim.first);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void ContentCache::erase(const Digest& key) {
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) return;
+
+    shard.bytes -= it->second->second->size();
+    shard.lru.erase(it->second);
+    shard.index.erase(it);
+}
+
+ContentCache::Stats ContentCache::stats() const {
+    Stats result;
+    result.hits = hits.load(std::memory_order_relaxed);
+    result.misses = misses.load(std::memory_order_relaxed);
+    result.evictions = evictions.load(std::memory_order_relaxed);
+
+    for (const auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        result.bytes += shard->bytes;
+        result.entries += shard->lru.size();
+    }
+    return result;
+}
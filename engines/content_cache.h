@@ -0,0 +1,62 @@
+#ifndef DELTASYNC_CONTENT_CACHE_H
+#define DELTASYNC_CONTENT_CACHE_H
+
+#include "digest.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Кэш восстановленного содержимого версий с ограничением по байтам.
+// Ключ — хеш содержимого; шардированный LRU, каждый шард под своим мьютексом.
+class ContentCache {
+public:
+    using Content = std::shared_ptr<const std::vector<uint8_t>>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytes = 0;
+        uint64_t entries = 0;
+    };
+
+    explicit ContentCache(size_t byteBudget, size_t shardCount = 16);
+
+    // nullptr, если записи нет
+    Content get(const Digest& key);
+
+    // Записи больше бюджета шарда не кэшируются
+    void put(const Digest& key, Content content);
+
+    // Поместится ли запись такого размера (чтобы не копировать содержимое зря)
+    bool admits(size_t bytes) const { return bytes <= shardBudget; }
+
+    void erase(const Digest& key);
+
+    Stats stats() const;
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::pair<Digest, Content>> lru;  // начало — самые свежие
+        std::unordered_map<Digest, std::list<std::pair<Digest, Content>>::iterator> index;
+        size_t bytes = 0;
+    };
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    size_t shardBudget;
+
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> evictions{0};
+
+    Shard& shardFor(const Digest& key);
+};
+
+#endif //DELTASYNC_CONTENT_CACHE_H
@@ -0,0 +1,75 @@
+#include "delta_format.h"
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+bool DeltaFormat::isVersion2(const unsigned char* data, size_t size) {
+    return size >= sizeof(kMagic) && memcmp(data, kMagic, sizeof(kMagic)) == 0;
+}
+
+DeltaHeader DeltaFormat::parseHeader(const unsigned char* data, size_t size) {
+    DeltaHeader header;
+    if (!isVersion2(data, size)) return header;
+
+    header.version = 2;
+    size_t pos = sizeof(kMagic);
+
+    if (!getVarint(data, size, pos, header.baseSize) ||
+        !getVarint(data, size, pos, header.targetSize) ||
+        pos + sizeof(uint32_t) > size) {
+        throw std::runtime_error("Invalid delta header");
+    }
+
+    header.checksum = static_cast<uint32_t>(data[pos]) |
+                      static_cast<uint32_t>(data[pos + 1]) << 8 |
+                      static_cast<uint32_t>(data[pos + 2]) << 16 |
+                      static_cast<uint32_t>(data[pos + 3]) << 24;
+    header.opsOffset = pos + sizeof(uint32_t);
+
+    return header;
+}
+
+void DeltaFormat::writeHeader(std::vector<unsigned char>& out, uint64_t baseSize,
+                              uint64_t targetSize, uint32_t checksum) {
+    out.insert(out.end(), kMagic, kMagic + sizeof(kMagic));
+    putVarint(out, baseSize);
+    putVarint(out, targetSize);
+    for (int shift = 0; shift < 32; shift += 8) {
+        out.push_back(static_cast<unsigned char>(checksum >> shift));
+    }
+}
+
+void DeltaFormat::putVarint(std::vector<unsigned char>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+bool DeltaFormat::getVarint(const unsigned char* data, size_t size, size_t& pos, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= size) return false;
+
+        unsigned char byte = data[pos++];
+        if (shift == 63 && byte > 1) return false;
+
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+uint64_t DeltaFormat::zigzagEncode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+int64_t DeltaFormat::zigzagDecode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+uint32_t DeltaFormat::checksum(const unsigned char* data, size_t size, uint32_t seed) {
+    // crc32_z принимает size_t, поэтому большие буферы не нужно резать вручную
+    return static_cast<uint32_t>(crc32_z(seed, data, size));
+}
@@ -0,0 +1,49 @@
+#ifndef DELTASYNC_DELTA_FORMAT_H
+#define DELTASYNC_DELTA_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Формат дельты v2:
+//   "DSD2" | varint baseSize | varint targetSize | uint32 LE crc32(target) | операции...
+// Операция начинается с varint (length << 1 | op):
+//   op = 0 (copy):   + zigzag varint смещения относительно конца предыдущего copy
+//   op = 1 (insert): + length байт данных
+// Формат v1 (без заголовка, op + native uint32 offset/length) поддерживается только на чтение.
+struct DeltaHeader {
+    uint32_t version = 1;
+    uint64_t baseSize = 0;
+    uint64_t targetSize = 0;
+    uint32_t checksum = 0;
+    size_t opsOffset = 0;   // начало операций внутри дельты
+};
+
+class DeltaFormat {
+public:
+    static constexpr unsigned char kMagic[4] = {'D', 'S', 'D', '2'};
+    static constexpr uint64_t kOpCopy = 0;
+    static constexpr uint64_t kOpInsert = 1;
+
+    static bool isVersion2(const unsigned char* data, size_t size);
+
+    // Для v1 возвращает заголовок с version = 1 и нулевыми размерами
+    static DeltaHeader parseHeader(const unsigned char* data, size_t size);
+
+    static void writeHeader(std::vector<unsigned char>& out, uint64_t baseSize,
+                            uint64_t targetSize, uint32_t checksum);
+
+    static void putVarint(std::vector<unsigned char>& out, uint64_t value);
+
+    // Читает LEB128 varint; false, если данные обрываются или число длиннее 64 бит
+    static bool getVarint(const unsigned char* data, size_t size, size_t& pos, uint64_t& value);
+
+    static uint64_t zigzagEncode(int64_t value);
+
+    static int64_t zigzagDecode(uint64_t value);
+
+    // CRC-32; seed позволяет считать сумму по кускам потока
+    static uint32_t checksum(const unsigned char* data, size_t size, uint32_t seed = 0);
+};
+
+#endif //DELTASYNC_DELTA_FORMAT_H
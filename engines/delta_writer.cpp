@@ -0,0 +1,50 @@
+#include "delta_writer.h"
+#include "delta_format.h"
+
+DeltaWriter::DeltaWriter(uint64_t baseSize) : baseSize(baseSize) {}
+
+void DeltaWriter::copy(uint64_t offset, uint64_t length) {
+    if (length == 0) return;
+    flushInsert();
+
+    DeltaFormat::putVarint(ops, length << 1 | DeltaFormat::kOpCopy);
+    DeltaFormat::putVarint(ops, DeltaFormat::zigzagEncode(
+            static_cast<int64_t>(offset) - static_cast<int64_t>(lastCopyEnd)));
+
+    lastCopyEnd = offset + length;
+}
+
+void DeltaWriter::insert(const unsigned char* data, size_t length) {
+    if (length == 0) return;
+
+    if (pendingInsert && pendingInsert + pendingInsertLength == data) {
+        pendingInsertLength += length;
+        return;
+    }
+
+    flushInsert();
+    pendingInsert = data;
+    pendingInsertLength = length;
+}
+
+std::vector<unsigned char> DeltaWriter::finish(const unsigned char* target, size_t targetSize) {
+    flushInsert();
+
+    std::vector<unsigned char> delta;
+    delta.reserve(32 + ops.size());
+    DeltaFormat::writeHeader(delta, baseSize, targetSize, DeltaFormat::checksum(target, targetSize));
+    delta.insert(delta.end(), ops.begin(), ops.end());
+
+    ops.clear();
+    return delta;
+}
+
+void DeltaWriter::flushInsert() {
+    if (!pendingInsert) return;
+
+    DeltaFormat::putVarint(ops, static_cast<uint64_t>(pendingInsertLength) << 1 | DeltaFormat::kOpInsert);
+    ops.insert(ops.end(), pendingInsert, pendingInsert + pendingInsertLength);
+
+    pendingInsert = nullptr;
+    pendingInsertLength = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef DELTASYNC_DELTA_WRITER_H
+#define DELTASYNC_DELTA_WRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Сериализация операций copy/insert в формат дельты v2 (см. delta_format.h).
+// Общая для всех кодировщиков, чтобы формат описывался в одном месте.
+class DeltaWriter {
+public:
+    explicit DeltaWriter(uint64_t baseSize);
+
+    // Копирование length байт из original начиная с offset
+    void copy(uint64_t offset, uint64_t length);
+
+    // Вставка новых байт; идущие подряд участки склеиваются в одну операцию.
+    // Данные должны оставаться доступными до finish().
+    void insert(const unsigned char* data, size_t length);
+
+    // Заголовок с размерами и контрольной суммой target, затем накопленные операции
+    std::vector<unsigned char> finish(const unsigned char* target, size_t targetSize);
+
+private:
+    uint64_t baseSize;
+    std::vector<unsigned char> ops;
+    uint64_t lastCopyEnd = 0;
+
+    const unsigned char* pendingInsert = nullptr;
+    size_t pendingInsertLength = 0;
+
+    void flushInsert();
+};
+
+#endif //DELTASYNC_DELTA_WRITER_H
@@ -1,4 +1,7 @@
 #include "diff_engine.h"
+#include "delta_format.h"
+#include "rolling_hash_encoder.h"
+#include "suffix_array_encoder.h"
 #include <boost/asio.hpp>
 #include <cstdint>
 #include <cstring>
@@ -15,169 +18,248 @@
 #include <fstream>
 #include <iostream>
 
-std::vector<unsigned char> DiffEngine::computeDelta(const std::vector<unsigned char>& original,
-                                               const std::vector<unsigned char>& modified,
+std::vector<unsigned char> DiffEngine::computeDelta(std::span<const unsigned char> original,
+                                               std::span<const unsigned char> modified,
                                                size_t minMatchLength) {
-    std::vector<unsigned char> delta;
-    
-    // Используем более эффективный алгоритм поиска совпадений
-    size_t i = 0;
-    while (i < modified.size()) {
-        size_t bestMatchPos = 0;
-        size_t bestMatchLen = 0;
-        
-        // Ищем самое длинное совпадение
-        for (size_t j = 0; j < original.size(); j++) {
-            size_t k = 0;
-            while (i + k < modified.size() && 
-                   j + k < original.size() && 
-                   modified[i + k] == original[j + k]) {
-                k++;
-            }
-            
-            if (k > bestMatchLen) {
-                bestMatchLen = k;
-                bestMatchPos = j;
-                if (bestMatchLen >= minMatchLength * 2) break; // ранний выход
-            }
+    // Индекс блоков original со скользящим хешем вместо полного перебора O(n·m)
+    return RollingHashEncoder::encode(original, modified, minMatchLength);
+}
+
+std::vector<unsigned char> DiffEngine::computeDelta(std::span<const unsigned char> original,
+                                               std::span<const unsigned char> modified,
+                                               DeltaMode mode,
+                                               size_t minMatchLength) {
+    switch (mode) {
+        case DeltaMode::MaxRatio:
+            return SuffixArrayEncoder::encode(original, modified, minMatchLength);
+        case DeltaMode::Fast:
+        default:
+            return RollingHashEncoder::encode(original, modified, minMatchLength);
+    }
+}
+
+DeltaReader::DeltaReader(std::span<const unsigned char> original, std::span<const unsigned char> delta,
+                         bool verifyHash)
+    : original(original), delta(delta), header(DeltaFormat::parseHeader(delta.data(), delta.size())),
+      verifyHash(verifyHash && header.version == 2), pos(header.opsOffset) {
+    if (header.version == 2) {
+        if (header.baseSize != original.size())
+            throw std::runtime_error("Delta base size mismatch");
+        return;
+    }
+
+    // Для v1 размер не записан — считаем его холостым проходом по операциям
+    while (nextOp()) {}
+    header.baseSize = original.size();
+    header.targetSize = written;
+    pos = 0;
+    written = 0;
+    lastCopyEnd = 0;
+    pendingLength = 0;
+}
+
+// Разбор операции с проверкой границ; её данные — pending/pendingLength
+bool DeltaReader::nextOp() {
+    if (header.version == 2) {
+        if (pos >= delta.size()) {
+            if (written != header.targetSize)
+                throw std::runtime_error("Delta produces less data than declared");
+            return false;
         }
-        
-        if (bestMatchLen >= minMatchLength) {
-            // Операция копирования
-            delta.push_back(0); // код операции
-            
-            // Добавляем offset и length
-            uint32_t offset = static_cast<uint32_t>(bestMatchPos);
-            uint32_t length = static_cast<uint32_t>(bestMatchLen);
-            delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&offset), 
-                         reinterpret_cast<unsigned char*>(&offset) + sizeof(offset));
-            delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&length), 
-                         reinterpret_cast<unsigned char*>(&length) + sizeof(length));
-            
-            i += bestMatchLen;
+
+        uint64_t opWord;
+        if (!DeltaFormat::getVarint(delta.data(), delta.size(), pos, opWord))
+            throw std::runtime_error("Invalid delta format");
+
+        uint64_t length = opWord >> 1;
+        if (length > header.targetSize - written)
+            throw std::runtime_error("Delta produces more data than declared");
+
+        if ((opWord & 1) == DeltaFormat::kOpCopy) {
+            uint64_t encoded;
+            if (!DeltaFormat::getVarint(delta.data(), delta.size(), pos, encoded))
+                throw std::runtime_error("Invalid copy operation in delta");
+
+            uint64_t offset = lastCopyEnd + static_cast<uint64_t>(DeltaFormat::zigzagDecode(encoded));
+            if (offset > original.size() || length > original.size() - offset)
+                throw std::runtime_error("Invalid offset/length in copy operation");
+
+            pending = original.data() + offset;
+            lastCopyEnd = offset + length;
         } else {
-            // Операция вставки новых данных
-            size_t insertStart = i;
-            i++; // минимум 1 байт
-            
-            // Ищем следующий хороший матч
-            while (i < modified.size()) {
-                bool foundGoodMatch = false;
-                for (size_t j = 0; j < original.size(); j++) {
-                    if (modified[i] == original[j]) {
-                        size_t k = 1;
-                        while (i + k < modified.size() && 
-                               j + k < original.size() && 
-                               modified[i + k] == original[j + k] && 
-                               k < minMatchLength) {
-                            k++;
-                        }
-                        if (k >= minMatchLength) {
-                            foundGoodMatch = true;
-                            break;
-                        }
-                    }
-                }
-                if (foundGoodMatch) break;
-                i++;
+            if (length > delta.size() - pos)
+                throw std::runtime_error("Invalid data length in insert operation");
+
+            pending = delta.data() + pos;
+            pos += length;
+        }
+        pendingLength = length;
+        written += length;
+        return true;
+    }
+
+    // Формат v1: op | uint32 offset | uint32 length, op | uint32 length | данные
+    if (pos >= delta.size()) return false;
+    if (pos + 1 >= delta.size()) throw std::runtime_error("Invalid delta format");
+
+    unsigned char op = delta[pos++];
+
+    if (op == 0) { // copy
+        if (pos + sizeof(uint32_t)*2 > delta.size())
+            throw std::runtime_error("Invalid copy operation in delta");
+
+        uint32_t offset, length;
+        memcpy(&offset, &delta[pos], sizeof(offset));
+        pos += sizeof(offset);
+        memcpy(&length, &delta[pos], sizeof(length));
+        pos += sizeof(length);
+
+        if (static_cast<uint64_t>(offset) + length > original.size())
+            throw std::runtime_error("Invalid offset/length in copy operation");
+
+        pending = original.data() + offset;
+        pendingLength = length;
+    }
+    else if (op == 1) { // insert
+        if (pos + sizeof(uint32_t) > delta.size())
+            throw std::runtime_error("Invalid insert operation in delta");
+
+        uint32_t length;
+        memcpy(&length, &delta[pos], sizeof(length));
+        pos += sizeof(length);
+
+        if (length > delta.size() - pos)
+            throw std::runtime_error("Invalid data length in insert operation");
+
+        pending = delta.data() + pos;
+        pendingLength = length;
+        pos += length;
+    }
+    else {
+        throw std::runtime_error("Unknown operation in delta");
+    }
+
+    written += pendingLength;
+    return true;
+}
+
+bool DeltaReader::next(std::span<const unsigned char>& segment) {
+    if (pendingLength == 0 && !nextOp()) {
+        finish();
+        return false;
+    }
+
+    segment = {pending, static_cast<size_t>(pendingLength)};
+    if (verifyHash) crc = DeltaFormat::checksum(pending, pendingLength, crc);
+    pendingLength = 0;
+    return true;
+}
+
+size_t DeltaReader::read(std::span<unsigned char> out) {
+    size_t filled = 0;
+    while (filled < out.size()) {
+        if (pendingLength == 0) {
+            if (!nextOp()) {
+                finish();
+                break;
             }
-            
-            uint32_t length = static_cast<uint32_t>(i - insertStart);
-            delta.push_back(1); // код операции
-            delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&length), 
-                         reinterpret_cast<unsigned char*>(&length) + sizeof(length));
-            delta.insert(delta.end(), modified.begin() + insertStart, 
-                         modified.begin() + i);
+            continue;
         }
+
+        size_t step = static_cast<size_t>(std::min<uint64_t>(pendingLength, out.size() - filled));
+        memcpy(out.data() + filled, pending, step);
+        if (verifyHash) crc = DeltaFormat::checksum(pending, step, crc);
+        pending += step;
+        pendingLength -= step;
+        filled += step;
     }
-    
-    return delta;
+    return filled;
+}
+
+void DeltaReader::finish() {
+    if (verifyHash && crc != header.checksum)
+        throw std::runtime_error("Delta checksum mismatch");
 }
 
 std::vector<unsigned char> DiffEngine::applyDelta(const std::vector<unsigned char>& original,
                                              const std::vector<unsigned char>& delta,
                                              bool verifyHash) {
-    std::vector<unsigned char> result;
-    size_t i = 0;
-    
-    while (i < delta.size()) {
-        if (i + 1 >= delta.size()) throw std::runtime_error("Invalid delta format");
-        
-        unsigned char op = delta[i++];
-        
-        if (op == 0) { // copy
-            if (i + sizeof(uint32_t)*2 > delta.size()) 
-                throw std::runtime_error("Invalid copy operation in delta");
-                
-            uint32_t offset, length;
-            memcpy(&offset, &delta[i], sizeof(offset));
-            i += sizeof(offset);
-            memcpy(&length, &delta[i], sizeof(length));
-            i += sizeof(length);
-            
-            if (offset + length > original.size())
-                throw std::runtime_error("Invalid offset/length in copy operation");
-                
-            result.insert(result.end(), original.begin() + offset, 
-                         original.begin() + offset + length);
-        } 
-        else if (op == 1) { // insert
-            if (i + sizeof(uint32_t) > delta.size())
-                throw std::runtime_error("Invalid insert operation in delta");
-                
-            uint32_t length;
-            memcpy(&length, &delta[i], sizeof(length));
-            i += sizeof(length);
-            
-            if (i + length > delta.size())
-                throw std::runtime_error("Invalid data length in insert operation");
-                
-            result.insert(result.end(), delta.begin() + i, delta.begin() + i + length);
-            i += length;
-        }
-        else {
-            throw std::runtime_error("Unknown operation in delta");
-        }
+    return applyDeltaBounded(original, delta, UINT64_MAX, verifyHash);
+}
+
+std::vector<unsigned char> DiffEngine::applyDeltaBounded(const std::vector<unsigned char>& original,
+                                                    const std::vector<unsigned char>& delta,
+                                                    uint64_t maxTargetSize,
+                                                    bool verifyHash) {
+    // Размер результата известен заранее — выделяем память один раз
+    std::vector<unsigned char> result(deltaTargetSize(original, delta, maxTargetSize));
+    applyDelta(original, delta, result, verifyHash);
+    return result;
+}
+
+size_t DiffEngine::applyDelta(std::span<const unsigned char> original,
+                              std::span<const unsigned char> delta,
+                              std::span<unsigned char> output,
+                              bool verifyHash) {
+    DeltaReader reader(original, delta, verifyHash);
+    size_t written = 0;
+
+    std::span<const unsigned char> segment;
+    while (reader.next(segment)) {
+        if (segment.size() > output.size() - written)
+            throw std::runtime_error("Output buffer too small for delta result");
+        memcpy(output.data() + written, segment.data(), segment.size());
+        written += segment.size();
     }
-    
-    if (verifyHash) {
-        // Проверяем хеш, если он есть в конце дельты
-        // (можно добавить опциональное хеширование)
+
+    return written;
+}
+
+uint64_t DiffEngine::applyDeltaStreaming(std::span<const unsigned char> original,
+                                         std::span<const unsigned char> delta,
+                                         const DeltaSink& sink,
+                                         bool verifyHash) {
+    DeltaReader reader(original, delta, verifyHash);
+
+    // Участки copy отдаются прямо из original, без промежуточного буфера
+    std::span<const unsigned char> segment;
+    while (reader.next(segment)) {
+        sink(segment.data(), segment.size());
     }
-    
-    return result;
+
+    return reader.size();
 }
 
-std::basic_string<char> DiffEngine::computeHash(const std::vector<unsigned char>& data) {
-    unsigned char hash[SHA256_DIGEST_LENGTH];
-    SHA256_CTX sha256;
-    SHA256_Init(&sha256);
-    SHA256_Update(&sha256, data.data(), data.size());
-    SHA256_Final(hash, &sha256);
-    
-    std::stringstream ss;
-    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
-        ss << std::hex << std::setw(2) << std::setfill('0') << (int)hash[i];
+uint64_t DiffEngine::deltaTargetSize(std::span<const unsigned char> original,
+                                     std::span<const unsigned char> delta,
+                                     uint64_t maxTargetSize) {
+    DeltaHeader header = DeltaFormat::parseHeader(delta.data(), delta.size());
+    uint64_t targetSize;
+
+    if (header.version == 2) {
+        // Заголовок не проверен операциями: каждая занимает хотя бы байт и копирует
+        // не больше original, вставки не длиннее самой дельты
+        uint64_t opsBytes = delta.size() - std::min<uint64_t>(header.opsOffset, delta.size());
+        uint64_t reachable = original.empty() || opsBytes <= (UINT64_MAX - opsBytes) / original.size()
+                                 ? opsBytes * original.size() + opsBytes
+                                 : UINT64_MAX;
+        if (header.targetSize > reachable)
+            throw std::runtime_error("Delta declares more data than its operations can produce");
+        targetSize = header.targetSize;
+    } else {
+        targetSize = DeltaReader(original, delta, false).size();
     }
-    
-    return ss.str();
+
+    if (targetSize > maxTargetSize)
+        throw std::runtime_error("Delta result exceeds the size limit of " + std::to_string(maxTargetSize) +
+                                 " bytes");
+    return targetSize;
+}
+
+std::basic_string<char> DiffEngine::computeHash(std::span<const unsigned char> data) {
+    return computeDigest(data).hex();
 }
 
-std::vector<unsigned char> DiffEngine::computeCompressedDelta(const std::vector<unsigned char>& original,
-                                                      const std::vector<unsigned char>& modified) {
-    std::vector<unsigned char> delta = computeDelta(original, modified);
-    std::vector<unsigned char> compressed(delta.size() * 1.1 + 12); // zlib рекомендация
-    
-    z_stream stream;
-    stream.next_in = delta.data();
-    stream.avail_in = delta.size();
-    stream.next_out = compressed.data();
-    stream.avail_out = compressed.size();
-    
-    deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-    deflate(&stream, Z_FINISH);
-    deflateEnd(&stream);
-    
-    compressed.resize(stream.total_out);
-    return compressed;
+Digest DiffEngine::computeDigest(std::span<const unsigned char> data) {
+    return Sha256Hasher::hash(data);
 }
\ No newline at end of file
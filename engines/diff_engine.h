@@ -2,25 +2,105 @@
 #define DELTASYNC_DIFF_ENGINE_H
 
 #include <vector>
+#include <cstdint>
 #include <cstring>
-#include <ios>
-#include <sstream>
-#include <openssl/sha.h>
+#include "delta_format.h"
+#include "digest.h"
+#include <functional>
+#include <span>
+#include <string>
+
+// Режим кодирования дельты: быстрый (скользящий хеш) или максимальное сжатие (суффиксный массив)
+enum class DeltaMode {
+    Fast,
+    MaxRatio
+};
+
+// Приёмник потокового результата applyDeltaStreaming
+using DeltaSink = std::function<void(const unsigned char* data, size_t size)>;
+
+// Пошаговое применение дельты (v1 или v2) с проверкой границ: результат выдаётся
+// участками или порциями в буфер вызывающего и целиком в памяти не собирается.
+// original и delta должны жить, пока идёт чтение.
+class DeltaReader {
+public:
+    // verifyHash: сверить контрольную сумму результата из заголовка дельты (только v2)
+    DeltaReader(std::span<const unsigned char> original, std::span<const unsigned char> delta,
+                bool verifyHash = true);
+
+    // Размер результата (для v1 — холостым проходом по операциям)
+    uint64_t size() const { return header.targetSize; }
+
+    // Следующий участок результата без копирования: внутри original или delta; false — конец
+    bool next(std::span<const unsigned char>& segment);
+
+    // Следующая порция результата в out; 0 — результат выдан целиком.
+    // Контрольная сумма сверяется после последней порции
+    size_t read(std::span<unsigned char> out);
+
+private:
+    std::span<const unsigned char> original;
+    std::span<const unsigned char> delta;
+    DeltaHeader header;
+    bool verifyHash;
+    size_t pos;                 // следующая операция в delta
+    uint64_t written = 0;       // объём разобранных операций
+    uint64_t lastCopyEnd = 0;
+    const unsigned char* pending = nullptr;  // невыданный остаток текущей операции
+    uint64_t pendingLength = 0;
+    uint32_t crc = 0;
+
+    bool nextOp();
+
+    void finish();
+};
 
 class DiffEngine {
 public:
-     static std::vector<unsigned char> computeDelta(const std::vector<unsigned char>& original,
-                                                 const std::vector<unsigned char>& modified,
+     static std::vector<unsigned char> computeDelta(std::span<const unsigned char> original,
+                                                 std::span<const unsigned char> modified,
+                                                 size_t minMatchLength = 8);
+
+    static std::vector<unsigned char> computeDelta(std::span<const unsigned char> original,
+                                                 std::span<const unsigned char> modified,
+                                                 DeltaMode mode,
                                                  size_t minMatchLength = 8);
 
+    // verifyHash: сверить контрольную сумму результата из заголовка дельты (только v2).
+    // Размер результата не ограничен — для дельт, созданных самим репозиторием
     static std::vector<unsigned char> applyDelta(const std::vector<unsigned char>& original,
                                          const std::vector<unsigned char>& delta,
-                                         bool verifyHash = false);
+                                         bool verifyHash = true);
+
+    // То же для дельт извне: буфер выделяется по размеру из заголовка, поэтому
+    // результат больше maxTargetSize — исключение до выделения памяти
+    static std::vector<unsigned char> applyDeltaBounded(const std::vector<unsigned char>& original,
+                                                const std::vector<unsigned char>& delta,
+                                                uint64_t maxTargetSize,
+                                                bool verifyHash = true);
+
+    // Применение дельты в заранее выделенный буфер; возвращает число записанных байт
+    static size_t applyDelta(std::span<const unsigned char> original,
+                             std::span<const unsigned char> delta,
+                             std::span<unsigned char> output,
+                             bool verifyHash = true);
+
+    // Потоковое применение: результат отдаётся кусками в sink (сокет, файл) без сборки в памяти
+    static uint64_t applyDeltaStreaming(std::span<const unsigned char> original,
+                                        std::span<const unsigned char> delta,
+                                        const DeltaSink& sink,
+                                        bool verifyHash = true);
+
+    // Размер результата применения дельты (из заголовка v2 или проходом по операциям v1).
+    // Исключение, если он больше maxTargetSize или больше, чем могут дать операции дельты
+    static uint64_t deltaTargetSize(std::span<const unsigned char> original,
+                                    std::span<const unsigned char> delta,
+                                    uint64_t maxTargetSize = UINT64_MAX);
 
-    static std::basic_string<char> computeHash(const std::vector<unsigned char>& data);
+    // SHA-256 в hex для внешнего API
+    static std::basic_string<char> computeHash(std::span<const unsigned char> data);
 
-    static std::vector<unsigned char> computeCompressedDelta(const std::vector<unsigned char>& original,
-                                                      const std::vector<unsigned char>& modified);
+    static Digest computeDigest(std::span<const unsigned char> data);
 };
 
 #endif //DELTASYNC_DIFF_ENGINE_H
@@ -0,0 +1,220 @@
+#include "digest.h"
+#include <openssl/evp.h>
+#include <stdexcept>
+
+#ifdef DELTASYNC_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+namespace {
+
+constexpr char kHexDigits[] = "0123456789abcdef";
+
+int nibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+#ifndef DELTASYNC_HAVE_XXHASH
+// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ull;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ull;
+
+uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+uint64_t read64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+uint32_t read32(const uint8_t* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+uint64_t round64(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= round64(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+uint64_t xxh64(const uint8_t* p, size_t size, uint64_t seed) {
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = mergeRound(h, v1);
+        h = mergeRound(h, v2);
+        h = mergeRound(h, v3);
+        h = mergeRound(h, v4);
+    } else {
+        h = seed + kPrime5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8) {
+        h ^= round64(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h ^= *p * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+#endif
+
+} // namespace
+
+// --- Digest ---
+
+bool Digest::empty() const {
+    for (uint8_t b : bytes) {
+        if (b != 0) return false;
+    }
+    return true;
+}
+
+std::string Digest::hex() const {
+    std::string result(kSize * 2, '0');
+    for (size_t i = 0; i < kSize; i++) {
+        result[2 * i] = kHexDigits[bytes[i] >> 4];
+        result[2 * i + 1] = kHexDigits[bytes[i] & 0x0f];
+    }
+    return result;
+}
+
+std::optional<Digest> Digest::tryFromHex(std::string_view hex) {
+    Digest digest;
+    if (hex.empty()) return digest;
+    if (hex.size() != kSize * 2) return std::nullopt;
+
+    for (size_t i = 0; i < kSize; i++) {
+        int hi = nibble(hex[2 * i]);
+        int lo = nibble(hex[2 * i + 1]);
+        if (hi < 0 || lo < 0) return std::nullopt;
+        digest.bytes[i] = static_cast<uint8_t>(hi << 4 | lo);
+    }
+    return digest;
+}
+
+Digest Digest::fromHex(std::string_view hex) {
+    auto digest = tryFromHex(hex);
+    if (!digest) {
+        throw std::invalid_argument("Invalid hash: " + std::string(hex));
+    }
+    return *digest;
+}
+
+std::ostream& operator<<(std::ostream& os, const Digest& digest) {
+    return os << digest.hex();
+}
+
+// --- Sha256Hasher ---
+
+Sha256Hasher::Sha256Hasher() : context(EVP_MD_CTX_new()) {
+    if (!context || EVP_DigestInit_ex(context, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(context);
+        throw std::runtime_error("Failed to initialize SHA-256");
+    }
+}
+
+Sha256Hasher::~Sha256Hasher() {
+    EVP_MD_CTX_free(context);
+}
+
+void Sha256Hasher::update(std::span<const uint8_t> data) {
+    if (!data.empty() && EVP_DigestUpdate(context, data.data(), data.size()) != 1) {
+        throw std::runtime_error("SHA-256 update failed");
+    }
+}
+
+Digest Sha256Hasher::finish() {
+    Digest digest;
+    unsigned int length = 0;
+    if (EVP_DigestFinal_ex(context, digest.bytes.data(), &length) != 1 || length != Digest::kSize ||
+        EVP_DigestInit_ex(context, EVP_sha256(), nullptr) != 1) {
+        throw std::runtime_error("SHA-256 finalization failed");
+    }
+    return digest;
+}
+
+Digest Sha256Hasher::hash(std::span<const uint8_t> data) {
+    // Контекст EVP переиспользуется в пределах потока
+    thread_local Sha256Hasher hasher;
+    hasher.update(data);
+    return hasher.finish();
+}
+
+// --- FastHash ---
+
+uint64_t FastHash::hash64(std::span<const uint8_t> data, uint64_t seed) {
+#ifdef DELTASYNC_HAVE_XXHASH
+    return XXH3_64bits_withSeed(data.data(), data.size(), seed);
+#else
+    return xxh64(data.data(), data.size(), seed);
+#endif
+}
+
+Digest FastHash::chunkId(std::span<const uint8_t> data) {
+#ifdef DELTASYNC_HAVE_XXHASH
+    XXH128_hash_t hash = XXH3_128bits(data.data(), data.size());
+    uint64_t lanes[2] = {hash.low64, hash.high64};
+    constexpr char kTag[8] = {'x', 'x', 'h', '3', '-', '1', '2', '8'};
+#else
+    uint64_t lanes[2] = {xxh64(data.data(), data.size(), 0),
+                         xxh64(data.data(), data.size(), 0x9E3779B97F4A7C15ull)};
+    constexpr char kTag[8] = {'x', 'x', 'h', '6', '4', 'x', '2', 0};
+#endif
+
+    Digest digest;
+    uint64_t size = data.size();
+    for (int i = 0; i < 8; i++) {
+        digest.bytes[i] = static_cast<uint8_t>(lanes[0] >> (8 * i));
+        digest.bytes[8 + i] = static_cast<uint8_t>(lanes[1] >> (8 * i));
+        digest.bytes[16 + i] = static_cast<uint8_t>(size >> (8 * i));
+    }
+    memcpy(digest.bytes.data() + 24, kTag, sizeof(kTag));
+    return digest;
+}
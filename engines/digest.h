@@ -0,0 +1,88 @@
+#ifndef DELTASYNC_DIGEST_H
+#define DELTASYNC_DIGEST_H
+
+#include <array>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+
+// Двоичный SHA-256 — ключ объектов и версий внутри движка; hex только на границах API.
+// Нулевой дайджест означает «нет» (например, родитель первой версии).
+struct Digest {
+    static constexpr size_t kSize = 32;
+
+    std::array<uint8_t, kSize> bytes{};
+
+    bool empty() const;
+
+    std::string hex() const;
+
+    // Пустая строка даёт нулевой дайджест; исключение std::invalid_argument при неверном hex
+    static Digest fromHex(std::string_view hex);
+
+    static std::optional<Digest> tryFromHex(std::string_view hex);
+
+    static Digest fromBytes(const uint8_t* data) {
+        Digest digest;
+        memcpy(digest.bytes.data(), data, kSize);
+        return digest;
+    }
+
+    auto operator<=>(const Digest&) const = default;
+};
+
+std::ostream& operator<<(std::ostream& os, const Digest& digest);
+
+template <>
+struct std::hash<Digest> {
+    // Байты дайджеста уже равномерно распределены
+    size_t operator()(const Digest& digest) const noexcept {
+        size_t value;
+        memcpy(&value, digest.bytes.data(), sizeof(value));
+        return value;
+    }
+};
+
+// Инкрементальный SHA-256 через EVP: OpenSSL сам выбирает SHA-NI или ARMv8 Crypto Extensions.
+// Данные можно подавать по мере приёма из сокета, без второго прохода по буферу.
+class Sha256Hasher {
+public:
+    Sha256Hasher();
+
+    ~Sha256Hasher();
+
+    Sha256Hasher(const Sha256Hasher&) = delete;
+    Sha256Hasher& operator=(const Sha256Hasher&) = delete;
+
+    void update(std::span<const uint8_t> data);
+
+    // После finish хешер готов к новому сообщению
+    Digest finish();
+
+    static Digest hash(std::span<const uint8_t> data);
+
+private:
+    EVP_MD_CTX* context;
+};
+
+// Быстрый некриптографический хеш: XXH3 при сборке с xxhash (DELTASYNC_HAVE_XXHASH), иначе XXH64.
+// Не стоек к подбору коллизий — только для внутренних идентификаторов доверенных данных.
+class FastHash {
+public:
+    static uint64_t hash64(std::span<const uint8_t> data, uint64_t seed = 0);
+
+    // 256-битный идентификатор куска: два независимых 64-битных хеша, длина и метка алгоритма.
+    // Метка не даёт идентификаторам разных алгоритмов (и SHA-256) совпасть.
+    static Digest chunkId(std::span<const uint8_t> data);
+};
+
+#endif //DELTASYNC_DIGEST_H
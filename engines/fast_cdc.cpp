@@ -0,0 +1,71 @@
+#include "fast_cdc.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+
+namespace {
+
+// Таблица gear фиксирована: от неё зависят границы кусков, а значит и дедупликация
+// между уже сохранёнными и новыми объектами
+constexpr std::array<uint64_t, 256> makeGearTable() {
+    std::array<uint64_t, 256> table{};
+    uint64_t state = 0x6a09e667f3bcc908ull;
+    for (auto& value : table) {
+        // splitmix64
+        state += 0x9e3779b97f4a7c15ull;
+        uint64_t z = state;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        value = z ^ (z >> 31);
+    }
+    return table;
+}
+
+constexpr std::array<uint64_t, 256> kGear = makeGearTable();
+
+// Маска из bits единиц в старших разрядах: после сдвига влево в них
+// накапливается вклад последних 64 байт
+constexpr uint64_t topMask(int bits) {
+    return bits <= 0 ? 0 : ~0ull << (64 - bits);
+}
+
+} // namespace
+
+size_t FastCdc::cut(const uint8_t* data, size_t size, const Params& params) {
+    if (size <= params.minSize) return size;
+
+    size_t limit = std::min(size, params.maxSize);
+    size_t normal = std::min(limit, params.avgSize);
+
+    // Нормализация: до среднего размера граница находится труднее, после — легче
+    int bits = std::bit_width(params.avgSize) - 1;
+    uint64_t maskSmall = topMask(bits + 2);
+    uint64_t maskLarge = topMask(bits - 2);
+
+    uint64_t fingerprint = 0;
+    size_t i = params.minSize;
+
+    for (; i < normal; i++) {
+        fingerprint = (fingerprint << 1) + kGear[data[i]];
+        if ((fingerprint & maskSmall) == 0) return i + 1;
+    }
+    for (; i < limit; i++) {
+        fingerprint = (fingerprint << 1) + kGear[data[i]];
+        if ((fingerprint & maskLarge) == 0) return i + 1;
+    }
+
+    return limit;
+}
+
+std::vector<size_t> FastCdc::split(std::span<const uint8_t> data, const Params& params) {
+    std::vector<size_t> lengths;
+    lengths.reserve(data.size() / std::max<size_t>(params.avgSize, 1) + 1);
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t length = cut(data.data() + pos, data.size() - pos, params);
+        lengths.push_back(length);
+        pos += length;
+    }
+    return lengths;
+}
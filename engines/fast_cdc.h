@@ -0,0 +1,27 @@
+#ifndef DELTASYNC_FAST_CDC_H
+#define DELTASYNC_FAST_CDC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Разбиение на куски по содержимому (FastCDC, нормализованный вариант).
+// Границы зависят только от соседних байт, поэтому вставка в начало файла
+// сдвигает лишь один кусок, а одинаковые фрагменты разных файлов дают одинаковые куски.
+class FastCdc {
+public:
+    struct Params {
+        size_t minSize = 16u << 10;
+        size_t avgSize = 64u << 10;   // степень двойки
+        size_t maxSize = 256u << 10;
+    };
+
+    // Длины кусков подряд; в сумме дают data.size()
+    static std::vector<size_t> split(std::span<const uint8_t> data, const Params& params);
+
+    // Длина первого куска data
+    static size_t cut(const uint8_t* data, size_t size, const Params& params);
+};
+
+#endif //DELTASYNC_FAST_CDC_H
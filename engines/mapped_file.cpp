@@ -0,0 +1,43 @@
+#include "mapped_file.h"
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+    if (length > 0) {
+        munmap(const_cast<uint8_t*>(base), length);
+    }
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat " + path.string());
+    }
+
+    size_t length = static_cast<size_t>(st.st_size);
+    const uint8_t* base = nullptr;
+
+    // Пустой файл отобразить нельзя — представляем его пустым диапазоном
+    if (length > 0) {
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Failed to mmap " + path.string());
+        }
+        base = static_cast<const uint8_t*>(mapping);
+    }
+
+    // Отображение остаётся валидным и после закрытия дескриптора
+    ::close(fd);
+    return std::shared_ptr<MappedFile>(new MappedFile(base, length));
+}
@@ -0,0 +1,33 @@
+#ifndef DELTASYNC_MAPPED_FILE_H
+#define DELTASYNC_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+
+// Файл, отображённый в память только для чтения (mmap). Отображение живёт,
+// пока жив объект, поэтому его удобно разделять через shared_ptr.
+class MappedFile {
+public:
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // nullptr, если файла нет; исключение при ошибке отображения
+    static std::shared_ptr<MappedFile> open(const std::filesystem::path& path);
+
+    const uint8_t* data() const { return base; }
+    size_t size() const { return length; }
+    std::span<const uint8_t> bytes() const { return {base, length}; }
+
+private:
+    MappedFile(const uint8_t* base, size_t length) : base(base), length(length) {}
+
+    const uint8_t* base;
+    size_t length;
+};
+
+#endif //DELTASYNC_MAPPED_FILE_H
@@ -0,0 +1,219 @@
+#include "match_kernels.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DELTASYNC_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using ForwardFn = size_t (*)(const unsigned char*, const unsigned char*, size_t);
+using BackwardFn = size_t (*)(const unsigned char*, const unsigned char*, size_t);
+
+struct KernelSet {
+    MatchKernels::Isa isa;
+    ForwardFn forward;
+    BackwardFn backward;
+};
+
+// Скалярная версия сравнивает по 8 байт через XOR
+size_t forwardScalar(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t k = 0;
+    while (k + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + k, 8);
+        memcpy(&y, b + k, 8);
+        if (uint64_t diff = x ^ y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return k + (__builtin_ctzll(diff) >> 3);
+#else
+            return k + (__builtin_clzll(diff) >> 3);
+#endif
+        }
+        k += 8;
+    }
+    while (k < limit && a[k] == b[k]) k++;
+    return k;
+}
+
+size_t backwardScalar(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit) {
+    size_t k = 0;
+    while (k + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, aEnd - k - 8, 8);
+        memcpy(&y, bEnd - k - 8, 8);
+        if (uint64_t diff = x ^ y) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            return k + (__builtin_clzll(diff) >> 3);
+#else
+            return k + (__builtin_ctzll(diff) >> 3);
+#endif
+        }
+        k += 8;
+    }
+    while (k < limit && aEnd[-static_cast<ptrdiff_t>(k) - 1] == bEnd[-static_cast<ptrdiff_t>(k) - 1]) k++;
+    return k;
+}
+
+#ifdef DELTASYNC_X86
+
+size_t forwardSSE2(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t k = 0;
+    while (k + 16 <= limit) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFFu;
+        if (mask) return k + __builtin_ctz(mask);
+        k += 16;
+    }
+    return k + forwardScalar(a + k, b + k, limit - k);
+}
+
+size_t backwardSSE2(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit) {
+    size_t k = 0;
+    while (k + 16 <= limit) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aEnd - k - 16));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bEnd - k - 16));
+        unsigned mask = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y))) & 0xFFFFu;
+        if (mask) return k + (__builtin_clz(mask) - 16);
+        k += 16;
+    }
+    return k + backwardScalar(aEnd - k, bEnd - k, limit - k);
+}
+
+__attribute__((target("avx2")))
+size_t forwardAVX2(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t k = 0;
+    while (k + 32 <= limit) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + k));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + k));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (mask) return k + __builtin_ctz(mask);
+        k += 32;
+    }
+    return k + forwardSSE2(a + k, b + k, limit - k);
+}
+
+__attribute__((target("avx2")))
+size_t backwardAVX2(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit) {
+    size_t k = 0;
+    while (k + 32 <= limit) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aEnd - k - 32));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bEnd - k - 32));
+        unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+        if (mask) return k + __builtin_clz(mask);
+        k += 32;
+    }
+    return k + backwardSSE2(aEnd - k, bEnd - k, limit - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t forwardAVX512(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t k = 0;
+    while (k + 64 <= limit) {
+        __m512i x = _mm512_loadu_si512(a + k);
+        __m512i y = _mm512_loadu_si512(b + k);
+        uint64_t mask = ~static_cast<uint64_t>(_mm512_cmpeq_epi8_mask(x, y));
+        if (mask) return k + __builtin_ctzll(mask);
+        k += 64;
+    }
+    return k + forwardAVX2(a + k, b + k, limit - k);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+size_t backwardAVX512(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit) {
+    size_t k = 0;
+    while (k + 64 <= limit) {
+        __m512i x = _mm512_loadu_si512(aEnd - k - 64);
+        __m512i y = _mm512_loadu_si512(bEnd - k - 64);
+        uint64_t mask = ~static_cast<uint64_t>(_mm512_cmpeq_epi8_mask(x, y));
+        if (mask) return k + __builtin_clzll(mask);
+        k += 64;
+    }
+    return k + backwardAVX2(aEnd - k, bEnd - k, limit - k);
+}
+
+#endif // DELTASYNC_X86
+
+constexpr KernelSet kScalar{MatchKernels::Isa::Scalar, forwardScalar, backwardScalar};
+#ifdef DELTASYNC_X86
+constexpr KernelSet kSSE2{MatchKernels::Isa::SSE2, forwardSSE2, backwardSSE2};
+constexpr KernelSet kAVX2{MatchKernels::Isa::AVX2, forwardAVX2, backwardAVX2};
+constexpr KernelSet kAVX512{MatchKernels::Isa::AVX512, forwardAVX512, backwardAVX512};
+#endif
+
+const KernelSet* kernelsFor(MatchKernels::Isa isa) {
+    switch (isa) {
+#ifdef DELTASYNC_X86
+        case MatchKernels::Isa::AVX512: return &kAVX512;
+        case MatchKernels::Isa::AVX2: return &kAVX2;
+        case MatchKernels::Isa::SSE2: return &kSSE2;
+#endif
+        default: return &kScalar;
+    }
+}
+
+const KernelSet* detectKernels() {
+    for (auto isa : {MatchKernels::Isa::AVX512, MatchKernels::Isa::AVX2, MatchKernels::Isa::SSE2}) {
+        if (MatchKernels::isSupported(isa)) return kernelsFor(isa);
+    }
+    return &kScalar;
+}
+
+std::atomic<const KernelSet*>& activeKernels() {
+    static std::atomic<const KernelSet*> active{detectKernels()};
+    return active;
+}
+
+} // namespace
+
+bool MatchKernels::isSupported(Isa isa) {
+#ifdef DELTASYNC_X86
+    __builtin_cpu_init();
+    switch (isa) {
+        case Isa::AVX512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+        case Isa::AVX2: return __builtin_cpu_supports("avx2");
+        case Isa::SSE2: return __builtin_cpu_supports("sse2");
+        case Isa::Scalar: return true;
+    }
+    return false;
+#else
+    return isa == Isa::Scalar;
+#endif
+}
+
+size_t MatchKernels::forward(const unsigned char* a, const unsigned char* b, size_t limit) {
+    return activeKernels().load(std::memory_order_relaxed)->forward(a, b, limit);
+}
+
+size_t MatchKernels::backward(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit) {
+    return activeKernels().load(std::memory_order_relaxed)->backward(aEnd, bEnd, limit);
+}
+
+int MatchKernels::compare(const unsigned char* a, const unsigned char* b, size_t length) {
+    size_t k = forward(a, b, length);
+    if (k == length) return 0;
+    return a[k] < b[k] ? -1 : 1;
+}
+
+MatchKernels::Isa MatchKernels::activeIsa() {
+    return activeKernels().load(std::memory_order_relaxed)->isa;
+}
+
+bool MatchKernels::forceIsa(Isa isa) {
+    if (!isSupported(isa)) return false;
+    activeKernels().store(kernelsFor(isa), std::memory_order_relaxed);
+    return true;
+}
+
+const char* MatchKernels::isaName(Isa isa) {
+    switch (isa) {
+        case Isa::AVX512: return "avx512";
+        case Isa::AVX2: return "avx2";
+        case Isa::SSE2: return "sse2";
+        case Isa::Scalar: return "scalar";
+    }
+    return "unknown";
+}
@@ -0,0 +1,37 @@
+#ifndef DELTASYNC_MATCH_KERNELS_H
+#define DELTASYNC_MATCH_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Векторизованные ядра поиска первого несовпадения для кодировщиков дельты.
+// Реализация (скалярная, SSE2, AVX2, AVX-512) выбирается один раз при старте по CPUID.
+class MatchKernels {
+public:
+    enum class Isa {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    // Длина общего префикса a и b, не больше limit (индекс первого несовпадения)
+    static size_t forward(const unsigned char* a, const unsigned char* b, size_t limit);
+
+    // Длина общего суффикса участков, заканчивающихся перед aEnd и bEnd, не больше limit
+    static size_t backward(const unsigned char* aEnd, const unsigned char* bEnd, size_t limit);
+
+    // Лексикографическое сравнение первых length байт через forward
+    static int compare(const unsigned char* a, const unsigned char* b, size_t length);
+
+    static Isa activeIsa();
+
+    static bool isSupported(Isa isa);
+
+    // Принудительный выбор реализации (для бенчмарков); false, если CPU её не поддерживает
+    static bool forceIsa(Isa isa);
+
+    static const char* isaName(Isa isa);
+};
+
+#endif //DELTASYNC_MATCH_KERNELS_H
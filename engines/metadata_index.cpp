@@ -0,0 +1,632 @@
+#include "metadata_index.h"
+#include "delta_format.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned char kSnapshotMagic[4] = {'D', 'S', 'M', 'I'};
+// Хеши хранятся 32 байтами; снимки v1 с хешами в hex не читаются
+constexpr uint32_t kSnapshotVersion = 2;
+constexpr size_t kHeaderSize = 48;
+constexpr size_t kDirectoryEntrySize = 32;
+
+// Флаг версии: за ней следуют objectHash и deltaBase
+constexpr uint8_t kRepackedFlag = 4;
+
+// Все числа хранятся в little-endian независимо от платформы
+void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void putU64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int shift = 0; shift < 64; shift += 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+void putString(std::vector<uint8_t>& out, const std::string& str) {
+    putU32(out, static_cast<uint32_t>(str.size()));
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+void putDigest(std::vector<uint8_t>& out, const Digest& digest) {
+    out.insert(out.end(), digest.bytes.begin(), digest.bytes.end());
+}
+
+uint32_t loadU32(const uint8_t* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+uint64_t loadU64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+// Последовательное чтение с проверкой границ
+class Reader {
+public:
+    Reader(const uint8_t* data, size_t size) : data(data), size(size) {}
+
+    uint8_t u8() {
+        need(1);
+        return data[pos++];
+    }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t value = loadU32(data + pos);
+        pos += 4;
+        return value;
+    }
+
+    uint64_t u64() {
+        need(8);
+        uint64_t value = loadU64(data + pos);
+        pos += 8;
+        return value;
+    }
+
+    std::string string() {
+        uint32_t length = u32();
+        need(length);
+        std::string value(reinterpret_cast<const char*>(data + pos), length);
+        pos += length;
+        return value;
+    }
+
+    Digest digest() {
+        need(Digest::kSize);
+        Digest value = Digest::fromBytes(data + pos);
+        pos += Digest::kSize;
+        return value;
+    }
+
+    bool atEnd() const { return pos == size; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+
+    void need(size_t n) const {
+        if (n > size - pos) throw std::runtime_error("Truncated metadata record");
+    }
+};
+
+void encodeVersion(std::vector<uint8_t>& out, const FileVersion& version) {
+    putDigest(out, version.hash);
+    putDigest(out, version.parentHash);
+    putDigest(out, version.contentHash);
+    putU64(out, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            version.timestamp.time_since_epoch()).count()));
+    putString(out, version.author);
+    putString(out, version.message);
+    bool repacked = !version.objectHash.empty() || !version.deltaBase.empty();
+    out.push_back(static_cast<uint8_t>((version.isDelta ? 1 : 0) | (version.isDeleted ? 2 : 0) |
+                                       (repacked ? kRepackedFlag : 0)));
+    putU32(out, version.chainDepth);
+    putU64(out, version.chainBytes);
+    if (repacked) {
+        putDigest(out, version.objectHash);
+        putDigest(out, version.deltaBase);
+    }
+}
+
+FileVersion decodeVersion(Reader& in) {
+    FileVersion version;
+    version.hash = in.digest();
+    version.parentHash = in.digest();
+    version.contentHash = in.digest();
+    version.timestamp = std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(static_cast<int64_t>(in.u64()))));
+    version.author = in.string();
+    version.message = in.string();
+    uint8_t flags = in.u8();
+    version.isDelta = flags & 1;
+    version.isDeleted = flags & 2;
+    version.chainDepth = in.u32();
+    version.chainBytes = in.u64();
+    if (flags & kRepackedFlag) {
+        version.objectHash = in.digest();
+        version.deltaBase = in.digest();
+    }
+    return version;
+}
+
+// Хранение версии после переупаковки (запись Storage)
+void encodeStorage(std::vector<uint8_t>& out, const FileVersion& version) {
+    putDigest(out, version.hash);
+    putDigest(out, version.objectHash);
+    putDigest(out, version.deltaBase);
+    out.push_back(static_cast<uint8_t>(version.isDelta ? 1 : 0));
+    putU32(out, version.chainDepth);
+    putU64(out, version.chainBytes);
+}
+
+FileVersion decodeStorage(Reader& in) {
+    FileVersion version;
+    version.hash = in.digest();
+    version.objectHash = in.digest();
+    version.deltaBase = in.digest();
+    version.isDelta = in.u8() & 1;
+    version.chainDepth = in.u32();
+    version.chainBytes = in.u64();
+    return version;
+}
+
+struct DirectoryEntry {
+    uint64_t nameOffset;
+    uint32_t nameLength;
+    uint32_t versionCount;
+    uint64_t versionsOffset;
+    uint64_t versionsLength;
+};
+
+// Представление снимка поверх отображённой памяти
+class SnapshotView {
+public:
+    explicit SnapshotView(const MappedFile* file) {
+        if (!file) return;
+
+        data = file->data();
+        size = file->size();
+        if (size < kHeaderSize || memcmp(data, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0) {
+            throw std::runtime_error("Invalid metadata snapshot");
+        }
+        if (loadU32(data + 4) != kSnapshotVersion) {
+            throw std::runtime_error("Unsupported metadata snapshot version");
+        }
+
+        lastSeq = loadU64(data + 8);
+        fileCount = loadU64(data + 16);
+        directoryOffset = loadU64(data + 24);
+        branchesOffset = loadU64(data + 32);
+        branchesLength = loadU64(data + 40);
+
+        if (directoryOffset > size || fileCount > (size - directoryOffset) / kDirectoryEntrySize ||
+            branchesOffset > size || branchesLength > size - branchesOffset) {
+            throw std::runtime_error("Corrupted metadata snapshot");
+        }
+    }
+
+    DirectoryEntry entry(uint64_t index) const {
+        const uint8_t* p = data + directoryOffset + index * kDirectoryEntrySize;
+        DirectoryEntry e{loadU64(p), loadU32(p + 8), loadU32(p + 12), loadU64(p + 16), loadU64(p + 24)};
+        if (e.nameOffset > size || e.nameLength > size - e.nameOffset ||
+            e.versionsOffset > size || e.versionsLength > size - e.versionsOffset) {
+            throw std::runtime_error("Corrupted metadata snapshot");
+        }
+        return e;
+    }
+
+    std::string_view name(const DirectoryEntry& e) const {
+        return {reinterpret_cast<const char*>(data + e.nameOffset), e.nameLength};
+    }
+
+    // Двоичный поиск по отсортированному каталогу
+    std::optional<DirectoryEntry> find(const std::string& fileName) const {
+        uint64_t lo = 0;
+        uint64_t hi = fileCount;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            DirectoryEntry e = entry(mid);
+            int cmp = name(e).compare(fileName);
+            if (cmp == 0) return e;
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return std::nullopt;
+    }
+
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    uint64_t lastSeq = 0;
+    uint64_t fileCount = 0;
+    uint64_t directoryOffset = 0;
+    uint64_t branchesOffset = 0;
+    uint64_t branchesLength = 0;
+};
+
+void writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to write metadata log");
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+}
+
+} // namespace
+
+MetadataIndex::MetadataIndex(const std::filesystem::path& dir, Options options)
+    : dir(dir), options(options) {
+    std::filesystem::create_directories(dir);
+}
+
+MetadataIndex::~MetadataIndex() {
+    if (logFd >= 0) {
+        ::close(logFd);
+    }
+}
+
+void MetadataIndex::open(BranchMap& branches, const VersionHandler& onVersion, const VersionHandler& onStorage) {
+    {
+        std::unique_lock<std::shared_mutex> lock(snapshotMutex);
+        snapshot = MappedFile::open(dir / "snapshot");
+    }
+
+    SnapshotView view(snapshot.get());
+
+    if (view.data) {
+        Reader in(view.data + view.branchesOffset, view.branchesLength);
+        uint32_t branchCount = in.u32();
+        for (uint32_t b = 0; b < branchCount; b++) {
+            auto& files = branches[in.string()];
+            uint32_t fileCount = in.u32();
+            for (uint32_t f = 0; f < fileCount; f++) {
+                std::string fileName = in.string();
+                files[fileName] = in.digest();
+            }
+        }
+    }
+
+    replayLog(view.lastSeq, branches, onVersion, onStorage);
+}
+
+void MetadataIndex::replayLog(uint64_t snapshotSeq, BranchMap& branches, const VersionHandler& onVersion,
+                              const VersionHandler& onStorage) {
+    std::lock_guard<std::mutex> lock(logMutex);
+
+    std::filesystem::path logPath = dir / "log";
+    nextSeq = snapshotSeq + 1;
+    logRecords = 0;
+
+    std::vector<uint8_t> log;
+    if (std::filesystem::exists(logPath)) {
+        std::ifstream file(logPath, std::ios::binary);
+        log.resize(std::filesystem::file_size(logPath));
+        file.read(reinterpret_cast<char*>(log.data()), log.size());
+    }
+
+    size_t pos = 0;
+    while (pos + 8 <= log.size()) {
+        uint32_t length = loadU32(log.data() + pos);
+        uint32_t crc = loadU32(log.data() + pos + 4);
+        if (length > log.size() - pos - 8 ||
+            DeltaFormat::checksum(log.data() + pos + 8, length) != crc) {
+            break; // оборванная при сбое запись — всё после неё отбрасывается
+        }
+
+        Reader in(log.data() + pos + 8, length);
+        auto type = static_cast<RecordType>(in.u8());
+        uint64_t seq = in.u64();
+        pos += 8 + length;
+        logRecords++;
+
+        // Записи, уже вошедшие в снимок (сбой между снимком и усечением журнала)
+        if (seq <= snapshotSeq) continue;
+        nextSeq = std::max(nextSeq, seq + 1);
+
+        switch (type) {
+            case RecordType::Version: {
+                std::string fileName = in.string();
+                onVersion(fileName, decodeVersion(in));
+                break;
+            }
+            case RecordType::Tip: {
+                std::string branch = in.string();
+                std::string fileName = in.string();
+                branches[branch][fileName] = in.digest();
+                break;
+            }
+            case RecordType::TipBatch: {
+                auto& files = branches[in.string()];
+                for (uint32_t count = in.u32(); count > 0; count--) {
+                    std::string fileName = in.string();
+                    files[fileName] = in.digest();
+                }
+                break;
+            }
+            case RecordType::Fork: {
+                std::string newBranch = in.string();
+                std::string fromBranch = in.string();
+                branches[newBranch] = branches[fromBranch];
+                break;
+            }
+            case RecordType::DeleteBranch:
+                branches.erase(in.string());
+                break;
+            case RecordType::Storage: {
+                std::string fileName = in.string();
+                for (uint32_t count = in.u32(); count > 0; count--) {
+                    FileVersion version = decodeStorage(in);
+                    if (onStorage) onStorage(fileName, version);
+                }
+                break;
+            }
+            default:
+                throw std::runtime_error("Unsupported metadata record type " +
+                                         std::to_string(static_cast<int>(type)));
+        }
+    }
+
+    logFd = ::open(logPath.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd < 0) {
+        throw std::runtime_error("Failed to open metadata log");
+    }
+    if (pos < log.size() && ftruncate(logFd, static_cast<off_t>(pos)) != 0) {
+        throw std::runtime_error("Failed to truncate metadata log");
+    }
+}
+
+std::optional<std::vector<FileVersion>> MetadataIndex::loadVersions(const std::string& fileName) const {
+    std::shared_lock<std::shared_mutex> lock(snapshotMutex);
+
+    SnapshotView view(snapshot.get());
+    if (!view.data) return std::nullopt;
+
+    auto entry = view.find(fileName);
+    if (!entry) return std::nullopt;
+
+    std::vector<FileVersion> versions;
+    versions.reserve(entry->versionCount);
+
+    Reader in(view.data + entry->versionsOffset, entry->versionsLength);
+    for (uint32_t i = 0; i < entry->versionCount; i++) {
+        versions.push_back(decodeVersion(in));
+    }
+    return versions;
+}
+
+std::vector<std::string> MetadataIndex::fileNames() const {
+    std::shared_lock<std::shared_mutex> lock(snapshotMutex);
+
+    std::vector<std::string> names;
+    SnapshotView view(snapshot.get());
+    names.reserve(view.fileCount);
+    for (uint64_t i = 0; i < view.fileCount; i++) {
+        names.emplace_back(view.name(view.entry(i)));
+    }
+    return names;
+}
+
+void MetadataIndex::appendVersion(const std::string& fileName, const FileVersion& version) {
+    std::vector<uint8_t> payload;
+    putString(payload, fileName);
+    encodeVersion(payload, version);
+    append(RecordType::Version, payload);
+}
+
+void MetadataIndex::appendTip(const std::string& branch, const std::string& fileName, const Digest& hash) {
+    std::vector<uint8_t> payload;
+    putString(payload, branch);
+    putString(payload, fileName);
+    putDigest(payload, hash);
+    append(RecordType::Tip, payload);
+}
+
+void MetadataIndex::appendTips(const std::string& branch,
+                               const std::vector<std::pair<std::string, Digest>>& tips) {
+    std::vector<uint8_t> payload;
+    putString(payload, branch);
+    putU32(payload, static_cast<uint32_t>(tips.size()));
+    for (const auto& [fileName, hash] : tips) {
+        putString(payload, fileName);
+        putDigest(payload, hash);
+    }
+    append(RecordType::TipBatch, payload);
+}
+
+void MetadataIndex::appendStorage(const std::string& fileName, const std::vector<FileVersion>& versions) {
+    std::vector<uint8_t> payload;
+    putString(payload, fileName);
+    putU32(payload, static_cast<uint32_t>(versions.size()));
+    for (const auto& version : versions) {
+        encodeStorage(payload, version);
+    }
+    append(RecordType::Storage, payload);
+}
+
+void MetadataIndex::appendFork(const std::string& newBranch, const std::string& fromBranch) {
+    std::vector<uint8_t> payload;
+    putString(payload, newBranch);
+    putString(payload, fromBranch);
+    append(RecordType::Fork, payload);
+}
+
+void MetadataIndex::appendDeleteBranch(const std::string& branch) {
+    std::vector<uint8_t> payload;
+    putString(payload, branch);
+    append(RecordType::DeleteBranch, payload);
+}
+
+void MetadataIndex::append(RecordType type, const std::vector<uint8_t>& payload) {
+    std::lock_guard<std::mutex> lock(logMutex);
+
+    std::vector<uint8_t> body;
+    body.reserve(payload.size() + 9);
+    body.push_back(static_cast<uint8_t>(type));
+    putU64(body, nextSeq++);
+    body.insert(body.end(), payload.begin(), payload.end());
+
+    std::vector<uint8_t> record;
+    record.reserve(body.size() + 8);
+    putU32(record, static_cast<uint32_t>(body.size()));
+    putU32(record, DeltaFormat::checksum(body.data(), body.size()));
+    record.insert(record.end(), body.begin(), body.end());
+
+    // Одна запись — один write с O_APPEND, чтобы записи не перемешивались
+    writeAll(logFd, record.data(), record.size());
+    if (options.syncWrites) {
+        fdatasync(logFd);
+    }
+    logRecords++;
+}
+
+void MetadataIndex::sync() {
+    std::lock_guard<std::mutex> lock(logMutex);
+    if (fdatasync(logFd) != 0) {
+        throw std::runtime_error("Failed to sync metadata log");
+    }
+
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        if (fd >= 0) ::close(fd);
+        throw std::runtime_error("Failed to sync metadata directory");
+    }
+    ::close(fd);
+}
+
+bool MetadataIndex::needsCompaction() const {
+    std::lock_guard<std::mutex> lock(logMutex);
+    return logRecords >= options.compactEvery;
+}
+
+void MetadataIndex::compact(const std::map<std::string, std::vector<FileVersion>>& materialized,
+                            const BranchMap& branches) {
+    std::lock_guard<std::mutex> logLock(logMutex);
+    std::unique_lock<std::shared_mutex> snapshotLock(snapshotMutex);
+
+    std::filesystem::path tempPath = dir / "snapshot.tmp";
+    writeSnapshot(tempPath, nextSeq - 1, materialized, branches, snapshot.get());
+    std::filesystem::rename(tempPath, dir / "snapshot");
+
+    snapshot = MappedFile::open(dir / "snapshot");
+
+    // Все записи журнала вошли в снимок
+    if (ftruncate(logFd, 0) != 0) {
+        throw std::runtime_error("Failed to truncate metadata log");
+    }
+    logRecords = 0;
+}
+
+void MetadataIndex::writeSnapshot(const std::filesystem::path& path, uint64_t lastSeq,
+                                  const std::map<std::string, std::vector<FileVersion>>& files,
+                                  const BranchMap& branches,
+                                  const MappedFile* previous) {
+    SnapshotView old(previous);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    uint64_t offset = 0;
+    std::vector<uint8_t> buffer;
+
+    auto flush = [&]() {
+        out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        offset += buffer.size();
+        buffer.clear();
+    };
+
+    buffer.resize(kHeaderSize);  // заголовок заполняется в конце
+    flush();
+
+    std::vector<DirectoryEntry> directory;
+    directory.reserve(files.size() + old.fileCount);
+
+    auto emitFile = [&](std::string_view name, auto&& writeVersions) {
+        DirectoryEntry e{};
+        e.nameOffset = offset;
+        e.nameLength = static_cast<uint32_t>(name.size());
+        buffer.insert(buffer.end(), name.begin(), name.end());
+        flush();
+
+        e.versionsOffset = offset;
+        e.versionCount = writeVersions();
+        flush();
+        e.versionsLength = offset - e.versionsOffset;
+        directory.push_back(e);
+    };
+
+    // Слияние отсортированного каталога старого снимка с файлами из памяти
+    uint64_t oldIndex = 0;
+    auto it = files.begin();
+    while (oldIndex < old.fileCount || it != files.end()) {
+        std::optional<DirectoryEntry> oldEntry;
+        if (oldIndex < old.fileCount) oldEntry = old.entry(oldIndex);
+
+        int cmp = !oldEntry ? 1 : (it == files.end() ? -1 : old.name(*oldEntry).compare(it->first));
+
+        if (cmp < 0) {
+            // Файл не загружался в память — копируем закодированные версии как есть
+            emitFile(old.name(*oldEntry), [&]() {
+                out.write(reinterpret_cast<const char*>(old.data + oldEntry->versionsOffset),
+                          static_cast<std::streamsize>(oldEntry->versionsLength));
+                offset += oldEntry->versionsLength;
+                return oldEntry->versionCount;
+            });
+            oldIndex++;
+        } else {
+            emitFile(it->first, [&]() {
+                for (const auto& version : it->second) {
+                    encodeVersion(buffer, version);
+                    if (buffer.size() >= (1u << 20)) flush();
+                }
+                return static_cast<uint32_t>(it->second.size());
+            });
+            if (cmp == 0) oldIndex++;
+            ++it;
+        }
+    }
+
+    uint64_t directoryOffset = offset;
+    for (const auto& e : directory) {
+        putU64(buffer, e.nameOffset);
+        putU32(buffer, e.nameLength);
+        putU32(buffer, e.versionCount);
+        putU64(buffer, e.versionsOffset);
+        putU64(buffer, e.versionsLength);
+        if (buffer.size() >= (1u << 20)) flush();
+    }
+    flush();
+
+    uint64_t branchesOffset = offset;
+    putU32(buffer, static_cast<uint32_t>(branches.size()));
+    for (const auto& [branch, branchFiles] : branches) {
+        putString(buffer, branch);
+        putU32(buffer, static_cast<uint32_t>(branchFiles.size()));
+        for (const auto& [fileName, hash] : branchFiles) {
+            putString(buffer, fileName);
+            putDigest(buffer, hash);
+        }
+    }
+    flush();
+    uint64_t branchesLength = offset - branchesOffset;
+
+    buffer.insert(buffer.end(), kSnapshotMagic, kSnapshotMagic + sizeof(kSnapshotMagic));
+    putU32(buffer, kSnapshotVersion);
+    putU64(buffer, lastSeq);
+    putU64(buffer, directory.size());
+    putU64(buffer, directoryOffset);
+    putU64(buffer, branchesOffset);
+    putU64(buffer, branchesLength);
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+    out.close();
+
+    if (!out) {
+        throw std::runtime_error("Failed to write metadata snapshot");
+    }
+
+    // Снимок должен попасть на диск до переименования
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        fsync(fd);
+        ::close(fd);
+    }
+}
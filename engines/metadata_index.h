@@ -0,0 +1,125 @@
+#ifndef DELTASYNC_METADATA_INDEX_H
+#define DELTASYNC_METADATA_INDEX_H
+
+#include "../servers/file_version.h"
+#include "mapped_file.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using deltasync::FileVersion;
+
+// Постоянный индекс метаданных репозитория (история версий и указатели веток).
+//
+// meta/snapshot — компактный снимок, отображаемый в память:
+//   заголовок | для каждого файла: имя и закодированные версии | каталог | ветки
+//   Каталог — отсортированный по имени массив записей фиксированного размера,
+//   поэтому история файла находится двоичным поиском и декодируется лениво.
+// meta/log — журнал изменений после снимка, только дозапись:
+//   uint32 длина | uint32 crc32 | тип | uint64 seq | данные
+//
+// Запуск читает заголовок снимка, ветки и хвост журнала; время не зависит от длины истории.
+class MetadataIndex {
+public:
+    using BranchMap = std::map<std::string, std::map<std::string, Digest>>;
+
+    struct Options {
+        // Число записей журнала, после которого стоит переписать снимок
+        size_t compactEvery = 65536;
+
+        // fdatasync после каждой записи журнала
+        bool syncWrites = false;
+    };
+
+    // Вызывается для каждой версии из журнала при открытии
+    using VersionHandler = std::function<void(const std::string& fileName, const FileVersion& version)>;
+
+    MetadataIndex(const std::filesystem::path& dir, Options options);
+
+    ~MetadataIndex();
+
+    MetadataIndex(const MetadataIndex&) = delete;
+    MetadataIndex& operator=(const MetadataIndex&) = delete;
+
+    // Отображение снимка, загрузка веток из него и проигрывание журнала.
+    // Изменения веток из журнала применяются к branches напрямую.
+    // onStorage получает новое хранение уже известной версии: hash, objectHash, deltaBase,
+    // isDelta, chainDepth и chainBytes (остальные поля пусты).
+    void open(BranchMap& branches, const VersionHandler& onVersion, const VersionHandler& onStorage = {});
+
+    // История файла из снимка (без учёта журнала); std::nullopt, если файла в снимке нет
+    std::optional<std::vector<FileVersion>> loadVersions(const std::string& fileName) const;
+
+    // Имена файлов в снимке (без учёта журнала), по возрастанию
+    std::vector<std::string> fileNames() const;
+
+    void appendVersion(const std::string& fileName, const FileVersion& version);
+
+    void appendTip(const std::string& branch, const std::string& fileName, const Digest& hash);
+
+    // Указатели ветки на несколько файлов одной записью: после сбоя видны все или ни одного
+    void appendTips(const std::string& branch, const std::vector<std::pair<std::string, Digest>>& tips);
+
+    // Новое хранение версий файла после переупаковки одной записью: цепочки дельт
+    // меняются согласованно, после сбоя видны все изменения или ни одного
+    void appendStorage(const std::string& fileName, const std::vector<FileVersion>& versions);
+
+    void appendFork(const std::string& newBranch, const std::string& fromBranch);
+
+    void appendDeleteBranch(const std::string& branch);
+
+    bool needsCompaction() const;
+
+    // Сброс на диск журнала и каталога (переименованного снимка) независимо от syncWrites
+    void sync();
+
+    // Переписывает снимок. Для файлов из materialized берутся версии из памяти,
+    // остальные копируются из старого снимка без декодирования.
+    // Вызывающий гарантирует, что параллельно нет записей в журнал.
+    void compact(const std::map<std::string, std::vector<FileVersion>>& materialized,
+                 const BranchMap& branches);
+
+    // Запись снимка «с нуля» (используется бенчмарком и при компактации)
+    static void writeSnapshot(const std::filesystem::path& path, uint64_t lastSeq,
+                              const std::map<std::string, std::vector<FileVersion>>& files,
+                              const BranchMap& branches,
+                              const MappedFile* previous = nullptr);
+
+private:
+    // Номера 1 и 2 занимали записи v1 с хешами в hex; они не поддерживаются
+    enum class RecordType : uint8_t {
+        Fork = 3,
+        DeleteBranch = 4,
+        Version = 5,
+        Tip = 6,
+        TipBatch = 7,
+        Storage = 8
+    };
+
+    std::filesystem::path dir;
+    Options options;
+
+    mutable std::shared_mutex snapshotMutex;
+    std::shared_ptr<MappedFile> snapshot;
+
+    mutable std::mutex logMutex;
+    int logFd = -1;
+    uint64_t nextSeq = 1;
+    size_t logRecords = 0;
+
+    void append(RecordType type, const std::vector<uint8_t>& payload);
+
+    void replayLog(uint64_t snapshotSeq, BranchMap& branches, const VersionHandler& onVersion,
+                   const VersionHandler& onStorage);
+};
+
+#endif //DELTASYNC_METADATA_INDEX_H
@@ -0,0 +1,566 @@
+#include "object_codec.h"
+#include "delta_format.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <zlib.h>
+
+#ifdef DELTASYNC_HAVE_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+namespace {
+
+constexpr size_t kFixedHeaderSize = 8;     // magic, кодек, id словаря
+constexpr uint8_t kFramedFlag = 0x80;      // старший бит байта кодека — объект из кусков
+constexpr uint8_t kManifestFlag = 0x40;    // объект — список кусков ChunkManifest
+constexpr uint8_t kCodecMask = 0x3f;
+constexpr size_t kZlibDictionaryBytes = 32768;  // окно deflate
+constexpr size_t kZstdDictionaryBytes = 112640;
+constexpr unsigned char kDictionaryMagic[4] = {'D', 'S', 'D', 'C'};
+
+void putU32(std::vector<uint8_t>& out, uint32_t value) {
+    for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<uint8_t>(value >> shift));
+}
+
+uint32_t loadU32(const uint8_t* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+uint32_t dictionaryId(Compression codec, const std::vector<uint8_t>& bytes) {
+    auto tag = static_cast<unsigned char>(codec);
+    uint32_t id = DeltaFormat::checksum(&tag, 1);
+    id = DeltaFormat::checksum(bytes.data(), bytes.size(), id);
+    return id ? id : 1;
+}
+
+void deflateInto(std::span<const uint8_t> raw, int level, const CompressionDictionary* dictionary,
+                 std::vector<uint8_t>& out) {
+    z_stream stream{};
+    if (deflateInit(&stream, level ? level : Z_DEFAULT_COMPRESSION) != Z_OK) {
+        throw std::runtime_error("deflateInit failed");
+    }
+
+    if (dictionary && deflateSetDictionary(&stream, dictionary->bytes.data(),
+                                           static_cast<uInt>(dictionary->bytes.size())) != Z_OK) {
+        deflateEnd(&stream);
+        throw std::runtime_error("deflateSetDictionary failed");
+    }
+
+    size_t headerSize = out.size();
+    out.resize(headerSize + deflateBound(&stream, raw.size()));
+
+    stream.next_in = const_cast<Bytef*>(raw.data());
+    stream.avail_in = static_cast<uInt>(raw.size());
+    stream.next_out = out.data() + headerSize;
+    stream.avail_out = static_cast<uInt>(out.size() - headerSize);
+
+    // deflateBound гарантирует, что одного вызова с Z_FINISH достаточно
+    int result = deflate(&stream, Z_FINISH);
+    deflateEnd(&stream);
+    if (result != Z_STREAM_END) {
+        throw std::runtime_error("deflate failed");
+    }
+
+    out.resize(headerSize + stream.total_out);
+}
+
+void inflateInto(std::span<const uint8_t> compressed, const CompressionDictionary* dictionary,
+                 std::span<uint8_t> out) {
+    z_stream stream{};
+    if (inflateInit(&stream) != Z_OK) {
+        throw std::runtime_error("inflateInit failed");
+    }
+
+    stream.next_in = const_cast<Bytef*>(compressed.data());
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    stream.next_out = out.data();
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int result = inflate(&stream, Z_FINISH);
+    if (result == Z_NEED_DICT) {
+        if (!dictionary || inflateSetDictionary(&stream, dictionary->bytes.data(),
+                                                static_cast<uInt>(dictionary->bytes.size())) != Z_OK) {
+            inflateEnd(&stream);
+            throw std::runtime_error("Compression dictionary mismatch");
+        }
+        result = inflate(&stream, Z_FINISH);
+    }
+
+    uint64_t produced = stream.total_out;
+    inflateEnd(&stream);
+    if (result != Z_STREAM_END || produced != out.size()) {
+        throw std::runtime_error("Corrupted compressed object");
+    }
+}
+
+#ifdef DELTASYNC_HAVE_ZSTD
+// Контексты zstd переиспользуются в пределах потока
+struct ZstdContexts {
+    ZSTD_CCtx* compress = ZSTD_createCCtx();
+    ZSTD_DCtx* decompress = ZSTD_createDCtx();
+
+    ~ZstdContexts() {
+        ZSTD_freeCCtx(compress);
+        ZSTD_freeDCtx(decompress);
+    }
+};
+
+ZstdContexts& zstdContexts() {
+    thread_local ZstdContexts contexts;
+    return contexts;
+}
+
+void zstdCompressInto(std::span<const uint8_t> raw, int level, const CompressionDictionary* dictionary,
+                      std::vector<uint8_t>& out) {
+    size_t headerSize = out.size();
+    out.resize(headerSize + ZSTD_compressBound(raw.size()));
+
+    size_t result = dictionary
+            ? ZSTD_compress_usingDict(zstdContexts().compress, out.data() + headerSize, out.size() - headerSize,
+                                      raw.data(), raw.size(), dictionary->bytes.data(), dictionary->bytes.size(),
+                                      level)
+            : ZSTD_compressCCtx(zstdContexts().compress, out.data() + headerSize, out.size() - headerSize,
+                                raw.data(), raw.size(), level);
+    if (ZSTD_isError(result)) {
+        throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(result));
+    }
+
+    out.resize(headerSize + result);
+}
+
+void zstdDecompressInto(std::span<const uint8_t> compressed, const CompressionDictionary* dictionary,
+                        std::span<uint8_t> out) {
+    size_t result = ZSTD_decompress_usingDict(zstdContexts().decompress, out.data(), out.size(),
+                                              compressed.data(), compressed.size(),
+                                              dictionary ? dictionary->bytes.data() : nullptr,
+                                              dictionary ? dictionary->bytes.size() : 0);
+    if (ZSTD_isError(result) || result != out.size()) {
+        throw std::runtime_error("Corrupted compressed object");
+    }
+}
+#endif
+
+// Начальные фрагменты образцов поровну; самые полезные строки ближе к концу словаря
+std::vector<uint8_t> prefixDictionary(const std::vector<std::vector<uint8_t>>& samples, size_t capacity) {
+    std::vector<uint8_t> dictionary;
+    if (samples.empty()) return dictionary;
+
+    size_t share = std::max<size_t>(capacity / samples.size(), 64);
+    for (const auto& sample : samples) {
+        size_t take = std::min({share, sample.size(), capacity - dictionary.size()});
+        dictionary.insert(dictionary.end(), sample.begin(), sample.begin() + take);
+        if (dictionary.size() == capacity) break;
+    }
+    return dictionary;
+}
+
+} // namespace
+
+bool ObjectCodec::isAvailable(Compression codec) {
+    switch (codec) {
+        case Compression::None:
+        case Compression::Zlib:
+            return true;
+        case Compression::Zstd:
+#ifdef DELTASYNC_HAVE_ZSTD
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+std::vector<uint8_t> ObjectCodec::encode(std::span<const uint8_t> raw, Compression codec, int level,
+                                         const CompressionDictionary* dictionary) {
+    codec = effectiveCodec(codec);
+    if (dictionary && dictionary->codec != codec) {
+        dictionary = nullptr;
+    }
+
+    auto header = [&](Compression used, uint32_t dictId) {
+        std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+        out.push_back(static_cast<uint8_t>(used));
+        putU32(out, dictId);
+        DeltaFormat::putVarint(out, raw.size());
+        return out;
+    };
+
+    std::vector<uint8_t> out = header(codec, dictionary ? dictionary->id : 0);
+
+    // Несжимаемые данные (уже сжатые форматы, короткие дельты) хранятся как есть
+    if (!compressChunk(raw, codec, level, dictionary, out)) {
+        out = header(Compression::None, 0);
+        out.insert(out.end(), raw.begin(), raw.end());
+    }
+
+    return out;
+}
+
+std::vector<uint8_t> ObjectCodec::encodeManifest(const ChunkManifest& manifest) {
+    std::vector<uint8_t> encoded = manifest.encode();
+
+    // Хеши кусков не сжимаются
+    std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+    out.push_back(kManifestFlag | static_cast<uint8_t>(Compression::None));
+    putU32(out, 0);
+    DeltaFormat::putVarint(out, encoded.size());
+    out.insert(out.end(), encoded.begin(), encoded.end());
+    return out;
+}
+
+std::vector<uint8_t> ObjectCodec::encodeParallel(std::span<const uint8_t> raw, Compression codec, int level,
+                                                 const CompressionDictionary* dictionary, WorkerPool& pool,
+                                                 size_t chunkSize) {
+    codec = effectiveCodec(codec);
+    if (dictionary && dictionary->codec != codec) {
+        dictionary = nullptr;
+    }
+    chunkSize = std::max<size_t>(chunkSize, 1);
+
+    size_t count = (raw.size() + chunkSize - 1) / chunkSize;
+
+    struct Chunk {
+        std::vector<uint8_t> stored;
+        bool compressed = false;
+        uint32_t checksum = 0;
+    };
+    std::vector<Chunk> chunks(count);
+
+    pool.parallelFor(count, [&](size_t i) {
+        auto piece = raw.subspan(i * chunkSize, std::min(chunkSize, raw.size() - i * chunkSize));
+        Chunk& chunk = chunks[i];
+
+        chunk.checksum = DeltaFormat::checksum(piece.data(), piece.size());
+        chunk.compressed = compressChunk(piece, codec, level, dictionary, chunk.stored);
+        if (!chunk.compressed) {
+            chunk.stored.assign(piece.begin(), piece.end());
+        }
+    });
+
+    std::vector<uint8_t> out(kMagic, kMagic + sizeof(kMagic));
+    out.push_back(static_cast<uint8_t>(kFramedFlag | static_cast<uint8_t>(codec)));
+    putU32(out, dictionary ? dictionary->id : 0);
+    DeltaFormat::putVarint(out, raw.size());
+    DeltaFormat::putVarint(out, chunkSize);
+    DeltaFormat::putVarint(out, count);
+
+    size_t payloadSize = 0;
+    for (const auto& chunk : chunks) {
+        DeltaFormat::putVarint(out, chunk.stored.size() << 1 | (chunk.compressed ? 0 : 1));
+        putU32(out, chunk.checksum);
+        payloadSize += chunk.stored.size();
+    }
+
+    out.reserve(out.size() + payloadSize);
+    for (auto& chunk : chunks) {
+        out.insert(out.end(), chunk.stored.begin(), chunk.stored.end());
+        std::vector<uint8_t>().swap(chunk.stored);
+    }
+
+    return out;
+}
+
+std::optional<size_t> ObjectCodec::rawPayloadOffset(std::span<const uint8_t> prefix, uint64_t storedSize) {
+    const uint8_t* data = prefix.data();
+    if (storedSize < kFixedHeaderSize || prefix.size() < kFixedHeaderSize ||
+        memcmp(data, kMagic, sizeof(kMagic)) != 0 || (data[3] & kCodecMask) > 2) {
+        return 0;  // объект без заголовка
+    }
+    if (data[3] != static_cast<uint8_t>(Compression::None)) {
+        return std::nullopt;
+    }
+
+    size_t pos = kFixedHeaderSize;
+    uint64_t rawSize = 0;
+    if (!DeltaFormat::getVarint(data, prefix.size(), pos, rawSize) || rawSize != storedSize - pos) {
+        throw std::runtime_error("Corrupted object header");
+    }
+    return pos;
+}
+
+bool ObjectCodec::isManifest(std::span<const uint8_t> prefix) {
+    return prefix.size() >= kFixedHeaderSize && memcmp(prefix.data(), kMagic, sizeof(kMagic)) == 0 &&
+           (prefix[3] & kCodecMask) <= 2 && (prefix[3] & kManifestFlag) != 0;
+}
+
+ObjectData ObjectCodec::decode(ObjectData stored, const DictionaryLookup& dictionaries, WorkerPool* pool) {
+    const uint8_t* data = stored.data();
+    size_t size = stored.size();
+
+    if (size < kFixedHeaderSize || memcmp(data, kMagic, sizeof(kMagic)) != 0 || (data[3] & kCodecMask) > 2) {
+        return stored;
+    }
+
+    bool framed = (data[3] & kFramedFlag) != 0;
+    bool manifest = (data[3] & kManifestFlag) != 0;
+    auto codec = static_cast<Compression>(data[3] & kCodecMask);
+    uint32_t dictId = loadU32(data + 4);
+
+    size_t pos = kFixedHeaderSize;
+    uint64_t rawSize = 0;
+    if (!DeltaFormat::getVarint(data, size, pos, rawSize)) {
+        throw std::runtime_error("Corrupted object header");
+    }
+
+    if (codec == Compression::None && !framed) {
+        std::span<const uint8_t> payload = stored.bytes.subspan(pos);
+        if (payload.size() != rawSize) {
+            throw std::runtime_error("Corrupted object header");
+        }
+        return ObjectData{payload, std::move(stored.owner), manifest};
+    }
+
+    std::shared_ptr<const CompressionDictionary> dictionary;
+    if (dictId != 0) {
+        dictionary = dictionaries ? dictionaries(dictId) : nullptr;
+        if (!dictionary) {
+            throw std::runtime_error("Compression dictionary not found");
+        }
+    }
+
+    std::vector<uint8_t> raw(rawSize);
+
+    if (!framed) {
+        decompressChunk(stored.bytes.subspan(pos), codec, dictionary.get(), raw);
+        return ObjectData::fromVector(std::move(raw));
+    }
+
+    uint64_t chunkSize = 0;
+    uint64_t count = 0;
+    if (!DeltaFormat::getVarint(data, size, pos, chunkSize) || !DeltaFormat::getVarint(data, size, pos, count) ||
+        chunkSize == 0 || count != (rawSize + chunkSize - 1) / chunkSize) {
+        throw std::runtime_error("Corrupted object header");
+    }
+
+    struct ChunkRef {
+        uint64_t offset;
+        uint64_t length;
+        bool compressed;
+        uint32_t checksum;
+    };
+    std::vector<ChunkRef> refs(count);
+
+    for (auto& ref : refs) {
+        uint64_t tagged = 0;
+        if (!DeltaFormat::getVarint(data, size, pos, tagged) || pos + 4 > size) {
+            throw std::runtime_error("Corrupted object header");
+        }
+        ref.length = tagged >> 1;
+        ref.compressed = (tagged & 1) == 0;
+        ref.checksum = loadU32(data + pos);
+        pos += 4;
+    }
+    for (auto& ref : refs) {
+        if (ref.length > size - pos) {
+            throw std::runtime_error("Corrupted object header");
+        }
+        ref.offset = pos;
+        pos += ref.length;
+    }
+
+    // Куски независимы: каждый распаковывается прямо на своё место в результате
+    auto decodeChunk = [&](size_t i) {
+        const ChunkRef& ref = refs[i];
+        std::span<uint8_t> target(raw.data() + i * chunkSize, std::min<uint64_t>(chunkSize, rawSize - i * chunkSize));
+        auto payload = stored.bytes.subspan(ref.offset, ref.length);
+
+        if (ref.compressed) {
+            decompressChunk(payload, codec, dictionary.get(), target);
+        } else if (payload.size() == target.size()) {
+            memcpy(target.data(), payload.data(), payload.size());
+        } else {
+            throw std::runtime_error("Corrupted compressed object");
+        }
+
+        if (DeltaFormat::checksum(target.data(), target.size()) != ref.checksum) {
+            throw std::runtime_error("Object chunk checksum mismatch");
+        }
+    };
+
+    if (pool && count > 1) {
+        pool->parallelFor(count, decodeChunk);
+    } else {
+        for (size_t i = 0; i < count; i++) decodeChunk(i);
+    }
+
+    return ObjectData::fromVector(std::move(raw));
+}
+
+Compression ObjectCodec::effectiveCodec(Compression codec) {
+    return isAvailable(codec) ? codec : Compression::Zlib;
+}
+
+bool ObjectCodec::compressChunk(std::span<const uint8_t> raw, Compression codec, int level,
+                                const CompressionDictionary* dictionary, std::vector<uint8_t>& out) {
+    size_t headerSize = out.size();
+
+    if (codec == Compression::Zlib) {
+        deflateInto(raw, level, dictionary, out);
+    }
+#ifdef DELTASYNC_HAVE_ZSTD
+    else if (codec == Compression::Zstd) {
+        zstdCompressInto(raw, level, dictionary, out);
+    }
+#endif
+
+    if (codec == Compression::None || out.size() - headerSize >= raw.size()) {
+        out.resize(headerSize);
+        return false;
+    }
+    return true;
+}
+
+void ObjectCodec::decompressChunk(std::span<const uint8_t> payload, Compression codec,
+                                  const CompressionDictionary* dictionary, std::span<uint8_t> out) {
+    if (codec == Compression::Zlib) {
+        inflateInto(payload, dictionary, out);
+    } else if (codec == Compression::Zstd) {
+#ifdef DELTASYNC_HAVE_ZSTD
+        zstdDecompressInto(payload, dictionary, out);
+#else
+        throw std::runtime_error("Object is zstd-compressed, but zstd support is not built in");
+#endif
+    } else {
+        throw std::runtime_error("Corrupted object header");
+    }
+}
+
+CompressionDictionary ObjectCodec::trainDictionary(const std::vector<std::vector<uint8_t>>& samples,
+                                                   Compression codec) {
+    if (!isAvailable(codec) || codec == Compression::None) {
+        codec = Compression::Zlib;
+    }
+
+    CompressionDictionary dictionary;
+    dictionary.codec = codec;
+
+#ifdef DELTASYNC_HAVE_ZSTD
+    if (codec == Compression::Zstd) {
+        std::vector<uint8_t> joined;
+        std::vector<size_t> sizes;
+        for (const auto& sample : samples) {
+            joined.insert(joined.end(), sample.begin(), sample.end());
+            sizes.push_back(sample.size());
+        }
+
+        dictionary.bytes.resize(kZstdDictionaryBytes);
+        size_t result = ZDICT_trainFromBuffer(dictionary.bytes.data(), dictionary.bytes.size(),
+                                              joined.data(), sizes.data(), static_cast<unsigned>(sizes.size()));
+        if (!ZDICT_isError(result)) {
+            dictionary.bytes.resize(result);
+        } else {
+            // Мало образцов для обучения — zstd примет и «сырой» словарь
+            dictionary.bytes = prefixDictionary(samples, kZstdDictionaryBytes);
+        }
+    }
+#endif
+
+    if (codec == Compression::Zlib) {
+        dictionary.bytes = prefixDictionary(samples, kZlibDictionaryBytes);
+    }
+
+    dictionary.id = dictionaryId(codec, dictionary.bytes);
+    return dictionary;
+}
+
+// --- CompressionDictionaries ---
+
+CompressionDictionaries::CompressionDictionaries(const std::filesystem::path& dir) : dir(dir) {
+    std::filesystem::create_directories(dir);
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.path().extension() != ".dict") continue;
+
+        std::ifstream file(entry.path(), std::ios::binary);
+        std::vector<uint8_t> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (content.size() < 5 || memcmp(content.data(), kDictionaryMagic, sizeof(kDictionaryMagic)) != 0) {
+            continue;
+        }
+
+        auto dictionary = std::make_shared<CompressionDictionary>();
+        dictionary->codec = static_cast<Compression>(content[4]);
+        dictionary->bytes.assign(content.begin() + 5, content.end());
+        dictionary->id = dictionaryId(dictionary->codec, dictionary->bytes);
+        byId[dictionary->id] = std::move(dictionary);
+    }
+
+    std::ifstream activeFile(dir / "active");
+    std::string extension;
+    uint32_t id;
+    while (activeFile >> extension >> std::hex >> id) {
+        if (byId.count(id)) {
+            active[extension == "-" ? "" : extension] = id;
+        }
+    }
+}
+
+std::string CompressionDictionaries::extensionOf(const std::string& fileName) {
+    return std::filesystem::path(fileName).extension().string();
+}
+
+std::shared_ptr<const CompressionDictionary> CompressionDictionaries::forFile(const std::string& fileName) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    auto it = active.find(extensionOf(fileName));
+    if (it == active.end()) return nullptr;
+    return byId.at(it->second);
+}
+
+std::shared_ptr<const CompressionDictionary> CompressionDictionaries::find(uint32_t id) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    auto it = byId.find(id);
+    return it == byId.end() ? nullptr : it->second;
+}
+
+void CompressionDictionaries::install(const std::string& extension, CompressionDictionary dictionary) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+
+    std::stringstream name;
+    name << std::hex << std::setw(8) << std::setfill('0') << dictionary.id << ".dict";
+
+    std::filesystem::path path = dir / name.str();
+    if (!std::filesystem::exists(path)) {
+        std::filesystem::path tempPath = path.string() + ".tmp";
+        {
+            std::ofstream file(tempPath, std::ios::binary);
+            file.write(reinterpret_cast<const char*>(kDictionaryMagic), sizeof(kDictionaryMagic));
+            file.put(static_cast<char>(dictionary.codec));
+            file.write(reinterpret_cast<const char*>(dictionary.bytes.data()),
+                       static_cast<std::streamsize>(dictionary.bytes.size()));
+            if (!file) {
+                throw std::runtime_error("Failed to write compression dictionary");
+            }
+        }
+        std::filesystem::rename(tempPath, path);
+    }
+
+    uint32_t id = dictionary.id;
+    byId[id] = std::make_shared<const CompressionDictionary>(std::move(dictionary));
+    active[extension] = id;
+    writeActive();
+}
+
+// Вызывается под исключительной блокировкой
+void CompressionDictionaries::writeActive() const {
+    std::filesystem::path tempPath = dir / "active.tmp";
+    {
+        std::ofstream file(tempPath);
+        for (const auto& [extension, id] : active) {
+            file << (extension.empty() ? "-" : extension) << ' ' << std::hex << id << '\n';
+        }
+        if (!file) {
+            throw std::runtime_error("Failed to write compression dictionary list");
+        }
+    }
+    std::filesystem::rename(tempPath, dir / "active");
+}
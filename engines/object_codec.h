@@ -0,0 +1,120 @@
+#ifndef DELTASYNC_OBJECT_CODEC_H
+#define DELTASYNC_OBJECT_CODEC_H
+
+#include "chunk_manifest.h"
+#include "object_store.h"
+#include "worker_pool.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+enum class Compression : uint8_t {
+    None = 0,
+    Zlib = 1,
+    Zstd = 2    // при сборке без DELTASYNC_HAVE_ZSTD запись идёт через zlib
+};
+
+// Словарь сжатия для одного типа файлов; id — crc32 кодека и содержимого
+struct CompressionDictionary {
+    uint32_t id = 0;
+    Compression codec = Compression::None;
+    std::vector<uint8_t> bytes;
+};
+
+using DictionaryLookup = std::function<std::shared_ptr<const CompressionDictionary>(uint32_t id)>;
+
+// Кодирование хранимых объектов. Формат:
+//   "DSZ" | uint8 кодек | uint32 LE id словаря (0 — без словаря) | varint исходный размер | данные
+// Объект из кусков (старший бит кодека установлен) после размера содержит:
+//   varint размер куска | varint число кусков |
+//   для каждого куска: varint (длина << 1 | хранится без сжатия), uint32 crc32 исходного куска |
+//   данные кусков подряд
+// Куски сжимаются независимо, поэтому кодируются и распаковываются параллельно.
+// Бит 0x40 кодека помечает список кусков ChunkManifest (ObjectData::manifest после decode).
+// Объекты без заголовка (записанные до появления сжатия) читаются как есть.
+class ObjectCodec {
+public:
+    static constexpr unsigned char kMagic[3] = {'D', 'S', 'Z'};
+
+    // Наибольшая длина заголовка объекта без кусков
+    static constexpr size_t kMaxHeaderSize = 18;
+
+    static bool isAvailable(Compression codec);
+
+    // level = 0 — уровень кодека по умолчанию. Если сжатие не уменьшает объект,
+    // он сохраняется с кодеком None. Словарь применяется, только если обучен для того же кодека.
+    static std::vector<uint8_t> encode(std::span<const uint8_t> raw, Compression codec, int level = 0,
+                                       const CompressionDictionary* dictionary = nullptr);
+
+    static std::vector<uint8_t> encodeManifest(const ChunkManifest& manifest);
+
+    // Параллельное сжатие кусками по chunkSize байт на пуле
+    static std::vector<uint8_t> encodeParallel(std::span<const uint8_t> raw, Compression codec, int level,
+                                               const CompressionDictionary* dictionary, WorkerPool& pool,
+                                               size_t chunkSize);
+
+    // Несжатые объекты возвращаются окном в stored без копирования.
+    // Куски объекта распаковываются на pool, если он задан.
+    static ObjectData decode(ObjectData stored, const DictionaryLookup& dictionaries = {},
+                             WorkerPool* pool = nullptr);
+
+    // Смещение содержимого в хранимом объекте размера storedSize, если оно лежит там без сжатия
+    // (кодек None без кусков или объект без заголовка); иначе std::nullopt.
+    // prefix — начало объекта, не меньше kMaxHeaderSize байт либо весь объект.
+    static std::optional<size_t> rawPayloadOffset(std::span<const uint8_t> prefix, uint64_t storedSize);
+
+    // Объект — список кусков ChunkManifest; prefix — начало объекта, как для rawPayloadOffset
+    static bool isManifest(std::span<const uint8_t> prefix);
+
+    // Словарь из образцов содержимого: ZDICT для zstd, начальные фрагменты образцов для zlib
+    static CompressionDictionary trainDictionary(const std::vector<std::vector<uint8_t>>& samples,
+                                                 Compression codec);
+
+private:
+    // Кодек, доступный в этой сборке (zstd заменяется на zlib)
+    static Compression effectiveCodec(Compression codec);
+
+    // Дописывает сжатый кусок в out; false (out не изменён), если сжатие не уменьшает данные
+    static bool compressChunk(std::span<const uint8_t> raw, Compression codec, int level,
+                              const CompressionDictionary* dictionary, std::vector<uint8_t>& out);
+
+    static void decompressChunk(std::span<const uint8_t> payload, Compression codec,
+                                const CompressionDictionary* dictionary, std::span<uint8_t> out);
+};
+
+// Словари по расширению файла, каталог objects/dict:
+//   <id>.dict — "DSDC" | uint8 кодек | содержимое;
+//   active    — строки "<расширение> <id>" для записи новых объектов.
+// Старые словари не удаляются: на них ссылаются уже записанные объекты.
+class CompressionDictionaries {
+public:
+    explicit CompressionDictionaries(const std::filesystem::path& dir);
+
+    // Словарь для новых объектов файла; nullptr, если для его типа словаря нет
+    std::shared_ptr<const CompressionDictionary> forFile(const std::string& fileName) const;
+
+    std::shared_ptr<const CompressionDictionary> find(uint32_t id) const;
+
+    // Сохраняет словарь и делает его активным для расширения
+    void install(const std::string& extension, CompressionDictionary dictionary);
+
+    static std::string extensionOf(const std::string& fileName);
+
+private:
+    std::filesystem::path dir;
+    mutable std::shared_mutex mutex;
+    std::map<uint32_t, std::shared_ptr<const CompressionDictionary>> byId;
+    std::map<std::string, uint32_t> active;
+
+    void writeActive() const;
+};
+
+#endif //DELTASYNC_OBJECT_CODEC_H
@@ -0,0 +1,644 @@
+#include "object_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <unordered_set>
+#include <utility>
+
+namespace {
+
+constexpr unsigned char kPackMagic[4] = {'D', 'S', 'P', 'K'};
+constexpr unsigned char kIndexMagic[4] = {'D', 'S', 'P', 'I'};
+constexpr uint32_t kPackVersion = 1;
+constexpr size_t kPackHeaderSize = 8;
+constexpr size_t kDigestSize = 32;
+constexpr size_t kIndexHeaderSize = 12 + 256 * 4;
+constexpr size_t kIndexEntrySize = kDigestSize + 16;
+
+void putU32(uint8_t* p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+void putU64(uint8_t* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) p[i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint32_t loadU32(const uint8_t* p) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+uint64_t loadU64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = value << 8 | p[i];
+    return value;
+}
+
+void writeAll(int fd, const struct iovec* iov, int count) {
+    std::vector<struct iovec> pending(iov, iov + count);
+    size_t index = 0;
+
+    while (index < pending.size()) {
+        ssize_t written = ::writev(fd, pending.data() + index, static_cast<int>(pending.size() - index));
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Failed to write pack file");
+        }
+
+        auto remaining = static_cast<size_t>(written);
+        while (index < pending.size() && remaining >= pending[index].iov_len) {
+            remaining -= pending[index].iov_len;
+            index++;
+        }
+        if (index < pending.size()) {
+            pending[index].iov_base = static_cast<uint8_t*>(pending[index].iov_base) + remaining;
+            pending[index].iov_len -= remaining;
+        }
+    }
+}
+
+// fsync файла или каталога (после переименования в нём)
+void syncPath(const std::filesystem::path& path, bool directory) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC | (directory ? O_DIRECTORY : 0));
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path.string() + " for sync");
+    }
+    int result = fsync(fd);
+    ::close(fd);
+    if (result != 0) {
+        throw std::runtime_error("Failed to sync " + path.string());
+    }
+}
+
+// Заголовок индекса, размер под число записей и монотонность fanout; смещения записей
+// сверяются с размером pack-файла при чтении
+bool validIndex(const MappedFile& pack, const MappedFile& index) {
+    if (pack.size() < kPackHeaderSize || memcmp(pack.data(), kPackMagic, sizeof(kPackMagic)) != 0) return false;
+
+    const uint8_t* data = index.data();
+    if (index.size() < kIndexHeaderSize || memcmp(data, kIndexMagic, sizeof(kIndexMagic)) != 0 ||
+        loadU32(data + 4) != kPackVersion) {
+        return false;
+    }
+
+    uint64_t count = loadU32(data + 8);
+    if (index.size() != kIndexHeaderSize + count * kIndexEntrySize) return false;
+
+    uint32_t previous = 0;
+    for (int b = 0; b < 256; b++) {
+        uint32_t cumulative = loadU32(data + 12 + b * 4);
+        if (cumulative < previous) return false;
+        previous = cumulative;
+    }
+    return previous == count;
+}
+
+} // namespace
+
+ObjectData ObjectData::fromVector(std::vector<uint8_t> data) {
+    auto owner = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    return ObjectData{std::span<const uint8_t>(owner->data(), owner->size()), owner};
+}
+
+FileRegion::FileRegion(FileRegion&& other) noexcept
+    : fd(std::exchange(other.fd, -1)), offset(other.offset), length(other.length) {}
+
+FileRegion& FileRegion::operator=(FileRegion&& other) noexcept {
+    if (this != &other) {
+        if (fd >= 0) ::close(fd);
+        fd = std::exchange(other.fd, -1);
+        offset = other.offset;
+        length = other.length;
+    }
+    return *this;
+}
+
+FileRegion::~FileRegion() {
+    if (fd >= 0) ::close(fd);
+}
+
+// --- LooseObjectStore ---
+
+LooseObjectStore::LooseObjectStore(const std::filesystem::path& dir, bool syncWrites)
+    : dir(dir), syncWrites(syncWrites) {
+    std::filesystem::create_directories(dir);
+}
+
+bool LooseObjectStore::contains(const Digest& hash) const {
+    return std::filesystem::exists(dir / hash.hex());
+}
+
+void LooseObjectStore::put(const Digest& hash, std::span<const uint8_t> data) {
+    std::filesystem::path objectPath = dir / hash.hex();
+    if (std::filesystem::exists(objectPath)) {
+        return; // объекты адресуются содержимым
+    }
+
+    std::filesystem::path tempPath = dir / (hash.hex() + ".tmp" + std::to_string(tempCounter.fetch_add(1)));
+    {
+        std::ofstream file(tempPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            throw std::runtime_error("Failed to write object: " + hash.hex());
+        }
+    }
+
+    if (syncWrites) syncPath(tempPath, false);
+    std::filesystem::rename(tempPath, objectPath);
+    if (syncWrites) syncPath(dir, true);
+}
+
+// Чтение объекта целиком; размер берётся из файловой системы, без seek/tellg
+std::optional<ObjectData> LooseObjectStore::get(const Digest& hash) const {
+    std::filesystem::path objectPath = dir / hash.hex();
+    std::ifstream file(objectPath, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> content(std::filesystem::file_size(objectPath));
+    file.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(content.size()));
+    if (static_cast<size_t>(file.gcount()) != content.size()) {
+        throw std::runtime_error("Failed to read object: " + hash.hex());
+    }
+
+    return ObjectData::fromVector(std::move(content));
+}
+
+std::optional<uint64_t> LooseObjectStore::storedSize(const Digest& hash) const {
+    std::error_code error;
+    auto size = std::filesystem::file_size(dir / hash.hex(), error);
+    if (error) return std::nullopt;
+    return size;
+}
+
+std::optional<FileRegion> LooseObjectStore::locate(const Digest& hash) const {
+    int fd = ::open((dir / hash.hex()).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Failed to stat object: " + hash.hex());
+    }
+    return FileRegion(fd, 0, static_cast<uint64_t>(st.st_size));
+}
+
+uint64_t LooseObjectStore::remove(const std::vector<Digest>& hashes, const std::function<void(uint64_t)>&) {
+    uint64_t freed = 0;
+    for (const auto& hash : hashes) {
+        std::error_code error;
+        auto size = std::filesystem::file_size(dir / hash.hex(), error);
+        if (!error && std::filesystem::remove(dir / hash.hex(), error)) {
+            freed += size;
+        }
+    }
+
+    if (syncWrites && freed > 0) syncPath(dir, true);
+    return freed;
+}
+
+// --- PackObjectStore ---
+
+PackObjectStore::PackObjectStore(const std::filesystem::path& dir, uint64_t maxPackBytes, bool syncWrites)
+    : dir(dir), maxPackBytes(maxPackBytes), syncWrites(syncWrites) {
+    std::filesystem::create_directories(dir);
+
+    std::vector<uint32_t> ids;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("pack-", 0) == 0 && entry.path().extension() == ".pack") {
+            ids.push_back(static_cast<uint32_t>(std::stoul(name.substr(5))));
+        }
+    }
+    std::sort(ids.begin(), ids.end());
+
+    for (uint32_t id : ids) {
+        auto pack = MappedFile::open(packPath(id));
+        auto index = MappedFile::open(indexPath(id));
+        if (pack && index && validIndex(*pack, *index)) {
+            sealed.push_back({id, std::move(pack), std::move(index)});
+            continue;
+        }
+
+        // Pack без индекса — активный (или сбой во время запечатывания).
+        // Повреждённый индекс строится заново по записям pack-файла
+        if (index) {
+            index.reset();
+            std::filesystem::remove(indexPath(id));
+        }
+        openActive(id);
+        recoverActive();
+        if (id != ids.back()) {
+            writeIndex();
+        }
+    }
+
+    if (activeFd < 0) {
+        openActive(ids.empty() ? 1 : ids.back() + 1);
+    }
+}
+
+PackObjectStore::~PackObjectStore() {
+    if (activeFd >= 0) {
+        ::close(activeFd);
+    }
+}
+
+std::filesystem::path PackObjectStore::packPath(uint32_t id) const {
+    return dir / ("pack-" + std::to_string(id) + ".pack");
+}
+
+std::filesystem::path PackObjectStore::indexPath(uint32_t id) const {
+    return dir / ("pack-" + std::to_string(id) + ".idx");
+}
+
+void PackObjectStore::openActive(uint32_t id) {
+    activeId = id;
+    activeIndex.clear();
+
+    activeFd = ::open(packPath(id).c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (activeFd < 0) {
+        throw std::runtime_error("Failed to open pack file " + packPath(id).string());
+    }
+
+    struct stat st{};
+    fstat(activeFd, &st);
+    activeSize = static_cast<uint64_t>(st.st_size);
+
+    if (activeSize == 0) {
+        uint8_t header[kPackHeaderSize];
+        memcpy(header, kPackMagic, sizeof(kPackMagic));
+        putU32(header + 4, kPackVersion);
+        struct iovec iov{header, sizeof(header)};
+        writeAll(activeFd, &iov, 1);
+        activeSize = kPackHeaderSize;
+        if (syncWrites) syncPath(dir, true);
+    }
+}
+
+// Запись pack-файла: uint8 длина ключа | ключ | uint64 длина | данные
+void PackObjectStore::recoverActive() {
+    auto mapped = MappedFile::open(packPath(activeId));
+    const uint8_t* data = mapped->data();
+    size_t size = mapped->size();
+
+    if (size < kPackHeaderSize || memcmp(data, kPackMagic, sizeof(kPackMagic)) != 0) {
+        throw std::runtime_error("Invalid pack file " + packPath(activeId).string());
+    }
+
+    size_t pos = kPackHeaderSize;
+    while (pos < size) {
+        size_t keyLength = data[pos];
+        if (pos + 1 + keyLength + 8 > size) break;
+
+        uint64_t length = loadU64(data + pos + 1 + keyLength);
+        uint64_t offset = pos + 1 + keyLength + 8;
+        if (length > size - offset) break;
+
+        // Ключ — 32 байта дайджеста; иная длина — повреждённая запись
+        if (keyLength != kDigestSize) break;
+
+        activeIndex[Digest::fromBytes(data + pos + 1)] = {offset, length};
+        pos = offset + length;
+    }
+
+    // Оборванная при сбое запись в конце отбрасывается
+    if (pos < size) {
+        if (ftruncate(activeFd, static_cast<off_t>(pos)) != 0) {
+            throw std::runtime_error("Failed to truncate pack file");
+        }
+        activeSize = pos;
+    }
+}
+
+void PackObjectStore::seal() {
+    if (activeSize <= kPackHeaderSize) return;
+
+    uint32_t nextId = activeId + 1;
+    writeIndex();
+    openActive(nextId);
+}
+
+void PackObjectStore::writeIndex() {
+    writeIndexFile(activeId, activeFd, {activeIndex.begin(), activeIndex.end()});
+
+    sealed.push_back({activeId, MappedFile::open(packPath(activeId)), MappedFile::open(indexPath(activeId))});
+
+    ::close(activeFd);
+    activeFd = -1;
+    activeIndex.clear();
+}
+
+void PackObjectStore::writeIndexFile(uint32_t id, int packFd, std::vector<std::pair<Digest, Location>> entries) const {
+    std::sort(entries.begin(), entries.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::vector<uint8_t> index(kIndexHeaderSize + entries.size() * kIndexEntrySize);
+    memcpy(index.data(), kIndexMagic, sizeof(kIndexMagic));
+    putU32(index.data() + 4, kPackVersion);
+    putU32(index.data() + 8, static_cast<uint32_t>(entries.size()));
+
+    // fanout[b] — число записей с первым байтом хеша <= b
+    uint32_t counts[256] = {};
+    for (const auto& entry : entries) counts[entry.first.bytes[0]]++;
+    uint32_t cumulative = 0;
+    for (int b = 0; b < 256; b++) {
+        cumulative += counts[b];
+        putU32(index.data() + 12 + b * 4, cumulative);
+    }
+
+    uint8_t* p = index.data() + kIndexHeaderSize;
+    for (const auto& [digest, location] : entries) {
+        memcpy(p, digest.bytes.data(), kDigestSize);
+        putU64(p + kDigestSize, location.offset);
+        putU64(p + kDigestSize + 8, location.length);
+        p += kIndexEntrySize;
+    }
+
+    // Индекс не должен опередить на диске записи pack-файла, а переименование — сам индекс
+    if (fsync(packFd) != 0) {
+        throw std::runtime_error("Failed to sync pack file " + packPath(id).string());
+    }
+
+    std::filesystem::path tempPath = indexPath(id).string() + ".tmp";
+    int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to write pack index");
+    }
+    struct iovec iov{index.data(), index.size()};
+    try {
+        writeAll(fd, &iov, 1);
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    int synced = fsync(fd);
+    ::close(fd);
+    if (synced != 0) {
+        throw std::runtime_error("Failed to sync pack index");
+    }
+
+    std::filesystem::rename(tempPath, indexPath(id));
+    syncPath(dir, true);
+}
+
+std::optional<PackObjectStore::Location> PackObjectStore::SealedPack::find(const uint8_t* digest) const {
+    const uint8_t* base = index->data();
+    uint32_t first = digest[0] ? loadU32(base + 12 + (digest[0] - 1) * 4) : 0;
+    uint32_t last = loadU32(base + 12 + digest[0] * 4);
+
+    // Двоичный поиск внутри диапазона fanout
+    while (first < last) {
+        uint32_t mid = first + (last - first) / 2;
+        const uint8_t* entry = base + kIndexHeaderSize + static_cast<size_t>(mid) * kIndexEntrySize;
+        int cmp = memcmp(entry, digest, kDigestSize);
+        if (cmp == 0) {
+            return Location{loadU64(entry + kDigestSize), loadU64(entry + kDigestSize + 8)};
+        }
+        if (cmp < 0) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::pair<const PackObjectStore::SealedPack*, PackObjectStore::Location>>
+PackObjectStore::findSealed(const Digest& hash) const {
+    for (auto it = sealed.rbegin(); it != sealed.rend(); ++it) {
+        if (auto location = it->find(hash.bytes.data())) {
+            return std::make_pair(&*it, *location);
+        }
+    }
+    return std::nullopt;
+}
+
+bool PackObjectStore::contains(const Digest& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    return activeIndex.count(hash) > 0 || findSealed(hash).has_value();
+}
+
+void PackObjectStore::put(const Digest& hash, std::span<const uint8_t> data) {
+    std::unique_lock<std::shared_mutex> lock(mutex);
+    if (activeIndex.count(hash) > 0 || findSealed(hash)) {
+        return;
+    }
+
+    uint64_t recordSize = 1 + kDigestSize + 8 + data.size();
+    if (activeSize > kPackHeaderSize && activeSize + recordSize > maxPackBytes) {
+        seal();
+    }
+
+    uint8_t keyLength = kDigestSize;
+    uint8_t length[8];
+    putU64(length, data.size());
+
+    // Заголовок записи и данные уходят одним writev
+    struct iovec iov[4] = {
+        {&keyLength, 1},
+        {const_cast<uint8_t*>(hash.bytes.data()), kDigestSize},
+        {length, sizeof(length)},
+        {const_cast<uint8_t*>(data.data()), data.size()},
+    };
+    writeAll(activeFd, iov, 4);
+    if (syncWrites && fdatasync(activeFd) != 0) {
+        throw std::runtime_error("Failed to sync pack file " + packPath(activeId).string());
+    }
+
+    activeIndex[hash] = {activeSize + 1 + kDigestSize + 8, data.size()};
+    activeSize += recordSize;
+}
+
+std::optional<ObjectData> PackObjectStore::get(const Digest& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    if (auto found = findSealed(hash)) {
+        const auto& [pack, location] = *found;
+        if (location.offset > pack->pack->size() || location.length > pack->pack->size() - location.offset) {
+            throw std::runtime_error("Corrupted pack index for object: " + hash.hex());
+        }
+        // Окно в отображённый pack без копирования
+        return ObjectData{pack->pack->bytes().subspan(location.offset, location.length), pack->pack};
+    }
+
+    auto it = activeIndex.find(hash);
+    if (it == activeIndex.end()) {
+        return std::nullopt;
+    }
+
+    std::vector<uint8_t> content(it->second.length);
+    size_t done = 0;
+    while (done < content.size()) {
+        ssize_t n = ::pread(activeFd, content.data() + done, content.size() - done,
+                            static_cast<off_t>(it->second.offset + done));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            throw std::runtime_error("Failed to read object: " + hash.hex());
+        }
+        done += static_cast<size_t>(n);
+    }
+    return ObjectData::fromVector(std::move(content));
+}
+
+std::optional<uint64_t> PackObjectStore::storedSize(const Digest& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    if (auto it = activeIndex.find(hash); it != activeIndex.end()) return it->second.length;
+    if (auto found = findSealed(hash)) return found->second.length;
+    return std::nullopt;
+}
+
+std::optional<FileRegion> PackObjectStore::locate(const Digest& hash) const {
+    std::shared_lock<std::shared_mutex> lock(mutex);
+
+    uint32_t id;
+    Location location;
+    if (auto found = findSealed(hash)) {
+        id = found->first->id;
+        location = found->second;
+    } else if (auto it = activeIndex.find(hash); it != activeIndex.end()) {
+        id = activeId;
+        location = it->second;
+    } else {
+        return std::nullopt;
+    }
+
+    int fd = ::open(packPath(id).c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open pack file " + packPath(id).string());
+    }
+    return FileRegion(fd, location.offset, location.length);
+}
+
+uint64_t PackObjectStore::remove(const std::vector<Digest>& hashes, const std::function<void(uint64_t)>& progress) {
+    std::unordered_set<Digest> doomed(hashes.begin(), hashes.end());
+
+    struct Rewrite {
+        SealedPack old;
+        uint32_t id = 0;                     // номер переписанного pack-файла
+        std::optional<SealedPack> rewritten; // нет, если живых записей не осталось
+    };
+    std::vector<Rewrite> rewrites;
+
+    // 1. Активный pack запечатывается, пустой активный уступает свой номер переписанным
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        seal();
+
+        for (const auto& pack : sealed) {
+            bool affected = std::any_of(doomed.begin(), doomed.end(), [&](const Digest& hash) {
+                return pack.find(hash.bytes.data()).has_value();
+            });
+            if (affected) rewrites.push_back({pack});
+        }
+        if (rewrites.empty()) return 0;
+
+        ::close(activeFd);
+        activeFd = -1;
+        std::filesystem::remove(packPath(activeId));
+
+        uint32_t next = activeId;
+        for (auto& rewrite : rewrites) rewrite.id = next++;
+        openActive(next);
+    }
+
+    // 2. Живые записи копируются без блокировки: до замены их читают из старых файлов
+    for (auto& rewrite : rewrites) {
+        const MappedFile& pack = *rewrite.old.pack;
+        const uint8_t* index = rewrite.old.index->data();
+        uint32_t count = loadU32(index + 8);
+
+        std::vector<std::pair<Digest, Location>> entries;
+        int fd = -1;
+        uint64_t size = kPackHeaderSize;
+        try {
+            for (uint32_t i = 0; i < count; i++) {
+                const uint8_t* entry = index + kIndexHeaderSize + static_cast<size_t>(i) * kIndexEntrySize;
+                Digest hash = Digest::fromBytes(entry);
+                if (doomed.count(hash) > 0) continue;
+
+                uint64_t offset = loadU64(entry + kDigestSize);
+                uint64_t length = loadU64(entry + kDigestSize + 8);
+                if (offset > pack.size() || length > pack.size() - offset) {
+                    throw std::runtime_error("Corrupted pack index for object: " + hash.hex());
+                }
+
+                if (fd < 0) {
+                    fd = ::open(packPath(rewrite.id).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+                                0644);
+                    if (fd < 0) {
+                        throw std::runtime_error("Failed to open pack file " + packPath(rewrite.id).string());
+                    }
+                    uint8_t header[kPackHeaderSize];
+                    memcpy(header, kPackMagic, sizeof(kPackMagic));
+                    putU32(header + 4, kPackVersion);
+                    struct iovec iov{header, sizeof(header)};
+                    writeAll(fd, &iov, 1);
+                }
+
+                uint8_t keyLength = kDigestSize;
+                uint8_t lengthBytes[8];
+                putU64(lengthBytes, length);
+                struct iovec iov[4] = {
+                    {&keyLength, 1},
+                    {const_cast<uint8_t*>(entry), kDigestSize},
+                    {lengthBytes, sizeof(lengthBytes)},
+                    {const_cast<uint8_t*>(pack.data() + offset), length},
+                };
+                writeAll(fd, iov, 4);
+
+                entries.emplace_back(hash, Location{size + 1 + kDigestSize + 8, length});
+                size += 1 + kDigestSize + 8 + length;
+                if (progress) progress(length);
+            }
+
+            if (fd >= 0) {
+                writeIndexFile(rewrite.id, fd, std::move(entries));
+                ::close(fd);
+                fd = -1;
+                rewrite.rewritten = SealedPack{rewrite.id, MappedFile::open(packPath(rewrite.id)),
+                                               MappedFile::open(indexPath(rewrite.id))};
+            }
+        } catch (...) {
+            if (fd >= 0) ::close(fd);
+            throw;
+        }
+    }
+
+    // 3. Замена под блокировкой; старые файлы удаляются, отображения у читателей остаются
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (auto& rewrite : rewrites) {
+            auto it = std::find_if(sealed.begin(), sealed.end(),
+                                   [&](const SealedPack& pack) { return pack.id == rewrite.old.id; });
+            if (rewrite.rewritten) {
+                *it = *rewrite.rewritten;
+            } else {
+                sealed.erase(it);
+            }
+        }
+    }
+
+    uint64_t freed = 0;
+    for (const auto& rewrite : rewrites) {
+        freed += rewrite.old.pack->size() + rewrite.old.index->size();
+        if (rewrite.rewritten) {
+            freed -= rewrite.rewritten->pack->size() + rewrite.rewritten->index->size();
+        }
+        std::filesystem::remove(indexPath(rewrite.old.id));
+        std::filesystem::remove(packPath(rewrite.old.id));
+    }
+    syncPath(dir, true);
+    return freed;
+}
@@ -0,0 +1,179 @@
+#ifndef DELTASYNC_OBJECT_STORE_H
+#define DELTASYNC_OBJECT_STORE_H
+
+#include "digest.h"
+#include "mapped_file.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Содержимое объекта: окно в отображённый pack-файл или собственный буфер.
+// owner удерживает память, на которую указывает bytes.
+struct ObjectData {
+    std::span<const uint8_t> bytes;
+    std::shared_ptr<const void> owner;
+
+    // Объект — список кусков (ChunkManifest), а не само содержимое
+    bool manifest = false;
+
+    const uint8_t* data() const { return bytes.data(); }
+    size_t size() const { return bytes.size(); }
+
+    static ObjectData fromVector(std::vector<uint8_t> data);
+};
+
+// Участок файла хранилища с байтами объекта; дескриптор принадлежит участку.
+// Позволяет отдать объект в сокет через sendfile, не читая его в память процесса.
+struct FileRegion {
+    int fd = -1;
+    uint64_t offset = 0;
+    uint64_t length = 0;
+
+    FileRegion() = default;
+    FileRegion(int fd, uint64_t offset, uint64_t length) : fd(fd), offset(offset), length(length) {}
+    FileRegion(FileRegion&& other) noexcept;
+    FileRegion& operator=(FileRegion&& other) noexcept;
+    ~FileRegion();
+};
+
+// Хранилище неизменяемых объектов, адресуемых SHA-256
+class ObjectStore {
+public:
+    virtual ~ObjectStore() = default;
+
+    virtual bool contains(const Digest& hash) const = 0;
+
+    // Повторная запись существующего объекта ничего не делает
+    virtual void put(const Digest& hash, std::span<const uint8_t> data) = 0;
+
+    virtual std::optional<ObjectData> get(const Digest& hash) const = 0;
+
+    // Объём, занятый объектом в хранилище; std::nullopt, если объекта нет
+    virtual std::optional<uint64_t> storedSize(const Digest& hash) const = 0;
+
+    // Где лежат хранимые байты объекта (как их вернул бы get); std::nullopt, если объекта нет
+    virtual std::optional<FileRegion> locate(const Digest& hash) const = 0;
+
+    // Удаление объектов (отсутствующие пропускаются); результат — освобождённое место на диске.
+    // Полученные раньше ObjectData и FileRegion остаются читаемыми. progress получает число байт,
+    // скопированных при перезаписи хранилища. Вызывающий не пишет те же объекты параллельно.
+    virtual uint64_t remove(const std::vector<Digest>& hashes,
+                            const std::function<void(uint64_t copied)>& progress = {}) = 0;
+};
+
+// Исходная раскладка: по файлу на объект в objects/<hash>
+class LooseObjectStore : public ObjectStore {
+public:
+    // syncWrites: объект и запись каталога сбрасываются на диск до возврата из put
+    explicit LooseObjectStore(const std::filesystem::path& dir, bool syncWrites = false);
+
+    bool contains(const Digest& hash) const override;
+
+    // Запись во временный файл и атомарное переименование: читатели не видят частичных объектов
+    void put(const Digest& hash, std::span<const uint8_t> data) override;
+
+    std::optional<ObjectData> get(const Digest& hash) const override;
+
+    std::optional<uint64_t> storedSize(const Digest& hash) const override;
+
+    std::optional<FileRegion> locate(const Digest& hash) const override;
+
+    uint64_t remove(const std::vector<Digest>& hashes,
+                    const std::function<void(uint64_t copied)>& progress = {}) override;
+
+private:
+    std::filesystem::path dir;
+    bool syncWrites;
+    mutable std::atomic<uint64_t> tempCounter{0};
+};
+
+// Pack-хранилище: объекты дописываются в большие файлы objects/pack/pack-N.pack.
+// Запечатанный pack получает индекс pack-N.idx:
+//   "DSPI" | uint32 версия | uint32 число записей | fanout[256] |
+//   отсортированные записи (32 байта хеша, uint64 смещение, uint64 длина)
+// Fanout-таблица по первому байту хеша сужает двоичный поиск; pack и индекс
+// читаются через mmap. Активный pack индексируется в памяти и при старте
+// восстанавливается последовательным чтением записей; так же заново строится
+// индекс, не прошедший проверку при загрузке. Индекс пишется во временный файл,
+// сбрасывается на диск вместе с pack-файлом и атомарно переименовывается.
+class PackObjectStore : public ObjectStore {
+public:
+    // syncWrites: каждая дописанная запись сбрасывается на диск (fdatasync) до возврата из put
+    PackObjectStore(const std::filesystem::path& dir, uint64_t maxPackBytes = 1ull << 30,
+                    bool syncWrites = false);
+
+    ~PackObjectStore() override;
+
+    bool contains(const Digest& hash) const override;
+
+    void put(const Digest& hash, std::span<const uint8_t> data) override;
+
+    std::optional<ObjectData> get(const Digest& hash) const override;
+
+    std::optional<uint64_t> storedSize(const Digest& hash) const override;
+
+    // Pack-файл открывается заново: участок остаётся читаемым после запечатывания
+    std::optional<FileRegion> locate(const Digest& hash) const override;
+
+    // Pack-файлы с удаляемыми объектами переписываются без них в новые запечатанные файлы
+    // (перед этим запечатывается активный); старые удаляются после записи индексов новых
+    uint64_t remove(const std::vector<Digest>& hashes,
+                    const std::function<void(uint64_t copied)>& progress = {}) override;
+
+    // Запечатывание активного pack-файла с записью индекса
+    void seal();
+
+private:
+    struct Location {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct SealedPack {
+        uint32_t id;
+        std::shared_ptr<MappedFile> pack;
+        std::shared_ptr<MappedFile> index;
+
+        std::optional<Location> find(const uint8_t* digest) const;
+    };
+
+    std::filesystem::path dir;
+    uint64_t maxPackBytes;
+    bool syncWrites;
+
+    mutable std::shared_mutex mutex;
+    std::vector<SealedPack> sealed;  // новые в конце
+
+    uint32_t activeId = 0;
+    int activeFd = -1;
+    uint64_t activeSize = 0;
+    std::unordered_map<Digest, Location> activeIndex;
+
+    void openActive(uint32_t id);
+
+    void recoverActive();
+
+    // Индекс для активного pack-файла; после этого pack только читается
+    void writeIndex();
+
+    // Запись индекса pack-файла id с дескриптором packFd: pack, индекс и каталог сбрасываются на диск
+    void writeIndexFile(uint32_t id, int packFd, std::vector<std::pair<Digest, Location>> entries) const;
+
+    std::optional<std::pair<const SealedPack*, Location>> findSealed(const Digest& hash) const;
+
+    std::filesystem::path packPath(uint32_t id) const;
+
+    std::filesystem::path indexPath(uint32_t id) const;
+};
+
+#endif //DELTASYNC_OBJECT_STORE_H
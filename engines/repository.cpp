@@ -1,13 +1,35 @@
 #include "repository.h"
+#include "similarity_sketch.h"
+#include <cerrno>
+#include <ctime>
+#include <fnmatch.h>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <unistd.h>
 
-Repository::Repository(const std::filesystem::__cxx11::path& path) : repoPath(path) {
+Repository::Repository(const std::filesystem::__cxx11::path& path, RepositoryOptions options)
+    : repoPath(path), options(options), contentCache(options.cacheBytes, options.cacheShards),
+      deltaCache(options.deltaCacheBytes, options.cacheShards),
+      metadata(std::make_unique<MetadataIndex>(path / "meta",
+                                               MetadataIndex::Options{options.metadataCompactEvery,
+                                                                      options.syncMetadata})) {
     if (!std::filesystem::exists(path)) {
         std::filesystem::create_directories(path);
     }
 
-    std::filesystem::create_directories(path / "objects");
     std::filesystem::create_directories(path / "branches");
 
+    if (options.objectBackend == ObjectBackend::Pack) {
+        objects = std::make_unique<PackObjectStore>(path / "objects" / "pack", options.maxPackBytes,
+                                                    options.syncMetadata);
+        looseObjects = std::make_unique<LooseObjectStore>(path / "objects");
+    } else {
+        objects = std::make_unique<LooseObjectStore>(path / "objects", options.syncMetadata);
+    }
+    dictionaries = std::make_unique<CompressionDictionaries>(path / "objects" / "dict");
+    workers = std::make_unique<WorkerPool>(options.workerThreads);
+
     if (!std::filesystem::exists(path / "branches" / "master")) {
         std::ofstream branch(path / "branches" / "master");
         branch.close();
@@ -18,140 +40,1543 @@ Repository::Repository(const std::filesystem::__cxx11::path& path) : repoPath(pa
 
 // Загрузка состояния репозитория с диска
 void Repository::loadRepository() {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    MetadataIndex::BranchMap loaded;
+    metadata->open(loaded, [this](const std::string& fileName, const FileVersion& version) {
+        versionsOrCreate(fileName).push_back(version);
+    }, [this](const std::string& fileName, const FileVersion& storage) {
+        // Переупаковка меняет только хранение версии; восстановленные копии его не используют
+        auto* versions = findVersions(fileName);
+        if (!versions) return;
+        for (auto& version : *versions) {
+            if (version.hash != storage.hash) continue;
+            version.objectHash = storage.objectHash;
+            version.deltaBase = storage.deltaBase;
+            version.isDelta = storage.isDelta;
+            version.chainDepth = storage.chainDepth;
+            version.chainBytes = storage.chainBytes;
+            break;
+        }
+    });
+
+    std::unique_lock<std::shared_mutex> lock(branchesMutex);
+    branches = std::move(loaded);
 
     for (const auto& entry : std::filesystem::__cxx11::directory_iterator(repoPath / "branches")) {
         std::string branchName = entry.path().filename().string();
-        branches[branchName] = {};
+        branches[branchName];
     }
 }
 
 // Сохранение файла в репозиторий
-std::string Repository::saveFile(const std::string& fileName, const std::vector<uint8_t>& content,
+std::string Repository::saveFile(const std::string& fileName, std::span<const uint8_t> content,
                      const std::string& author, const std::string& message,
-                     const std::string& branch = "master") {
-    std::lock_guard<std::mutex> lock(repoMutex);
+                     const std::string& branch = "master",
+                     std::optional<DeltaMode> mode,
+                     std::optional<Digest> contentHash) {
+    return *saveVersion(fileName, content, author, message, branch, mode, contentHash, std::nullopt);
+}
+
+std::optional<std::string> Repository::saveFile(const std::string& fileName, std::span<const uint8_t> content,
+                                                const std::string& author, const std::string& message,
+                                                const std::string& branch, const Digest& expectedTip,
+                                                std::optional<Digest> contentHash) {
+    return saveVersion(fileName, content, author, message, branch, std::nullopt, contentHash, expectedTip);
+}
+
+std::optional<std::string> Repository::saveVersion(const std::string& fileName, std::span<const uint8_t> content,
+                                                   const std::string& author, const std::string& message,
+                                                   const std::string& branch, std::optional<DeltaMode> mode,
+                                                   std::optional<Digest> contentHash,
+                                                   const std::optional<Digest>& expectedTip) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+
+    // Хеширование не требует блокировок; большой файл хешируется на пуле,
+    // пока восстанавливается предок и считается дельта
+    Digest fileHash;
+    PoolTask<Digest> pendingHash;
+    if (contentHash) {
+        fileHash = *contentHash;
+    } else if (content.size() >= options.parallelThreshold) {
+        pendingHash = workers->submit([&content] { return DiffEngine::computeDigest(content); });
+    } else {
+        fileHash = DiffEngine::computeDigest(content);
+    }
 
-    std::string fileHash = DiffEngine::computeHash(content);
+    // Задача читает content: при исключении её нужно отменить или дождаться до выхода
+    struct PendingHashGuard {
+        PoolTask<Digest>& hash;
+        ~PendingHashGuard() {
+            hash.cancel();
+        }
+    } pendingHashGuard{pendingHash};
+
+    auto fileHashOnce = [&] {
+        if (pendingHash.valid()) fileHash = pendingHash.get();
+        return fileHash;
+    };
+
+    auto& versions = versionsOrCreate(fileName);
+    auto& stripe = fileLock(fileName);
+
+    for (uint32_t attempt = 0;; attempt++) {
+        // Последняя попытка держит блокировку файла всё время сборки: её никто не опередит
+        bool pessimistic = attempt >= options.saveRetries;
+        std::unique_lock<std::shared_mutex> fileGuard(stripe, std::defer_lock);
 
-    bool isNewFile = fileVersions.find(fileName) == fileVersions.end() ||
-                     fileVersions[fileName].empty();
+        // 1. Снимок родителя под короткой блокировкой
+        std::optional<Digest> latestVersionHash;
+        DeltaMode deltaMode = DeltaMode::Fast;
+        ParentSnapshot parent;
+        {
+            std::shared_lock<std::shared_mutex> snapshotGuard(stripe, std::defer_lock);
+            if (pessimistic) {
+                fileGuard.lock();
+            } else {
+                snapshotGuard.lock();
+            }
+
+            if (!versions.empty()) {
+                std::shared_lock<std::shared_mutex> branchGuard(branchesMutex);
+                latestVersionHash = expectedTip ? findTip(fileName, branch) : tipHash(fileName, branch);
+                deltaMode = resolveDeltaMode(fileName, branch, mode);
+            }
+            if (expectedTip && latestVersionHash != expectedTip) return std::nullopt;
+
+            parent = snapshotParent(versions, latestVersionHash, content.size());
+        }
+
+        // 2. Дельта, хеш и запись объектов без блокировок
+        FileVersion newVersion = buildVersion(fileName, parent, content, deltaMode, fileHashOnce);
+        newVersion.timestamp = std::chrono::system_clock::now();
+        newVersion.author = author;
+        newVersion.message = message;
+
+        // 3. Публикация, если ветка не сдвинулась с момента снимка. Иначе объекты
+        // остаются без ссылок (они безвредны), и версия строится заново —
+        // или не сохраняется вовсе, если вызывающему нужна именно expectedTip
+        if (!pessimistic) fileGuard.lock();
+        if (!publishVersion(fileName, versions, branch, latestVersionHash, newVersion)) {
+            if (expectedTip) return std::nullopt;
+            continue;
+        }
+
+        fileGuard.unlock();
+        maybeCompactMetadata();
+
+        return newVersion.hash.hex();
+    }
+}
+
+bool Repository::publishVersion(const std::string& fileName, std::vector<FileVersion>& versions,
+                                const std::string& branch, const std::optional<Digest>& expectedTip,
+                                const FileVersion& version) {
+    std::unique_lock<std::shared_mutex> branchGuard(branchesMutex);
+    if (findTip(fileName, branch) != expectedTip) return false;
+
+    // Ветка отстала от последней версии файла — версия уходит в новую ветку
+    std::string targetBranch = branch;
+    if (expectedTip && *expectedTip != versions.back().hash) {
+        targetBranch = forkName(branch, version.timestamp);
+
+        branches[targetBranch] = branches[branch];
+        metadata->appendFork(targetBranch, branch);
+    }
+
+    // Сначала версия, затем указатель ветки: читатель ветки всегда найдёт версию
+    versions.push_back(version);
+    metadata->appendVersion(fileName, version);
+    branches[targetBranch][fileName] = version.hash;
+    metadata->appendTip(targetBranch, fileName, version.hash);
+    return true;
+}
+
+std::optional<std::string> Repository::saveFileDelta(const std::string& fileName, std::span<const uint8_t> delta,
+                                                     const std::string& author, const std::string& message,
+                                                     const std::string& branch, const std::string& baseHash,
+                                                     const Digest& contentHash) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+    auto* versions = findVersions(fileName);
+    std::optional<Digest> base = Digest::tryFromHex(baseHash);
+    if (!versions || !base || base->empty()) {
+        return std::nullopt;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(branchesMutex);
+        if (findTip(fileName, branch) != *base) return std::nullopt;
+    }
+
+    // Размер результата объявлен отправителем: он проверяется до выделения памяти
+    auto baseContent = getFileContentShared(fileName, baseHash);
+    uint64_t contentSize = DiffEngine::deltaTargetSize(*baseContent, delta, options.maxDeltaResultBytes);
+
+    bool storeDelta = false;
+    uint32_t depth = 0;
+    uint64_t chainBytes = 0;
+    {
+        std::shared_lock<std::shared_mutex> snapshotGuard(fileLock(fileName));
+        const FileVersion* parent = findVersion(*versions, *base);
+        bool chunked = options.chunkLargeFiles && contentSize >= options.chunkingThreshold;
+        depth = parent ? parent->chainDepth + 1 : 0;
+        chainBytes = parent ? parent->chainBytes + delta.size() : 0;
+        storeDelta = parent && !parent->isDeleted && !chunked && depth <= options.maxChainDepth &&
+                     chainBytes <= options.maxChainSizeRatio * static_cast<double>(contentSize);
+    }
+
+    // Содержимое собирается, только если оно нужно для снимка или кэша;
+    // иначе для проверки хеша дельта применяется потоково
+    ContentCache::Content content;
+    Digest appliedHash;
+    if (!storeDelta || contentCache.admits(contentSize)) {
+        std::vector<uint8_t> buffer(contentSize);
+        DiffEngine::applyDelta(*baseContent, delta, buffer, true);
+        appliedHash = DiffEngine::computeDigest(buffer);
+        content = std::make_shared<const std::vector<uint8_t>>(std::move(buffer));
+    } else {
+        Sha256Hasher hasher;
+        DiffEngine::applyDeltaStreaming(*baseContent, delta, [&](const unsigned char* data, size_t size) {
+            hasher.update({data, size});
+        }, true);
+        appliedHash = hasher.finish();
+    }
+    if (appliedHash != contentHash) {
+        throw std::runtime_error("Content hash mismatch after applying delta");
+    }
+
+    if (!storeDelta) {
+        // Снимок или список кусков — обычным путём, но только поверх base
+        return saveFile(fileName, *content, author, message, branch, *base, contentHash);
+    }
 
     FileVersion newVersion;
-    newVersion.hash = fileHash;
     newVersion.timestamp = std::chrono::system_clock::now();
     newVersion.author = author;
     newVersion.message = message;
+    newVersion.parentHash = *base;
+    newVersion.contentHash = contentHash;
+    newVersion.hash = DiffEngine::computeDigest(delta);
+    newVersion.isDelta = true;
+    newVersion.chainDepth = depth;
+    newVersion.chainBytes = chainBytes;
+
+    writeObject(newVersion.hash, delta, fileName);
+
+    if (content) {
+        contentCache.put(contentHash, content);
+    }
+
+    // Ветка могла сдвинуться, пока применялась дельта: тогда версия не публикуется
+    std::unique_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+    if (!publishVersion(fileName, *versions, branch, *base, newVersion)) {
+        return std::nullopt;
+    }
 
-    std::filesystem::__cxx11::path objectPath = repoPath / "objects" / fileHash;
-    std::ofstream objectFile(objectPath, std::ios::binary);
-    objectFile.write(reinterpret_cast<const char*>(content.data()), content.size());
-    objectFile.close();
+    fileGuard.unlock();
+    maybeCompactMetadata();
 
-    if (!isNewFile) {
-        std::string latestVersionHash = getCurrentVersionHash(fileName, branch);
+    return newVersion.hash.hex();
+}
+
+// Родители снимаются под разделяемыми блокировками, версии строятся без блокировок,
+// а полосы всех файлов пакета и branchesMutex захватываются только на проверку веток
+// и публикацию. Полосы берутся по возрастанию адреса (порядок
+// массива fileLocks), поэтому пакеты и saveFile не блокируют друг друга взаимно.
+Repository::BatchResult Repository::saveBatch(const std::vector<BatchFile>& files, const std::string& author,
+                                              const std::string& message, const std::string& branch) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+    BatchResult result;
+    result.branch = branch;
+    result.files.resize(files.size());
+    if (files.empty()) {
+        result.committed = true;
+        return result;
+    }
+
+    std::set<std::string> names;
+    for (const auto& file : files) {
+        if (!names.insert(file.fileName).second) {
+            throw std::invalid_argument("Duplicate file in batch: " + file.fileName);
+        }
+    }
+
+    std::vector<std::vector<FileVersion>*> versionLists;
+    std::vector<std::shared_mutex*> stripes;
+    for (const auto& file : files) {
+        versionLists.push_back(&versionsOrCreate(file.fileName));
+        stripes.push_back(&fileLock(file.fileName));
+    }
+    std::sort(stripes.begin(), stripes.end());
+    stripes.erase(std::unique(stripes.begin(), stripes.end()), stripes.end());
+
+    std::vector<std::optional<Digest>> parents(files.size());
+    std::vector<FileVersion> prepared(files.size());
+    std::vector<uint8_t> built(files.size(), 0);  // версия собрана от parents[i]
+
+    for (uint32_t attempt = 0;; attempt++) {
+        // Последняя попытка держит полосы всё время сборки: её никто не опередит
+        bool pessimistic = attempt >= options.saveRetries;
+        std::vector<std::unique_lock<std::shared_mutex>> fileGuards;
+        auto lockStripes = [&] {
+            for (auto* stripe : stripes) {
+                fileGuards.emplace_back(*stripe);
+            }
+        };
+        if (pessimistic) lockStripes();
+
+        // 1. Родители и режимы дельт несобранных файлов — по состоянию ветки на начало сборки
+        std::vector<DeltaMode> modes(files.size());
+        std::vector<size_t> pending;
+        {
+            std::shared_lock<std::shared_mutex> branchGuard(branchesMutex);
+            for (size_t i = 0; i < files.size(); i++) {
+                if (built[i]) continue;
+                // Файла нет в ветке — в ней он начинается со снимка
+                parents[i] = findTip(files[i].fileName, branch);
+                modes[i] = resolveDeltaMode(files[i].fileName, branch, std::nullopt);
+                pending.push_back(i);
+            }
+        }
+
+        // 2. Сборка без блокировок
+        workers->parallelFor(pending.size(), [&](size_t k) {
+            size_t i = pending[k];
+            const auto& file = files[i];
+            try {
+                ParentSnapshot parent;
+                {
+                    std::shared_lock<std::shared_mutex> snapshotGuard(fileLock(file.fileName), std::defer_lock);
+                    if (!pessimistic) snapshotGuard.lock();
+                    parent = snapshotParent(*versionLists[i], parents[i], file.content.size());
+                }
+                prepared[i] = buildVersion(file.fileName, parent, file.content, modes[i], [&] {
+                    return file.contentHash ? *file.contentHash : DiffEngine::computeDigest(file.content);
+                });
+                built[i] = 1;
+            } catch (const std::exception& e) {
+                result.files[i].error = e.what();
+            }
+        });
 
-        std::string newBranch = branch;
-        if (latestVersionHash != fileVersions[fileName].back().hash) {
-            auto now = std::chrono::system_clock::now();
-            auto timestamp = std::chrono::system_clock::to_time_t(now);
-            std::stringstream branchName;
-            branchName << branch << "-" << timestamp;
-            newBranch = branchName.str();
+        bool failed = std::any_of(result.files.begin(), result.files.end(),
+                                  [](const BatchFileResult& file) { return !file.error.empty(); });
+        if (failed) {
+            // Записанные объекты ни на что не ссылаются и безвредны
+            for (auto& file : result.files) {
+                if (file.error.empty()) file.error = "Batch aborted";
+            }
+            return result;
+        }
+
+        // 3. Публикация, если ни одна ветка файла не сдвинулась; иначе сдвинувшиеся
+        // файлы собираются заново от новых родителей
+        if (!pessimistic) lockStripes();
+        std::unique_lock<std::shared_mutex> branchGuard(branchesMutex);
 
-            branches[newBranch] = branches[branch];
+        bool conflict = false;
+        bool diverged = false;
+        for (size_t i = 0; i < files.size(); i++) {
+            if (findTip(files[i].fileName, branch) != parents[i]) {
+                built[i] = 0;
+                conflict = true;
+            }
+            const auto& versions = *versionLists[i];
+            diverged = diverged || (parents[i] && !versions.empty() && *parents[i] != versions.back().hash);
         }
+        if (conflict) continue;
 
-        auto lastContent = getFileContent(fileName, latestVersionHash);
+        auto now = std::chrono::system_clock::now();
+        std::vector<std::pair<std::string, Digest>> tips;
+        for (size_t i = 0; i < files.size(); i++) {
+            prepared[i].timestamp = now;
+            prepared[i].author = author;
+            prepared[i].message = message;
+
+            versionLists[i]->push_back(prepared[i]);
+            metadata->appendVersion(files[i].fileName, prepared[i]);
+            tips.emplace_back(files[i].fileName, prepared[i].hash);
+            result.files[i].hash = prepared[i].hash.hex();
+        }
+
+        // Ветка отстала от последней версии какого-либо файла — пакет уходит в новую ветку
+        if (diverged) {
+            result.branch = forkName(branch, now);
+
+            branches[result.branch] = branches[branch];
+            metadata->appendFork(result.branch, branch);
+        }
+
+        auto& tipMap = branches[result.branch];
+        for (const auto& [fileName, hash] : tips) {
+            tipMap[fileName] = hash;
+        }
+        metadata->appendTips(result.branch, tips);
+        break;
+    }
+
+    maybeCompactMetadata();
+
+    result.committed = true;
+    return result;
+}
+
+Repository::ParentSnapshot Repository::snapshotParent(const std::vector<FileVersion>& versions,
+                                                      std::optional<Digest> parentHash, uint64_t contentSize) {
+    ParentSnapshot snapshot;
+    snapshot.hash = parentHash;
+    if (!parentHash) return snapshot;
+
+    // Новый файл или слишком длинная цепочка — сохраняем полный снимок (keyframe).
+    // Большие файлы всегда сохраняются списком кусков: общие куски с прошлой версией не дублируются.
+    const FileVersion* parent = findVersion(versions, *parentHash);
+    bool chunked = options.chunkLargeFiles && contentSize >= options.chunkingThreshold;
+    if (parent && parent->chainDepth + 1 <= options.maxChainDepth && !chunked) {
+        snapshot.plan = planReplay(versions, *parentHash);
+        snapshot.chainDepth = parent->chainDepth;
+        snapshot.chainBytes = parent->chainBytes;
+    }
+    return snapshot;
+}
+
+FileVersion Repository::buildVersion(const std::string& fileName, const ParentSnapshot& parent,
+                                     std::span<const uint8_t> content, DeltaMode mode,
+                                     const std::function<Digest()>& contentHash) {
+    FileVersion version;
+    bool storeKeyframe = true;
+    bool chunked = options.chunkLargeFiles && content.size() >= options.chunkingThreshold;
+
+    if (parent.hash) {
+        version.parentHash = *parent.hash;
+
+        if (parent.plan) {
+            auto lastContent = replay(*parent.plan);
+
+            auto delta = DiffEngine::computeDelta(*lastContent, content, mode);
+
+            // Суммарный объём дельт с последнего снимка ограничивает стоимость восстановления
+            uint64_t chainBytes = parent.chainBytes + delta.size();
+            if (chainBytes <= options.maxChainSizeRatio * static_cast<double>(content.size())) {
+                Digest deltaHash = DiffEngine::computeDigest(delta);
+                writeObject(deltaHash, delta, fileName);
+
+                version.isDelta = true;
+                version.hash = deltaHash;
+                version.chainDepth = parent.chainDepth + 1;
+                version.chainBytes = chainBytes;
+                storeKeyframe = false;
+            }
+        }
+    }
+
+    Digest fileHash = contentHash();
+    version.contentHash = fileHash;
+
+    if (storeKeyframe) {
+        if (chunked) {
+            writeChunked(fileHash, content, fileName);
+        } else {
+            writeObject(fileHash, content, fileName);
+        }
+
+        version.hash = fileHash;
+        version.isDelta = false;
+        version.chainDepth = 0;
+        version.chainBytes = 0;
+    }
+
+    // Следующее сохранение этого файла возьмёт базу из кэша
+    if (contentCache.admits(content.size())) {
+        contentCache.put(fileHash, std::make_shared<const std::vector<uint8_t>>(content.begin(), content.end()));
+    }
+
+    return version;
+}
+
+namespace {
+
+bool isPattern(const std::string& name) {
+    return name.find_first_of("*?[") != std::string::npos;
+}
 
-        auto delta = DiffEngine::computeDelta(lastContent, content);
-        std::string deltaHash = DiffEngine::computeHash(delta);
+void setPatternMode(std::vector<std::pair<std::string, DeltaMode>>& patterns, const std::string& pattern,
+                    DeltaMode mode) {
+    for (auto& [existing, existingMode] : patterns) {
+        if (existing == pattern) {
+            existingMode = mode;
+            return;
+        }
+    }
+    patterns.emplace_back(pattern, mode);
+}
 
-        std::filesystem::__cxx11::path deltaPath = repoPath / "objects" / deltaHash;
-        std::ofstream deltaFile(deltaPath, std::ios::binary);
-        deltaFile.write(reinterpret_cast<const char*>(delta.data()), delta.size());
-        deltaFile.close();
+std::optional<DeltaMode> findMode(const std::map<std::string, DeltaMode>& exact,
+                                  const std::vector<std::pair<std::string, DeltaMode>>& patterns,
+                                  const std::string& name) {
+    if (auto it = exact.find(name); it != exact.end()) return it->second;
+    for (const auto& [pattern, mode] : patterns) {
+        if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0) return mode;
+    }
+    return std::nullopt;
+}
 
-        newVersion.parentHash = latestVersionHash;
-        newVersion.isDelta = true;
-        newVersion.hash = deltaHash;
+} // namespace
 
-        branches[newBranch][fileName] = deltaHash;
+void Repository::setBranchDeltaMode(const std::string& branch, DeltaMode mode) {
+    std::unique_lock<std::shared_mutex> lock(branchesMutex);
+    if (isPattern(branch)) {
+        setPatternMode(branchDeltaPatterns, branch, mode);
     } else {
-        newVersion.isDelta = false;
-        newVersion.parentHash = "";
+        branchDeltaModes[branch] = mode;
+    }
+}
 
-        branches[branch][fileName] = fileHash;
+void Repository::setFileDeltaMode(const std::string& fileName, DeltaMode mode) {
+    std::unique_lock<std::shared_mutex> lock(branchesMutex);
+    if (isPattern(fileName)) {
+        setPatternMode(fileDeltaPatterns, fileName, mode);
+    } else {
+        fileDeltaModes[fileName] = mode;
     }
+}
+
+DeltaMode Repository::resolveDeltaMode(const std::string& fileName, const std::string& branch,
+                                       std::optional<DeltaMode> requested) const {
+    if (requested) return *requested;
 
-    fileVersions[fileName].push_back(newVersion);
+    if (auto mode = findMode(fileDeltaModes, fileDeltaPatterns, fileName)) return *mode;
+    if (auto mode = findMode(branchDeltaModes, branchDeltaPatterns, branch)) return *mode;
 
-    return newVersion.hash;
+    return DeltaMode::Fast;
 }
 
 // Получение содержимого файла по хешу
 std::vector<uint8_t> Repository::getFileContent(const std::string& fileName, const std::string& hash) {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    return *getFileContentShared(fileName, hash);
+}
 
-    FileVersion* version = nullptr;
-    for (const auto& v : fileVersions[fileName]) {
-        if (v.hash == hash) {
-            version = const_cast<FileVersion*>(&v);
-            break;
+// Восстановление с использованием кэша: план составляется под разделяемой блокировкой
+// полосы файла, чтение объектов и применение дельт идут без блокировок
+ContentCache::Content Repository::getFileContentShared(const std::string& fileName, const std::string& hash) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+    auto* versions = findVersions(fileName);
+    if (!versions) {
+        throw std::runtime_error("Version not found");
+    }
+
+    ReplayPlan plan;
+    {
+        std::shared_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+        plan = planReplay(*versions, Digest::fromHex(hash));
+    }
+
+    return replay(plan);
+}
+
+Repository::ContentSource Repository::openFileContent(const std::string& fileName, const std::string& hash) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+    auto* versions = findVersions(fileName);
+    if (!versions) {
+        throw std::runtime_error("Version not found");
+    }
+
+    ReplayPlan plan;
+    {
+        std::shared_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+        plan = planReplay(*versions, Digest::fromHex(hash));
+    }
+
+    ContentSource source;
+    if (plan.deltas.empty() && !plan.cached) {
+        if (auto region = locateRaw(plan.base.objectHash)) {
+            source.size = region->length;
+            source.region = std::move(region);
+            return source;
+        }
+
+        auto object = readObject(plan.base.objectHash);
+        if (object.manifest) {
+            auto manifest = ChunkManifest::decode(object.bytes);
+            source.size = manifest.totalSize;
+            source.chunks = std::move(manifest.chunks);
+            return source;
         }
+
+        source.content = std::make_shared<const std::vector<uint8_t>>(object.bytes.begin(), object.bytes.end());
+        contentCache.put(plan.base.contentHash, source.content);
+    } else if (!plan.deltas.empty()) {
+        // Последнее звено применяется по ходу отправки, если результат всё равно не попадёт
+        // в кэш: в памяти остаются родитель и дельта, а не ещё одна полная копия файла
+        ChainLink last = plan.deltas.back();
+        plan.deltas.pop_back();
+
+        auto stream = std::make_shared<DeltaStream>(replay(plan), readObject(last.objectHash));
+        if (!contentCache.admits(stream->reader.size())) {
+            source.size = stream->reader.size();
+            source.stream = std::move(stream);
+            return source;
+        }
+
+        std::vector<uint8_t> next(stream->reader.size());
+        DiffEngine::applyDelta(*stream->parent, stream->delta.bytes, next, true);
+        source.content = std::make_shared<const std::vector<uint8_t>>(std::move(next));
+        contentCache.put(last.contentHash, source.content);
+    } else {
+        source.content = replay(plan);
+    }
+
+    source.size = source.content->size();
+    return source;
+}
+
+// Дельты между одними и теми же версиями запрашивают многие получатели
+// (все, кто синхронизировался с прошлой версией), поэтому они кэшируются
+Repository::DeltaDownload Repository::getLatestDelta(const std::string& fileName, const std::string& branch,
+                                                     const std::string& baseHash) {
+    DeltaDownload result;
+    Digest tip;
+    DeltaMode mode;
+    {
+        std::shared_lock<std::shared_mutex> lock(branchesMutex);
+        tip = tipHash(fileName, branch);
+        mode = resolveDeltaMode(fileName, branch, std::nullopt);
+    }
+    result.versionHash = tip.hex();
+
+    auto* versions = findVersions(fileName);
+    if (!versions) {
+        throw std::runtime_error("Version not found");
+    }
+
+    std::optional<Digest> base = Digest::tryFromHex(baseHash);
+    bool baseKnown = false;
+    Digest baseContentHash;
+    {
+        std::shared_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+        const FileVersion* tipVersion = findVersion(*versions, tip);
+        if (!tipVersion) {
+            throw std::runtime_error("Version not found");
+        }
+        result.contentHash = tipVersion->contentHash;
+
+        if (base && !base->empty()) {
+            if (const FileVersion* baseVersion = findVersion(*versions, *base)) {
+                baseKnown = true;
+                baseContentHash = baseVersion->contentHash;
+            }
+        }
+    }
+
+    auto pairKey = [&] {
+        Sha256Hasher hasher;
+        hasher.update(baseContentHash.bytes);
+        hasher.update(result.contentHash.bytes);
+        return hasher.finish();
+    };
+
+    if (!baseKnown) {
+        if (result.contentHash.empty()) {
+            result.contentHash = DiffEngine::computeDigest(*getFileContentShared(fileName, result.versionHash));
+        }
+        return result;
+    }
+
+    // В записях старого формата хеша содержимого может не быть — тогда дельта считается заново
+    if (!baseContentHash.empty() && !result.contentHash.empty()) {
+        if (auto cached = deltaCache.get(pairKey())) {
+            if (!cached->empty()) result.delta = cached;
+            return result;
+        }
+    }
+
+    auto baseContent = getFileContentShared(fileName, baseHash);
+    auto tipContent = getFileContentShared(fileName, result.versionHash);
+    if (baseContentHash.empty()) baseContentHash = DiffEngine::computeDigest(*baseContent);
+    if (result.contentHash.empty()) result.contentHash = DiffEngine::computeDigest(*tipContent);
+
+    auto delta = std::make_shared<const std::vector<uint8_t>>(DiffEngine::computeDelta(*baseContent, *tipContent,
+                                                                                       mode));
+    if (delta->size() >= tipContent->size()) {
+        deltaCache.put(pairKey(), std::make_shared<const std::vector<uint8_t>>());
+        return result;
     }
 
+    deltaCache.put(pairKey(), delta);
+    result.delta = delta;
+    return result;
+}
+
+// Цепочка собирается от запрошенной версии назад до ближайшего закэшированного предка
+// или полного снимка; её длина ограничена options.maxChainDepth
+Repository::ReplayPlan Repository::planReplay(const std::vector<FileVersion>& versions, const Digest& hash) {
+    ReplayPlan plan;
+
+    const FileVersion* version = findVersion(versions, hash);
     if (!version) {
         throw std::runtime_error("Version not found");
     }
 
-    if (!version->isDelta) {
-        std::filesystem::__cxx11::path objectPath = repoPath / "objects" / hash;
-        std::ifstream file(objectPath, std::ios::binary);
+    while (true) {
+        if (!version->contentHash.empty() && (plan.cached = contentCache.get(version->contentHash))) {
+            break;
+        }
+        if (!version->isDelta) {
+            plan.base = {version->objectKey(), version->contentHash};
+            break;
+        }
 
-        file.seekg(0, std::ios::end);
-        size_t size = file.tellg();
-        file.seekg(0, std::ios::beg);
+        plan.deltas.push_back({version->objectKey(), version->contentHash});
+        version = findVersion(versions, version->baseHash());
+        if (!version || plan.deltas.size() > versions.size()) {
+            throw std::runtime_error("Broken delta chain");
+        }
+    }
 
-        std::vector<uint8_t> content(size);
-        file.read(reinterpret_cast<char*>(content.data()), size);
+    std::reverse(plan.deltas.begin(), plan.deltas.end());
+    return plan;
+}
 
-        return content;
+ContentCache::Content Repository::replay(const ReplayPlan& plan, bool admit) {
+    ContentCache::Content content = plan.cached;
+    if (!content) {
+        content = std::make_shared<const std::vector<uint8_t>>(readContent(plan.base.objectHash));
+        if (admit) contentCache.put(plan.base.contentHash, content);
     }
 
-    auto parentContent = getFileContent(fileName, version->parentHash);
+    // Дельты читаются прямо из отображённого pack-файла и применяются в буфер нужного размера.
+    // Промежуточные звенья тоже попадают в кэш.
+    for (const auto& link : plan.deltas) {
+        auto delta = readObject(link.objectHash);
+        std::vector<uint8_t> next(DiffEngine::deltaTargetSize(*content, delta.bytes));
+        DiffEngine::applyDelta(*content, delta.bytes, next, true);
 
-    std::filesystem::__cxx11::path deltaPath = repoPath / "objects" / hash;
-    std::ifstream deltaFile(deltaPath, std::ios::binary);
+        content = std::make_shared<const std::vector<uint8_t>>(std::move(next));
+        if (admit) contentCache.put(link.contentHash, content);
+    }
 
-    deltaFile.seekg(0, std::ios::end);
-    size_t deltaSize = deltaFile.tellg();
-    deltaFile.seekg(0, std::ios::beg);
+    return content;
+}
 
-    std::vector<uint8_t> delta(deltaSize);
-    deltaFile.read(reinterpret_cast<char*>(delta.data()), deltaSize);
+ContentCache::Stats Repository::cacheStats() const {
+    return contentCache.stats();
+}
 
-    return DiffEngine::applyDelta(parentContent, delta);
+std::shared_mutex& Repository::fileLock(const std::string& fileName) const {
+    return fileLocks[std::hash<std::string>{}(fileName) % kFileLockStripes];
 }
 
-std::vector<uint8_t> Repository::getLatestVersion(const std::string& fileName, const std::string& branch = "master") {
-    std::string hash = getCurrentVersionHash(fileName, branch);
-    return getFileContent(fileName, hash);
+std::vector<FileVersion>* Repository::findVersions(const std::string& fileName) {
+    {
+        std::shared_lock<std::shared_mutex> lock(fileIndexMutex);
+
+        auto it = fileVersions.find(fileName);
+        if (it != fileVersions.end()) return &it->second;
+    }
+
+    auto loaded = metadata->loadVersions(fileName);
+    if (!loaded) return nullptr;
+
+    // Параллельный поток мог загрузить историю раньше — тогда emplace её не заменит
+    std::unique_lock<std::shared_mutex> lock(fileIndexMutex);
+    return &fileVersions.emplace(fileName, std::move(*loaded)).first->second;
 }
 
-std::string Repository::getCurrentVersionHash(const std::string& fileName, const std::string& branch = "master") {
-    std::lock_guard<std::mutex> lock(repoMutex);
+std::vector<FileVersion>& Repository::versionsOrCreate(const std::string& fileName) {
+    if (auto* versions = findVersions(fileName)) {
+        return *versions;
+    }
 
-    if (branches.find(branch) == branches.end() ||
-        branches[branch].find(fileName) == branches[branch].end()) {
+    std::unique_lock<std::shared_mutex> lock(fileIndexMutex);
+    return fileVersions[fileName];
+}
+
+std::set<std::string> Repository::allFileNames() {
+    std::set<std::string> names;
+    {
+        std::shared_lock<std::shared_mutex> lock(fileIndexMutex);
+        for (const auto& [fileName, _] : fileVersions) {
+            names.insert(fileName);
+        }
+    }
+    for (auto& fileName : metadata->fileNames()) {
+        names.insert(std::move(fileName));
+    }
+    return names;
+}
+
+void Repository::maybeCompactMetadata(bool force) {
+    if (!force && !metadata->needsCompaction()) return;
+
+    std::unique_lock<std::mutex> compaction(compactionMutex, std::try_to_lock);
+    if (!compaction.owns_lock()) return;
+
+    // Разделяемые блокировки всех полос и веток останавливают писателей на время перезаписи
+    std::unique_lock<std::shared_mutex> indexGuard(fileIndexMutex);
+    std::vector<std::shared_lock<std::shared_mutex>> stripeGuards;
+    stripeGuards.reserve(kFileLockStripes);
+    for (auto& stripe : fileLocks) {
+        stripeGuards.emplace_back(stripe);
+    }
+    std::shared_lock<std::shared_mutex> branchGuard(branchesMutex);
+
+    if (force || metadata->needsCompaction()) {
+        metadata->compact(fileVersions, branches);
+    }
+}
+
+std::string Repository::forkName(const std::string& branch, std::chrono::system_clock::time_point time) const {
+    std::string name = branch + "-" + std::to_string(std::chrono::system_clock::to_time_t(time));
+    if (!branches.contains(name)) return name;
+
+    for (uint32_t n = 2;; n++) {
+        std::string numbered = name + "-" + std::to_string(n);
+        if (!branches.contains(numbered)) return numbered;
+    }
+}
+
+const FileVersion* Repository::findVersion(const std::vector<FileVersion>& versions, const Digest& hash) {
+    for (const auto& v : versions) {
+        if (v.hash == hash) return &v;
+    }
+    return nullptr;
+}
+
+Digest Repository::tipHash(const std::string& fileName, const std::string& branch) const {
+    auto tip = findTip(fileName, branch);
+    if (!tip) {
         throw std::runtime_error("File not found in branch");
     }
+    return *tip;
+}
+
+std::optional<Digest> Repository::findTip(const std::string& fileName, const std::string& branch) const {
+    auto branchIt = branches.find(branch);
+    if (branchIt == branches.end()) return std::nullopt;
+
+    auto fileIt = branchIt->second.find(fileName);
+    if (fileIt == branchIt->second.end()) return std::nullopt;
+
+    return fileIt->second;
+}
+
+std::vector<uint8_t> Repository::encodeObject(std::span<const uint8_t> data, const std::string& fileName) const {
+    auto dictionary = dictionaries->forFile(fileName);
+    if (data.size() >= options.parallelThreshold) {
+        return ObjectCodec::encodeParallel(data, options.compression, options.compressionLevel, dictionary.get(),
+                                           *workers, options.parallelChunkBytes);
+    }
+    return ObjectCodec::encode(data, options.compression, options.compressionLevel, dictionary.get());
+}
+
+void Repository::writeObject(const Digest& hash, std::span<const uint8_t> data,
+                             const std::string& fileName) const {
+    reviveObject(hash);
+
+    // Проверка до сжатия: повторная запись существующего объекта ничего не стоит
+    if (objects->contains(hash) || (looseObjects && looseObjects->contains(hash))) {
+        return; // объекты адресуются содержимым
+    }
+
+    objects->put(hash, encodeObject(data, fileName));
+}
+
+void Repository::writeChunked(const Digest& hash, std::span<const uint8_t> content,
+                              const std::string& fileName) const {
+    reviveObject(hash);
+    if (objects->contains(hash) || (looseObjects && looseObjects->contains(hash))) {
+        return;
+    }
+
+    auto lengths = FastCdc::split(content, options.chunking);
+
+    ChunkManifest manifest;
+    manifest.totalSize = content.size();
+    manifest.chunks.resize(lengths.size());
+
+    std::vector<size_t> offsets(lengths.size());
+    for (size_t i = 1; i < lengths.size(); i++) {
+        offsets[i] = offsets[i - 1] + lengths[i - 1];
+    }
+
+    // Куски хешируются, сжимаются и пишутся параллельно; уже известные пропускает writeObject
+    workers->parallelFor(lengths.size(), [&](size_t i) {
+        auto piece = content.subspan(offsets[i], lengths[i]);
+        manifest.chunks[i] = {chunkId(piece), lengths[i]};
+        writeObject(manifest.chunks[i].hash, piece, fileName);
+    });
+
+    objects->put(hash, ObjectCodec::encodeManifest(manifest));
+}
+
+Digest Repository::chunkId(std::span<const uint8_t> data) const {
+    if (options.chunkIdentity == ChunkIdentity::Fast) {
+        return FastHash::chunkId(data);
+    }
+    return DiffEngine::computeDigest(data);
+}
+
+std::vector<uint8_t> Repository::readContent(const Digest& hash) const {
+    auto object = readObject(hash);
+    if (!object.manifest) {
+        return {object.bytes.begin(), object.bytes.end()};
+    }
+
+    auto manifest = ChunkManifest::decode(object.bytes);
+    std::vector<uint8_t> content(manifest.totalSize);
+
+    std::vector<size_t> offsets(manifest.chunks.size());
+    for (size_t i = 1; i < offsets.size(); i++) {
+        offsets[i] = offsets[i - 1] + manifest.chunks[i - 1].length;
+    }
+
+    workers->parallelFor(manifest.chunks.size(), [&](size_t i) {
+        const auto& chunk = manifest.chunks[i];
+        auto data = readObject(chunk.hash);
+        if (data.size() != chunk.length) {
+            throw std::runtime_error("Chunk size mismatch: " + chunk.hash.hex());
+        }
+        memcpy(content.data() + offsets[i], data.data(), data.size());
+    });
+
+    return content;
+}
+
+std::optional<ChunkManifest> Repository::getChunkManifest(const std::string& fileName, const std::string& hash) {
+    ObjectReaders::Guard objectsInUse(objectReaders);
+    auto* versions = findVersions(fileName);
+    if (!versions) {
+        throw std::runtime_error("Version not found");
+    }
+
+    Digest objectHash;
+    {
+        std::shared_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+        const FileVersion* version = findVersion(*versions, Digest::fromHex(hash));
+        if (!version) {
+            throw std::runtime_error("Version not found");
+        }
+        if (version->isDelta) {
+            return std::nullopt;
+        }
+        objectHash = version->objectKey();
+    }
+
+    auto object = readObject(objectHash);
+    if (!object.manifest) {
+        return std::nullopt;
+    }
+    return ChunkManifest::decode(object.bytes);
+}
+
+std::vector<Digest> Repository::findMissingChunks(const std::vector<Digest>& chunkHashes) const {
+    std::vector<Digest> missing;
+    for (const auto& chunkHash : chunkHashes) {
+        if (!objects->contains(chunkHash) && !(looseObjects && looseObjects->contains(chunkHash))) {
+            missing.push_back(chunkHash);
+        }
+    }
+    return missing;
+}
+
+std::vector<uint8_t> Repository::readChunk(const Digest& chunkHash) const {
+    auto chunk = readObject(chunkHash);
+    return {chunk.bytes.begin(), chunk.bytes.end()};
+}
+
+namespace {
+
+// Начало хранимого объекта, не больше kMaxHeaderSize байт; результат — прочитанная длина
+size_t readPrefix(const FileRegion& region, uint8_t (&prefix)[ObjectCodec::kMaxHeaderSize], const Digest& hash) {
+    size_t wanted = static_cast<size_t>(std::min<uint64_t>(sizeof(prefix), region.length));
+    ssize_t n;
+    do {
+        n = ::pread(region.fd, prefix, wanted, static_cast<off_t>(region.offset));
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(wanted)) {
+        throw std::runtime_error("Failed to read object: " + hash.hex());
+    }
+    return wanted;
+}
+
+} // namespace
+
+std::optional<FileRegion> Repository::locateRaw(const Digest& hash) const {
+    auto region = objects->locate(hash);
+    if (!region && looseObjects) {
+        region = looseObjects->locate(hash);
+    }
+    if (!region) {
+        return std::nullopt;
+    }
+
+    // Заголовок кодека читается из файла, само содержимое — нет
+    uint8_t prefix[ObjectCodec::kMaxHeaderSize];
+    size_t wanted = readPrefix(*region, prefix, hash);
+
+    auto payload = ObjectCodec::rawPayloadOffset({prefix, wanted}, region->length);
+    if (!payload) {
+        return std::nullopt;
+    }
+    region->offset += *payload;
+    region->length -= *payload;
+    return region;
+}
+
+std::optional<ChunkManifest> Repository::readManifest(const Digest& hash) const {
+    auto region = objects->locate(hash);
+    if (!region && looseObjects) {
+        region = looseObjects->locate(hash);
+    }
+    if (!region) {
+        return std::nullopt;
+    }
+
+    uint8_t prefix[ObjectCodec::kMaxHeaderSize];
+    size_t wanted = readPrefix(*region, prefix, hash);
+    if (!ObjectCodec::isManifest({prefix, wanted})) {
+        return std::nullopt;
+    }
+    return ChunkManifest::decode(readObject(hash).bytes);
+}
+
+ObjectData Repository::readObject(const Digest& hash) const {
+    auto lookup = [this](uint32_t id) { return dictionaries->find(id); };
+
+    if (auto object = objects->get(hash)) {
+        return ObjectCodec::decode(std::move(*object), lookup, workers.get());
+    }
+    if (looseObjects) {
+        if (auto object = looseObjects->get(hash)) {
+            return ObjectCodec::decode(std::move(*object), lookup, workers.get());
+        }
+    }
+    throw std::runtime_error("Object not found: " + hash.hex());
+}
+
+uint32_t Repository::trainCompressionDictionary(const std::string& extension, size_t maxSamples) {
+    // Последние версии файлов во всех ветках
+    std::vector<std::pair<std::string, Digest>> tips;
+    {
+        std::shared_lock<std::shared_mutex> lock(branchesMutex);
+        for (const auto& [branch, files] : branches) {
+            for (const auto& [fileName, hash] : files) {
+                if (CompressionDictionaries::extensionOf(fileName) == extension && tips.size() < maxSamples) {
+                    tips.emplace_back(fileName, hash);
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<uint8_t>> samples;
+    for (const auto& [fileName, hash] : tips) {
+        auto content = getFileContentShared(fileName, hash.hex());
+        samples.push_back(*content);
+    }
+    if (samples.empty()) {
+        throw std::runtime_error("No files to train a dictionary for " + extension);
+    }
+
+    auto dictionary = ObjectCodec::trainDictionary(samples, options.compression);
+    uint32_t id = dictionary.id;
+    dictionaries->install(extension, std::move(dictionary));
+    return id;
+}
+
+Repository::ObjectReaders::Guard::Guard(ObjectReaders& readers) : readers(readers) {
+    // Эпоха перечитывается: если drain() сменил её между чтением и отметкой, отметка переносится
+    while (true) {
+        epoch = readers.epoch.load();
+        readers.active[epoch & 1].fetch_add(1);
+        if (readers.epoch.load() == epoch) return;
+        readers.active[epoch & 1].fetch_sub(1);
+    }
+}
+
+Repository::ObjectReaders::Guard::~Guard() {
+    readers.active[epoch & 1].fetch_sub(1);
+}
+
+// Новые операции отмечаются следующей эпохой; операции прошлой эпохи завершились
+// при предыдущем вызове, поэтому ждать нужно только текущую
+void Repository::ObjectReaders::drain() {
+    uint64_t previous = epoch.fetch_add(1);
+    while (active[previous & 1].load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Repository::reviveObject(const Digest& hash) const {
+    if (!reclaiming.load()) return;
+
+    std::unique_lock<std::mutex> lock(reclaimMutex);
+    condemned.erase(hash);
+    reclaimDone.wait(lock, [&] { return !deleting.contains(hash); });
+}
+
+namespace {
+
+double threadCpuSeconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+} // namespace
+
+// Бюджет переупаковки: после каждой порции работы поток спит, пока прочитанные байты
+// и затраченное процессорное время с начала прохода не уложатся в лимиты. Время считается
+// по потоку переупаковки и по потокам пула, которым он отдал работу (сжатие, сборка кусков)
+class Repository::RepackThrottle {
+public:
+    RepackThrottle(const RepackOptions& options, const std::atomic<bool>* cancel)
+        : options(options), cancel(cancel), cpuStart(threadCpuSeconds()) {}
+
+    bool cancelled() const { return cancel && cancel->load(); }
+
+    void charge(uint64_t processedBytes) {
+        bytes += processedBytes;
+
+        double due = 0;  // секунд от начала, раньше которых работа не должна закончиться
+        if (options.ioBytesPerSecond) {
+            due = std::max(due, static_cast<double>(bytes) / static_cast<double>(options.ioBytesPerSecond));
+        }
+        if (options.cpuShare > 0 && options.cpuShare < 1) {
+            double cpu = threadCpuSeconds() - cpuStart + poolCpu.seconds();
+            due = std::max(due, cpu / options.cpuShare);
+        }
+
+        // Сон по частям, чтобы отмена не ждала
+        auto until = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double>(due));
+        while (!cancelled() && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+                until - std::chrono::steady_clock::now(), std::chrono::milliseconds(100)));
+        }
+    }
 
-    return branches[branch][fileName];
+private:
+    const RepackOptions& options;
+    const std::atomic<bool>* cancel;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double cpuStart;
+    uint64_t bytes = 0;
+    CpuAccount poolCpu;
+    CpuAccount::Scope poolScope{poolCpu};
+};
+
+RepackStats Repository::repack(const RepackOptions& repackOptions, const std::atomic<bool>* cancel) {
+    std::lock_guard<std::mutex> serial(repackMutex);
+    RepackThrottle throttle(repackOptions, cancel);
+    RepackStats stats;
+    std::vector<Digest> replaced;
+
+    std::set<std::string> names = allFileNames();
+
+    for (const auto& extension : repackOptions.dictionaryExtensions) {
+        try {
+            trainCompressionDictionary(extension);
+            stats.dictionariesTrained++;
+        } catch (const std::exception& e) {
+            std::cerr << "Dictionary for '" << extension << "' not trained: " << e.what() << std::endl;
+        }
+    }
+
+    for (const auto& fileName : names) {
+        if (throttle.cancelled()) break;
+
+        // Повреждённая история одного файла не останавливает переупаковку остальных
+        try {
+            repackFile(fileName, repackOptions, throttle, stats, replaced);
+        } catch (const std::exception& e) {
+            std::cerr << "Repack of '" << fileName << "' failed: " << e.what() << std::endl;
+        }
+    }
+
+    // Снимок метаданных перестраивается с новым хранением, журнал обнуляется
+    if (stats.filesRepacked > 0) {
+        maybeCompactMetadata(true);
+    }
+
+    reclaimObjects(replaced, throttle, stats);
+    return stats;
+}
+
+// Версии обрабатываются от больших к меньшим, база выбирается только среди уже обработанных:
+// цепочки остаются ациклическими, а снимками становятся самые большие версии.
+// Содержимое версий не меняется, поэтому дельты, которые ссылаются на переписанную
+// версию как на базу, остаются верными.
+void Repository::repackFile(const std::string& fileName, const RepackOptions& repackOptions,
+                            RepackThrottle& throttle, RepackStats& stats, std::vector<Digest>& replaced) {
+    auto* liveVersions = findVersions(fileName);
+    if (!liveVersions) return;
+
+    // Копия истории: сохранения только дописывают версии, а хранение меняет лишь переупаковка
+    std::vector<FileVersion> versions;
+    {
+        std::shared_lock<std::shared_mutex> guard(fileLock(fileName));
+        versions = *liveVersions;
+    }
+    stats.filesScanned++;
+
+    // Дельту без хеша содержимого (старый формат записей) нельзя переписать снимком
+    for (const auto& version : versions) {
+        if (version.isDelta && version.contentHash.empty()) return;
+    }
+
+    struct Candidate {
+        size_t index = 0;  // в versions
+        uint64_t size = 0;
+        SimilaritySketch sketch;
+
+        // Новое хранение
+        bool decided = false;
+        bool isDelta = false;
+        Digest objectKey;
+        Digest base;
+        uint64_t deltaSize = 0;
+        uint32_t chainDepth = 0;
+        uint64_t chainBytes = 0;
+        bool changed = false;
+        std::vector<uint8_t> object;  // несжатые данные нового объекта
+    };
+
+    auto reconstruct = [&](const FileVersion& version) -> ContentCache::Content {
+        if (!version.isDelta) {
+            auto object = readObject(version.objectKey());
+            if (object.manifest) return nullptr;
+            return std::make_shared<const std::vector<uint8_t>>(object.bytes.begin(), object.bytes.end());
+        }
+        return replay(planReplay(versions, version.hash), false);
+    };
+
+    // 1. Размеры и отпечатки версий; удалённые, списки кусков и повторы хешей не переписываются
+    std::vector<Candidate> candidates;
+    std::unordered_map<Digest, size_t> candidateOf;  // хеш версии -> кандидат
+    std::unordered_set<Digest> seen;
+    for (size_t i = 0; i < versions.size(); i++) {
+        const auto& version = versions[i];
+        if (throttle.cancelled()) return;
+        if (!seen.insert(version.hash).second || version.isDeleted || version.contentHash.empty()) {
+            continue;
+        }
+
+        auto content = reconstruct(version);
+        if (!content) continue;
+        throttle.charge(content->size());
+        if (options.chunkLargeFiles && content->size() >= options.chunkingThreshold) continue;
+
+        Candidate candidate;
+        candidate.index = i;
+        candidate.size = content->size();
+        candidate.sketch = SimilaritySketch::of(*content);
+        candidateOf[version.hash] = candidates.size();
+        candidates.push_back(std::move(candidate));
+    }
+    if (candidates.size() < 2) return;
+
+    std::vector<size_t> order(candidates.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (candidates[a].size != candidates[b].size) return candidates[a].size > candidates[b].size;
+        return candidates[a].index > candidates[b].index;  // при равенстве новые раньше
+    });
+
+    // 2. Выбор базы из окна последних обработанных версий
+    struct PoolEntry {
+        size_t candidate;
+        ContentCache::Content content;
+    };
+    std::deque<PoolEntry> pool;
+    uint64_t poolBytes = 0;
+
+    for (size_t current : order) {
+        if (throttle.cancelled()) return;
+        auto& candidate = candidates[current];
+        const auto& version = versions[candidate.index];
+
+        auto content = reconstruct(version);
+        throttle.charge(content->size());
+
+        // Без подходящей базы — полный снимок
+        candidate.decided = true;
+        candidate.isDelta = false;
+        candidate.objectKey = version.contentHash;
+        uint64_t bestSize = content->size();
+        std::optional<std::vector<uint8_t>> bestDelta;
+
+        auto fits = [&](const Candidate& base, uint64_t deltaSize) {
+            return base.chainDepth + 1 <= options.maxChainDepth &&
+                   base.chainBytes + deltaSize <= options.maxChainSizeRatio * static_cast<double>(candidate.size);
+        };
+
+        // Прежняя дельта сохраняется, если её база уже обработана и ничего лучше не нашлось
+        if (version.isDelta) {
+            auto baseIt = candidateOf.find(version.baseHash());
+            const FileVersion* oldBase = findVersion(versions, version.baseHash());
+            if (baseIt != candidateOf.end() && candidates[baseIt->second].decided && oldBase) {
+                const auto& base = candidates[baseIt->second];
+                uint64_t deltaSize = version.chainBytes - oldBase->chainBytes;
+                if (deltaSize < bestSize && fits(base, deltaSize)) {
+                    bestSize = deltaSize;
+                    candidate.isDelta = true;
+                    candidate.objectKey = version.objectKey();
+                    candidate.base = version.baseHash();
+                    candidate.deltaSize = deltaSize;
+                    candidate.chainDepth = base.chainDepth + 1;
+                    candidate.chainBytes = base.chainBytes + deltaSize;
+                }
+            }
+        }
+
+        // Самые похожие по отпечатку, при равном сходстве — ближайшие по размеру
+        std::vector<std::pair<double, size_t>> ranked;
+        for (size_t p = 0; p < pool.size(); p++) {
+            ranked.emplace_back(candidate.sketch.similarity(candidates[pool[p].candidate].sketch), p);
+        }
+        std::sort(ranked.begin(), ranked.end(), [&](const auto& a, const auto& b) {
+            if (a.first != b.first) return a.first > b.first;
+            auto distance = [&](size_t p) {
+                uint64_t size = candidates[pool[p].candidate].size;
+                return size > candidate.size ? size - candidate.size : candidate.size - size;
+            };
+            return distance(a.second) < distance(b.second);
+        });
+        if (ranked.size() > repackOptions.window) ranked.resize(repackOptions.window);
+
+        for (const auto& [similarity, p] : ranked) {
+            const auto& base = candidates[pool[p].candidate];
+            if (!fits(base, 0)) continue;
+
+            auto delta = DiffEngine::computeDelta(*pool[p].content, *content, repackOptions.mode);
+            throttle.charge(0);
+            if (delta.size() >= bestSize || !fits(base, delta.size())) continue;
+
+            bestSize = delta.size();
+            candidate.isDelta = true;
+            candidate.objectKey = DiffEngine::computeDigest(delta);
+            candidate.base = versions[base.index].hash;
+            candidate.deltaSize = delta.size();
+            candidate.chainDepth = base.chainDepth + 1;
+            candidate.chainBytes = base.chainBytes + delta.size();
+            bestDelta = std::move(delta);
+        }
+
+        if (!candidate.isDelta) {
+            candidate.chainDepth = 0;
+            candidate.chainBytes = 0;
+        }
+
+        candidate.changed = candidate.isDelta != version.isDelta || candidate.objectKey != version.objectKey() ||
+                            (candidate.isDelta && candidate.base != version.baseHash());
+        if (candidate.changed) {
+            if (bestDelta) {
+                candidate.object = std::move(*bestDelta);
+            } else if (!candidate.isDelta) {
+                candidate.object.assign(content->begin(), content->end());
+            }
+        }
+
+        pool.push_front({current, content});
+        poolBytes += content->size();
+        while (pool.size() > repackOptions.candidates ||
+               (pool.size() > 1 && poolBytes > repackOptions.windowMemory)) {
+            poolBytes -= pool.back().content->size();
+            pool.pop_back();
+        }
+    }
+
+    // 3. Выгода: занятое прежними объектами против новых; объект, который уже есть
+    // в хранилище, ничего не добавляет
+    std::vector<std::pair<size_t, std::vector<uint8_t>>> encoded;  // кандидат -> сжатый объект
+    uint64_t before = 0;
+    uint64_t after = 0;
+    for (size_t c = 0; c < candidates.size(); c++) {
+        auto& candidate = candidates[c];
+        const auto& version = versions[candidate.index];
+        if (!candidate.changed) continue;
+
+        auto oldSize = objects->storedSize(version.objectKey());
+        if (!oldSize && looseObjects) oldSize = looseObjects->storedSize(version.objectKey());
+        before += oldSize.value_or(0);
+
+        bool exists = objects->contains(candidate.objectKey) ||
+                      (looseObjects && looseObjects->contains(candidate.objectKey));
+        std::vector<uint8_t> object;
+        if (!exists) {
+            object = encodeObject(candidate.object, fileName);
+            after += object.size();
+        }
+        candidate.object.clear();
+        encoded.emplace_back(c, std::move(object));
+    }
+
+    if (encoded.empty() || static_cast<double>(after) >
+                               (1.0 - repackOptions.minSavings) * static_cast<double>(before)) {
+        return;
+    }
+
+    // 4. Объекты пишутся до публикации: читатель всегда найдёт объект версии
+    for (auto& [c, object] : encoded) {
+        if (object.empty()) continue;  // объект уже есть
+        objects->put(candidates[c].objectKey, object);
+        throttle.charge(object.size());
+        object = {};
+    }
+
+    // 5. Публикация под короткой блокировкой. Версии, сохранённые после копии истории,
+    // сохраняют свои дельты, но их цепочки пересчитываются от новых баз.
+    std::unique_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+    auto& live = *liveVersions;
+
+    // Первые вхождения хешей (на них ссылаются цепочки) и размеры собственных дельт
+    std::unordered_map<Digest, size_t> first;
+    for (size_t i = 0; i < live.size(); i++) {
+        first.emplace(live[i].hash, i);
+    }
+    auto baseOf = [&](const FileVersion& version) -> std::optional<size_t> {
+        auto it = first.find(version.baseHash());
+        if (it == first.end()) return std::nullopt;
+        return it->second;
+    };
+
+    std::vector<uint64_t> ownDelta(live.size());
+    for (size_t i = 0; i < live.size(); i++) {
+        if (!live[i].isDelta) continue;
+        auto base = baseOf(live[i]);
+        ownDelta[i] = live[i].chainBytes - (base ? live[*base].chainBytes : 0);
+    }
+
+    std::vector<size_t> touched;
+    for (const auto& [c, object] : encoded) {
+        const auto& candidate = candidates[c];
+        auto& version = live[candidate.index];
+
+        if (version.objectKey() != candidate.objectKey) {
+            replaced.push_back(version.objectKey());
+        }
+        version.isDelta = candidate.isDelta;
+        version.objectHash = candidate.objectKey == version.hash ? Digest{} : candidate.objectKey;
+        version.deltaBase = candidate.isDelta && candidate.base != version.parentHash ? candidate.base : Digest{};
+        ownDelta[candidate.index] = candidate.isDelta ? candidate.deltaSize : 0;
+        touched.push_back(candidate.index);
+    }
+
+    std::vector<std::optional<std::pair<uint32_t, uint64_t>>> chains(live.size());
+    std::function<std::pair<uint32_t, uint64_t>(size_t)> chainOf = [&](size_t i) {
+        if (!live[i].isDelta) return std::pair<uint32_t, uint64_t>{0, 0};
+        if (chains[i]) return *chains[i];
+
+        auto base = baseOf(live[i]);
+        auto chain = base ? chainOf(*base) : std::pair<uint32_t, uint64_t>{0, 0};
+        chains[i] = {chain.first + 1, chain.second + ownDelta[i]};
+        return *chains[i];
+    };
+
+    std::vector<FileVersion> changed;
+    std::sort(touched.begin(), touched.end());
+    for (size_t i = 0; i < live.size(); i++) {
+        auto& version = live[i];
+        if (first[version.hash] != i) continue;
+
+        auto [depth, bytes] = chainOf(i);
+        bool rewritten = std::binary_search(touched.begin(), touched.end(), i);
+        if (rewritten || depth != version.chainDepth || bytes != version.chainBytes) {
+            version.chainDepth = depth;
+            version.chainBytes = bytes;
+            changed.push_back(version);
+        }
+    }
+    metadata->appendStorage(fileName, changed);
+    fileGuard.unlock();
+
+    stats.filesRepacked++;
+    stats.versionsRewritten += encoded.size();
+    stats.replacedBytes += before;
+    stats.writtenBytes += after;
+}
+
+void Repository::reclaimObjects(const std::vector<Digest>& replaced, RepackThrottle& throttle,
+                                RepackStats& stats) {
+    if (replaced.empty()) return;
+
+    // 1. Новое хранение версий на диске раньше, чем пропадут прежние объекты
+    metadata->sync();
+
+    // 2. С этого момента запись заменённого объекта снимает его с удаления. Операции,
+    // которые могли взять его ключ раньше (план чтения, сохранение с уже найденным объектом),
+    // дожидаемся: их версии к концу ожидания опубликованы и видны ниже
+    {
+        std::lock_guard<std::mutex> lock(reclaimMutex);
+        condemned.insert(replaced.begin(), replaced.end());
+        reclaiming = true;
+    }
+
+    struct ReclaimGuard {
+        const Repository& repo;
+        ~ReclaimGuard() {
+            std::lock_guard<std::mutex> lock(repo.reclaimMutex);
+            repo.condemned.clear();
+            repo.deleting.clear();
+            repo.reclaiming = false;
+            repo.reclaimDone.notify_all();
+        }
+    } reclaimGuard{*this};
+
+    objectReaders.drain();
+
+    // 3. Ссылки: хранение любой версии любого файла (в том числе повторов хеша)
+    // и куски списков; содержимое снимков не читается, только заголовки
+    std::unordered_set<Digest> unreferenced(replaced.begin(), replaced.end());
+    for (const auto& fileName : allFileNames()) {
+        if (unreferenced.empty()) break;
+        auto* versions = findVersions(fileName);
+        if (!versions) continue;
+
+        std::unordered_set<Digest> snapshots;
+        {
+            std::shared_lock<std::shared_mutex> guard(fileLock(fileName));
+            for (const auto& version : *versions) {
+                unreferenced.erase(version.objectKey());
+                if (!version.isDelta && !version.isDeleted) snapshots.insert(version.objectKey());
+            }
+        }
+
+        for (const auto& key : snapshots) {
+            if (unreferenced.empty()) break;
+            if (auto manifest = readManifest(key)) {
+                for (const auto& chunk : manifest->chunks) unreferenced.erase(chunk.hash);
+            }
+        }
+    }
+
+    // 4. Объекты, записанные заново после шага 2, уже сняты с удаления
+    std::vector<Digest> doomed;
+    {
+        std::lock_guard<std::mutex> lock(reclaimMutex);
+        for (const auto& hash : condemned) {
+            if (unreferenced.contains(hash)) doomed.push_back(hash);
+        }
+        deleting.insert(doomed.begin(), doomed.end());
+        condemned.clear();
+    }
+    if (doomed.empty()) return;
+
+    auto progress = [&](uint64_t copied) { throttle.charge(copied); };
+    stats.bytesFreed += objects->remove(doomed, progress);
+    if (looseObjects) stats.bytesFreed += looseObjects->remove(doomed);
+    stats.objectsRemoved += doomed.size();
+}
+
+std::vector<uint8_t> Repository::getLatestVersion(const std::string& fileName, const std::string& branch = "master") {
+    std::string hash = getCurrentVersionHash(fileName, branch);
+    return getFileContent(fileName, hash);
+}
+
+std::string Repository::getCurrentVersionHash(const std::string& fileName, const std::string& branch = "master") {
+    std::shared_lock<std::shared_mutex> lock(branchesMutex);
+    return tipHash(fileName, branch).hex();
 }
 
 std::vector<std::string> Repository::getBranches() {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    std::shared_lock<std::shared_mutex> lock(branchesMutex);
 
     std::vector<std::string> result;
     for (const auto& [branch, _] : branches) {
@@ -162,17 +1587,19 @@ std::vector<std::string> Repository::getBranches() {
 }
 
 std::vector<FileVersion> Repository::getFileHistory(const std::string& fileName) {
-    std::lock_guard<std::mutex> lock(repoMutex);
-
-    if (fileVersions.find(fileName) == fileVersions.end()) {
+    auto* versions = findVersions(fileName);
+    if (!versions) {
         return {};
     }
 
-    return fileVersions[fileName];
+    std::shared_lock<std::shared_mutex> lock(fileLock(fileName));
+    return *versions;
 }
 
 void Repository::deleteFile(const std::string& fileName, const std::string& branch) {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    auto& versions = versionsOrCreate(fileName);
+    std::unique_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+    std::unique_lock<std::shared_mutex> branchGuard(branchesMutex);
 
     // Проверяем, существует ли файл в указанной ветке
     if (branches.find(branch) == branches.end() || branches[branch].find(fileName) == branches[branch].end()) {
@@ -181,24 +1608,28 @@ void Repository::deleteFile(const std::string& fileName, const std::string& bran
 
     // Создаем новую версию файла с отметкой "удален"
     FileVersion deletedVersion;
-    deletedVersion.hash = computeHash({}); // Хеш пустого содержимого
-    deletedVersion.parentHash = getCurrentVersionHash(fileName, branch);
+    deletedVersion.hash = DiffEngine::computeDigest({}); // Хеш пустого содержимого
+    deletedVersion.contentHash = deletedVersion.hash;
+    deletedVersion.parentHash = tipHash(fileName, branch);
     deletedVersion.timestamp = std::chrono::system_clock::now();
     deletedVersion.author = "System";
     deletedVersion.message = "File marked as deleted.";
     deletedVersion.isDelta = false;
+    deletedVersion.isDeleted = true;
 
     // Добавляем версию в историю файла
-    fileVersions[fileName].push_back(deletedVersion);
+    versions.push_back(deletedVersion);
+    metadata->appendVersion(fileName, deletedVersion);
 
     // Обновляем ветку, указывая на новую версию
     branches[branch][fileName] = deletedVersion.hash;
+    metadata->appendTip(branch, fileName, deletedVersion.hash);
 
     std::cout << "File '" << fileName << "' marked as deleted in branch '" << branch << "'." << std::endl;
 }
 
 void Repository::deleteBranch(const std::string& branchName) {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    std::unique_lock<std::shared_mutex> lock(branchesMutex);
 
     // Проверяем, существует ли ветка
     if (branches.find(branchName) == branches.end()) {
@@ -207,12 +1638,15 @@ void Repository::deleteBranch(const std::string& branchName) {
 
     // Помечаем ветку как удаленную
     branches.erase(branchName);
+    metadata->appendDeleteBranch(branchName);
 
     std::cout << "Branch '" << branchName << "' has been deleted." << std::endl;
 }
 
 void Repository::restoreFile(const std::string& fileName, const std::string& branch) {
-    std::lock_guard<std::mutex> lock(repoMutex);
+    auto& versions = versionsOrCreate(fileName);
+    std::unique_lock<std::shared_mutex> fileGuard(fileLock(fileName));
+    std::unique_lock<std::shared_mutex> branchGuard(branchesMutex);
 
     // Проверяем, существует ли файл в указанной ветке
     if (branches.find(branch) == branches.end() || branches[branch].find(fileName) == branches[branch].end()) {
@@ -220,12 +1654,11 @@ void Repository::restoreFile(const std::string& fileName, const std::string& bra
     }
 
     // Находим последнюю версию файла
-    const auto& versions = fileVersions[fileName];
     if (versions.empty()) {
         throw std::runtime_error("No versions available for the file.");
     }
 
-    const auto& lastVersion = versions.back();
+    const FileVersion lastVersion = versions.back();
 
     // Если файл уже не удален, ничего делать не нужно
     if (!lastVersion.isDeleted) {
@@ -236,6 +1669,9 @@ void Repository::restoreFile(const std::string& fileName, const std::string& bra
     FileVersion restoredVersion;
     restoredVersion.hash = lastVersion.parentHash; // Восстанавливаем предыдущую версию
     restoredVersion.parentHash = lastVersion.hash;
+    if (const FileVersion* original = findVersion(versions, lastVersion.parentHash)) {
+        restoredVersion.contentHash = original->contentHash;
+    }
     restoredVersion.timestamp = std::chrono::system_clock::now();
     restoredVersion.author = "System";
     restoredVersion.message = "File restored.";
@@ -243,10 +1679,12 @@ void Repository::restoreFile(const std::string& fileName, const std::string& bra
     restoredVersion.isDeleted = false;
 
     // Добавляем версию в историю файла
-    fileVersions[fileName].push_back(restoredVersion);
+    versions.push_back(restoredVersion);
+    metadata->appendVersion(fileName, restoredVersion);
 
     // Обновляем ветку, указывая на новую версию
     branches[branch][fileName] = restoredVersion.hash;
+    metadata->appendTip(branch, fileName, restoredVersion.hash);
 
     std::cout << "File '" << fileName << "' has been restored in branch '" << branch << "'." << std::endl;
 }
\ No newline at end of file
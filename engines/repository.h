@@ -3,43 +3,481 @@
 
 #include "../servers/file_version.h"
 #include "diff_engine.h"
+#include "fast_cdc.h"
+#include "content_cache.h"
+#include "metadata_index.h"
+#include "object_codec.h"
+#include "object_store.h"
 #include <boost/asio.hpp>
 #include <cstdint>
 #include <cstring>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <optional>
 #include <algorithm>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
 #include <map>
+#include <set>
+#include <unordered_set>
 #include <vector>
 #include <fstream>
 #include <iostream>
 
+using deltasync::FileVersion;
+
+// Идентификатор кусков списка: SHA-256 либо быстрый некриптографический хеш (XXH3/XXH64).
+// Быстрый вариант годится, только если содержимое репозитория не подбирается злоумышленником.
+enum class ChunkIdentity {
+    Sha256,
+    Fast
+};
+
+// Раскладка объектов на диске
+enum class ObjectBackend {
+    Loose,  // objects/<hash>, файл на объект
+    Pack    // objects/pack/pack-N.pack с индексами
+};
+
+struct RepositoryOptions {
+    // Максимальная длина цепочки дельт до принудительного полного снимка
+    uint32_t maxChainDepth = 32;
+
+    // Снимок сохраняется, если суммарный размер дельт с последнего снимка
+    // превышает размер содержимого, умноженный на этот коэффициент
+    double maxChainSizeRatio = 2.0;
+
+    // Бюджет кэша восстановленного содержимого и число его шардов
+    size_t cacheBytes = 256u << 20;
+    size_t cacheShards = 16;
+
+    // Бюджет кэша дельт для загрузки по известной получателю версии (пары база -> ветка)
+    size_t deltaCacheBytes = 64u << 20;
+
+    // Число записей журнала метаданных до перезаписи снимка; fdatasync каждой записи
+    // журнала и каждого объекта, на который она может сослаться
+    size_t metadataCompactEvery = 65536;
+    bool syncMetadata = false;
+
+    // Хранилище новых объектов и предельный размер одного pack-файла.
+    // Объекты из objects/<hash> читаются при любом выборе.
+    ObjectBackend objectBackend = ObjectBackend::Pack;
+    uint64_t maxPackBytes = 1ull << 30;
+
+    // Сжатие объектов при записи; level = 0 — уровень кодека по умолчанию
+    Compression compression = Compression::Zstd;
+    int compressionLevel = 0;
+
+    // Потоки пула вычислений (0 — по числу ядер). Объекты от parallelThreshold байт
+    // хешируются параллельно с вычислением дельты и сжимаются кусками по parallelChunkBytes.
+    size_t workerThreads = 0;
+    uint64_t parallelThreshold = 32u << 20;
+    size_t parallelChunkBytes = 4u << 20;
+
+    // Файлы от chunkingThreshold байт хранятся списком кусков FastCDC вместо дельт;
+    // куски дедуплицируются по хешу между всеми файлами и ветками.
+    // Порог должен превышать chunking.maxSize.
+    bool chunkLargeFiles = true;
+    uint64_t chunkingThreshold = 4u << 20;
+    FastCdc::Params chunking;
+    ChunkIdentity chunkIdentity = ChunkIdentity::Sha256;
+
+    // saveFile и saveBatch собирают версии без блокировок файлов и публикуют их, только если
+    // ветки не сдвинулись; после стольких неудачных попыток сборка идёт под блокировками
+    uint32_t saveRetries = 3;
+
+    // Предельный размер файла, собираемого из дельты отправителя (saveFileDelta);
+    // размер объявлен в заголовке дельты и проверяется до выделения памяти
+    uint64_t maxDeltaResultBytes = 1ull << 30;
+};
+
+// Фоновая переупаковка истории: версии пересобираются дельтами от лучшей базы
+// среди похожих версий того же файла (как git repack --window)
+struct RepackOptions {
+    // Базы, по которым считается дельта, из пула последних обработанных версий,
+    // ранжированного по сходству содержимого и близости размера; пул ограничен
+    // числом версий и памятью на их содержимое
+    size_t window = 8;
+    size_t candidates = 32;
+    uint64_t windowMemory = 256u << 20;
+    DeltaMode mode = DeltaMode::MaxRatio;
+
+    // Бюджет: байт прочитанного и записанного в секунду (0 — без ограничения)
+    // и доля одного ядра (не больше 0 или от 1 — без ограничения)
+    uint64_t ioBytesPerSecond = 0;
+    double cpuShare = 0;
+
+    // Файл переписывается, если его объекты сжимаются хотя бы на эту долю
+    double minSavings = 0.05;
+
+    // Расширения (например, ".yaml"), для которых перед переупаковкой обучаются словари
+    // сжатия: переписанные и новые объекты таких файлов сжимаются с ними
+    std::vector<std::string> dictionaryExtensions;
+};
+
+struct RepackStats {
+    size_t dictionariesTrained = 0;
+    size_t filesScanned = 0;
+    size_t filesRepacked = 0;
+    size_t versionsRewritten = 0;
+    // Объём заменённых объектов и объектов, записанных вместо них
+    uint64_t replacedBytes = 0;
+    uint64_t writtenBytes = 0;
+    // Удалённые заменённые объекты (на них больше ничто не ссылается) и место,
+    // освобождённое на диске
+    size_t objectsRemoved = 0;
+    uint64_t bytesFreed = 0;
+};
+
 class Repository {
+public:
+    // Версия из цепочки дельт, не помещающаяся в кэш: родитель собран, последняя дельта
+    // применяется порциями по ходу отправки
+    struct DeltaStream {
+        ContentCache::Content parent;
+        ObjectData delta;
+        DeltaReader reader;
+
+        DeltaStream(ContentCache::Content parent, ObjectData delta)
+            : parent(std::move(parent)), delta(std::move(delta)), reader(*this->parent, this->delta.bytes) {}
+    };
+
+    // Содержимое версии для отдачи по сети без сборки большого файла в памяти.
+    // Заполнено одно из region, chunks, stream, content.
+    struct ContentSource {
+        uint64_t size = 0;
+        std::optional<FileRegion> region;          // несжатый снимок: байты подряд в файле хранилища
+        std::vector<ChunkManifest::Entry> chunks;  // список кусков: читаются по одному через readChunk
+        std::shared_ptr<DeltaStream> stream;       // большая версия из цепочки дельт
+        ContentCache::Content content;             // собранное из цепочки дельт или распакованное
+    };
+
+    // Последняя версия файла для получателя, у которого уже есть одна из версий
+    struct DeltaDownload {
+        std::string versionHash;      // hex-хеш последней версии
+        Digest contentHash;           // SHA-256 её содержимого для проверки у получателя
+        ContentCache::Content delta;  // nullptr — содержимое передаётся целиком
+    };
+
+    // Файл пакетного сохранения; content должен жить до конца saveBatch
+    struct BatchFile {
+        std::string fileName;
+        std::span<const uint8_t> content;
+        std::optional<Digest> contentHash;
+    };
+
+    struct BatchFileResult {
+        std::string hash;   // hex-хеш версии; пуст при ошибке
+        std::string error;
+    };
+
+    struct BatchResult {
+        bool committed = false;
+        std::string branch;  // ветка, в которую записан пакет
+        std::vector<BatchFileResult> files;  // в порядке BatchFile
+    };
+
 private:
     std::filesystem::__cxx11::path repoPath;
+    RepositoryOptions options;
+    // Блокировки:
+    //  - branchesMutex (shared/exclusive) — метаданные веток и режимы дельт;
+    //  - fileIndexMutex — структура fileVersions (добавление новых файлов);
+    //  - fileLocks — списки версий, полосы выбираются по хешу имени файла;
+    //  - объекты неизменяемы, хранилище объектов синхронизируется само.
+    // Порядок захвата: fileIndexMutex -> fileLocks -> branchesMutex.
+    static constexpr size_t kFileLockStripes = 64;
+
     std::map<std::string, std::vector<FileVersion>> fileVersions;  // файл -> версии
-    std::map<std::string, std::map<std::string, std::string>> branches;  // ветка -> (файл -> хеш)
-    std::mutex repoMutex;
+    std::map<std::string, std::map<std::string, Digest>> branches;  // ветка -> (файл -> хеш)
+    std::map<std::string, DeltaMode> branchDeltaModes;  // ветка -> режим дельты
+    std::map<std::string, DeltaMode> fileDeltaModes;    // файл -> режим дельты
+    std::vector<std::pair<std::string, DeltaMode>> branchDeltaPatterns;  // шаблон fnmatch -> режим
+    std::vector<std::pair<std::string, DeltaMode>> fileDeltaPatterns;
+    mutable std::shared_mutex branchesMutex;
+    mutable std::shared_mutex fileIndexMutex;
+    mutable std::array<std::shared_mutex, kFileLockStripes> fileLocks;
+    ContentCache contentCache;
+    ContentCache deltaCache;  // ключ — SHA-256 пары хешей содержимого; пустая запись — дельта невыгодна
+    std::unique_ptr<MetadataIndex> metadata;
+    std::unique_ptr<ObjectStore> objects;
+    std::unique_ptr<LooseObjectStore> looseObjects;  // старые объекты при pack-хранилище
+    std::unique_ptr<CompressionDictionaries> dictionaries;
+    std::unique_ptr<WorkerPool> workers;
+    std::mutex compactionMutex;
+    std::mutex repackMutex;
+
+    // Операции, которые держат ключи объектов вне блокировок полос (план восстановления,
+    // сохранение до публикации версии), отмечаются эпохой; drain() ждёт все операции,
+    // начатые до вызова. После этого заменённые переупаковкой объекты никто не читает
+    class ObjectReaders {
+    public:
+        class Guard {
+        public:
+            explicit Guard(ObjectReaders& readers);
+            ~Guard();
+
+            Guard(const Guard&) = delete;
+            Guard& operator=(const Guard&) = delete;
+
+        private:
+            ObjectReaders& readers;
+            uint64_t epoch;
+        };
+
+        // Вызовы drain() не пересекаются (repackMutex)
+        void drain();
+
+    private:
+        std::atomic<uint64_t> epoch{0};
+        std::array<std::atomic<uint64_t>, 2> active{};  // операций по чётности эпохи
+    };
+    mutable ObjectReaders objectReaders;
+
+    // Объекты, заменённые переупаковкой: ждут удаления (condemned) или удаляются (deleting).
+    // Запись такого объекта снимает его с удаления (reviveObject)
+    mutable std::mutex reclaimMutex;
+    mutable std::condition_variable reclaimDone;
+    mutable std::unordered_set<Digest> condemned;
+    mutable std::unordered_set<Digest> deleting;
+    mutable std::atomic<bool> reclaiming{false};
+
+    // Звено цепочки восстановления
+    struct ChainLink {
+        Digest objectHash;
+        Digest contentHash;
+    };
+
+    // План восстановления версии: готовое содержимое из кэша либо полный снимок base,
+    // затем дельты от старых к новым
+    struct ReplayPlan {
+        ContentCache::Content cached;
+        ChainLink base;
+        std::vector<ChainLink> deltas;
+    };
+
+    // Родитель новой версии, снятый под блокировкой полосы: дальше версия строится без неё
+    struct ParentSnapshot {
+        std::optional<Digest> hash;       // std::nullopt — первая версия файла
+        std::optional<ReplayPlan> plan;   // есть, если новую версию можно сохранить дельтой
+        uint32_t chainDepth = 0;
+        uint64_t chainBytes = 0;
+    };
+
+    std::shared_mutex& fileLock(const std::string& fileName) const;
+
+    // Список версий файла; указатель стабилен, т.к. файлы из fileVersions не удаляются.
+    // История, ещё не загруженная из снимка метаданных, подгружается при первом обращении.
+    std::vector<FileVersion>* findVersions(const std::string& fileName);
+
+    std::vector<FileVersion>& versionsOrCreate(const std::string& fileName);
+
+    // Файлы, загруженные в память, и файлы снимка метаданных
+    std::set<std::string> allFileNames();
+
+    // Составление плана под блокировкой полосы файла
+    ReplayPlan planReplay(const std::vector<FileVersion>& versions, const Digest& hash);
+
+    // Выполнение плана без блокировок; admit = false — результат не вытесняет кэш
+    ContentCache::Content replay(const ReplayPlan& plan, bool admit = true);
+
+    // Перезапись снимка метаданных, когда журнал вырос (force — в любом случае);
+    // вызывается без удерживаемых блокировок
+    void maybeCompactMetadata(bool force = false);
+
+    // Ограничение скорости переупаковки по RepackOptions
+    class RepackThrottle;
+
+    // Переупаковка истории одного файла; вызывается под repackMutex.
+    // Ключи объектов, которые перестали хранить версии файла, добавляются в replaced
+    void repackFile(const std::string& fileName, const RepackOptions& repackOptions,
+                    RepackThrottle& throttle, RepackStats& stats, std::vector<Digest>& replaced);
+
+    // Удаление объектов из replaced, на которые не ссылаются ни версии, ни списки кусков,
+    // после завершения операций, начатых до публикации нового хранения. Вызывается
+    // под repackMutex без удерживаемых блокировок
+    void reclaimObjects(const std::vector<Digest>& replaced, RepackThrottle& throttle, RepackStats& stats);
+
+    // Перед записью объекта: объект, ждущий удаления, остаётся в хранилище,
+    // а удаляемый прямо сейчас дожидается удаления и будет записан заново
+    void reviveObject(const Digest& hash) const;
+
+    // Вызывается под блокировкой полосы файла
+    ParentSnapshot snapshotParent(const std::vector<FileVersion>& versions, std::optional<Digest> parentHash,
+                                  uint64_t contentSize);
+
+    // Новая версия content от снятого родителя: дельта или снимок, объекты записаны.
+    // contentHash вызывается, когда хеш понадобится, чтобы его вычисление шло параллельно
+    // с дельтой. Блокировок не требует.
+    FileVersion buildVersion(const std::string& fileName, const ParentSnapshot& parent,
+                             std::span<const uint8_t> content, DeltaMode mode,
+                             const std::function<Digest()>& contentHash);
+
+    // Хеш версии файла в ветке; вызывается под branchesMutex
+    Digest tipHash(const std::string& fileName, const std::string& branch) const;
+
+    // То же без исключения: std::nullopt, если файла в ветке нет
+    std::optional<Digest> findTip(const std::string& fileName, const std::string& branch) const;
+
+    // Имя новой ветки для отставшего сохранения: <branch>-<время>, с номером, если такая
+    // ветка уже есть (несколько ответвлений за секунду). Вызывается под записью branchesMutex
+    std::string forkName(const std::string& branch, std::chrono::system_clock::time_point time) const;
+
+    // Общая часть saveFile: expectedTip задан — версия строится только поверх него,
+    // при сдвиге ветки возвращается std::nullopt; иначе версия строится заново от нового родителя
+    std::optional<std::string> saveVersion(const std::string& fileName, std::span<const uint8_t> content,
+                                           const std::string& author, const std::string& message,
+                                           const std::string& branch, std::optional<DeltaMode> mode,
+                                           std::optional<Digest> contentHash,
+                                           const std::optional<Digest>& expectedTip);
+
+    // Публикация собранной версии, если ветка всё ещё указывает на expectedTip; false — сдвинулась.
+    // Если ветка отстала от последней версии файла, версия уходит в новую ветку branch-<время>.
+    // Вызывается под исключительной блокировкой полосы файла
+    bool publishVersion(const std::string& fileName, std::vector<FileVersion>& versions,
+                        const std::string& branch, const std::optional<Digest>& expectedTip,
+                        const FileVersion& version);
+
+    // Участок файла хранилища с несжатым содержимым объекта;
+    // std::nullopt, если объект сжат или это список кусков
+    std::optional<FileRegion> locateRaw(const Digest& hash) const;
+
+    // Чтение объекта: сначала основное хранилище, затем loose-объекты; сжатые распаковываются
+    ObjectData readObject(const Digest& hash) const;
+
+    // Список кусков, если объект — ChunkManifest; содержимое других объектов не читается
+    std::optional<ChunkManifest> readManifest(const Digest& hash) const;
+
+    // Сжатие словарём типа файла fileName
+    std::vector<uint8_t> encodeObject(std::span<const uint8_t> data, const std::string& fileName) const;
+
+    // Сжатие и запись
+    void writeObject(const Digest& hash, std::span<const uint8_t> data, const std::string& fileName) const;
+
+    // Разбиение на куски, запись новых кусков и списка кусков под hash
+    void writeChunked(const Digest& hash, std::span<const uint8_t> content, const std::string& fileName) const;
+
+    // Идентификатор куска по options.chunkIdentity
+    Digest chunkId(std::span<const uint8_t> data) const;
+
+    // Полное содержимое объекта-снимка; список кусков собирается параллельно
+    std::vector<uint8_t> readContent(const Digest& hash) const;
+
+    // Первая версия с данным хешем (восстановленные версии ссылаются на исходную запись)
+    static const FileVersion* findVersion(const std::vector<FileVersion>& versions, const Digest& hash);
+
+    // Явный режим > режим файла > режим ветки > Fast; вызывается под branchesMutex
+    DeltaMode resolveDeltaMode(const std::string& fileName, const std::string& branch,
+                               std::optional<DeltaMode> requested) const;
 
 public:
-    Repository(const std::filesystem::__cxx11::path& path);
+    Repository(const std::filesystem::__cxx11::path& path, RepositoryOptions options = {});
 
-    // Загрузка состояния репозитория с диска
+    // Загрузка состояния репозитория с диска: ветки и хвост журнала метаданных,
+    // истории файлов подгружаются из снимка лениво
     void loadRepository();
 
-    // Сохранение файла в репозиторий
-    std::string saveFile(const std::string& fileName, const std::vector<uint8_t>& content,
+    // Сохранение файла в репозиторий; возвращает hex-хеш версии.
+    // contentHash — SHA-256 содержимого, если он посчитан при приёме (второй проход не нужен).
+    // content может указывать на отображённый файл: большие файлы сохраняются кусками
+    // без копирования в память процесса.
+    // Дельта и запись объектов идут без блокировок, поэтому сохранения разных файлов
+    // и чтения того же файла их не ждут. Если ветка за это время сдвинулась, версия
+    // строится заново от нового родителя.
+    std::string saveFile(const std::string& fileName, std::span<const uint8_t> content,
                         const std::string& author, const std::string& message,
-                        const std::string& branch);
+                        const std::string& branch,
+                        std::optional<DeltaMode> mode = std::nullopt,
+                        std::optional<Digest> contentHash = std::nullopt);
+
+    // То же, но только поверх версии expectedTip (compare-and-swap): если ветка указывает
+    // на другую версию, ничего не сохраняется и возвращается std::nullopt
+    std::optional<std::string> saveFile(const std::string& fileName, std::span<const uint8_t> content,
+                                        const std::string& author, const std::string& message,
+                                        const std::string& branch, const Digest& expectedTip,
+                                        std::optional<Digest> contentHash = std::nullopt);
+
+    // Сохранение по дельте от версии baseHash, которая должна быть последней в ветке.
+    // Дельта применяется, результат сверяется с contentHash. Если цепочка укладывается
+    // в лимиты, дельта отправителя сама становится объектом версии — сервер её не пересчитывает.
+    // Ветка выбирается как у saveFile (отставшая ветка уходит в branch-<время>).
+    // std::nullopt, если baseHash не последняя версия ветки: отправителю нужна полная загрузка.
+    // Результат больше options.maxDeltaResultBytes — исключение.
+    std::optional<std::string> saveFileDelta(const std::string& fileName, std::span<const uint8_t> delta,
+                                             const std::string& author, const std::string& message,
+                                             const std::string& branch, const std::string& baseHash,
+                                             const Digest& contentHash);
+
+    // Сохранение нескольких файлов одним коммитом. Версии файлов строятся параллельно на пуле
+    // без блокировок, указатели ветки публикуются разом: читатели видят либо весь пакет,
+    // либо ничего, в журнале метаданных это одна запись. Если ветка какого-либо файла
+    // за время сборки сдвинулась, этот файл строится заново от нового родителя.
+    // Ошибка хотя бы одного файла отменяет весь пакет.
+    // Если ветка отстала от последней версии какого-либо файла, пакет уходит в новую ветку,
+    // как и у saveFile.
+    BatchResult saveBatch(const std::vector<BatchFile>& files, const std::string& author,
+                          const std::string& message, const std::string& branch);
+
+    // Режим кодирования дельты по умолчанию для ветки или файла. Имя может быть шаблоном
+    // fnmatch ("release-*", "*.sql"): точное имя важнее шаблона, из шаблонов — первый заданный
+    void setBranchDeltaMode(const std::string& branch, DeltaMode mode);
+
+    void setFileDeltaMode(const std::string& fileName, DeltaMode mode);
 
-    // Получение содержимого файла по хешу
+    // Получение содержимого файла по hex-хешу
     std::vector<uint8_t> getFileContent(const std::string& fileName, const std::string& hash);
 
+    // То же без копирования: содержимое разделяется с кэшем
+    ContentCache::Content getFileContentShared(const std::string& fileName, const std::string& hash);
+
+    // Обучение словаря сжатия на последних версиях файлов с расширением extension
+    // (например, ".yaml"); новые объекты таких файлов сжимаются с ним. Возвращает id словаря.
+    uint32_t trainCompressionDictionary(const std::string& extension, size_t maxSamples = 256);
+
+    // Счётчики попаданий, промахов и вытеснений кэша содержимого
+    ContentCache::Stats cacheStats() const;
+
+    // Пул вычислений репозитория (RepositoryOptions::workerThreads). Сервер выполняет на нём
+    // запросы: задачи пула ждут друг друга без блокировки (parallelFor, PoolTask)
+    WorkerPool& workerPool() { return *workers; }
+
+    // Источник для отдачи версии: несжатый снимок — участком файла (для sendfile),
+    // список кусков — по куску, версия из цепочки дельт больше записи кэша — потоком
+    // от собранного родителя; целиком в памяти собираются только сжатые снимки
+    // и версии, которые остаются в кэше
+    ContentSource openFileContent(const std::string& fileName, const std::string& hash);
+
+    // Дельта от версии baseHash к последней версии файла в ветке. Без дельты (содержимое
+    // целиком), если база неизвестна или дельта не меньше содержимого.
+    DeltaDownload getLatestDelta(const std::string& fileName, const std::string& branch,
+                                 const std::string& baseHash);
+
+    // Синхронизация по кускам: получатель запрашивает список кусков версии и забирает
+    // через readChunk только те, которых у него нет (GET_MANIFEST/GET_CHUNKS сервера).
+    // std::nullopt, если версия хранится не списком кусков.
+    std::optional<ChunkManifest> getChunkManifest(const std::string& fileName, const std::string& hash);
+
+    // Переупаковка истории всех файлов. Живые запросы не ждут её: объекты пишутся без
+    // блокировок, новое хранение версий файла публикуется под короткой блокировкой
+    // одной записью журнала, в конце перезаписывается снимок метаданных. Затем заменённые
+    // объекты без ссылок удаляются, когда завершатся чтения и сохранения, начатые до публикации
+    // (pack-файлы с ними переписываются). cancel прерывает работу между файлами и между
+    // версиями; уже опубликованное освобождается и при отмене.
+    RepackStats repack(const RepackOptions& repackOptions, const std::atomic<bool>* cancel = nullptr);
+
+    // Хеши из chunkHashes, которых нет в репозитории
+    std::vector<Digest> findMissingChunks(const std::vector<Digest>& chunkHashes) const;
+
+    std::vector<uint8_t> readChunk(const Digest& chunkHash) const;
+
     // Получение последней версии файла в указанной ветке
     std::vector<uint8_t> getLatestVersion(const std::string& fileName, const std::string& branch );
 
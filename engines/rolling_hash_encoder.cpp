@@ -0,0 +1,132 @@
+#include "rolling_hash_encoder.h"
+#include "delta_writer.h"
+#include "match_kernels.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Множитель полиномиального хеша Рабина-Карпа (арифметика по модулю 2^64)
+constexpr uint64_t kPrime = 0x100000001b3ULL;
+
+uint64_t mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+} // namespace
+
+uint64_t RollingHashEncoder::fingerprint(const unsigned char* data, size_t length) {
+    uint64_t h = 0;
+    for (size_t i = 0; i < length; i++) {
+        h = h * kPrime + data[i] + 1;
+    }
+    return h;
+}
+
+RollingHashEncoder::BlockIndex::BlockIndex(const unsigned char* data, size_t size, size_t blockSize) {
+    size_t blocks = size / blockSize;
+    size_t capacity = 16;
+    while (capacity < blocks * 2) capacity <<= 1;
+
+    fingerprints.assign(capacity, 0);
+    positions.assign(capacity, 0);
+    mask = capacity - 1;
+
+    // Индексируем непересекающиеся блоки; при совпадении отпечатков остаётся первый
+    for (size_t b = 0; b < blocks; b++) {
+        size_t pos = b * blockSize;
+        uint64_t fp = fingerprint(data + pos, blockSize);
+
+        size_t slot = mix(fp) & mask;
+        while (positions[slot] != 0 && fingerprints[slot] != fp) {
+            slot = (slot + 1) & mask;
+        }
+        if (positions[slot] == 0) {
+            fingerprints[slot] = fp;
+            positions[slot] = pos + 1;
+        }
+    }
+}
+
+size_t RollingHashEncoder::BlockIndex::find(uint64_t fp) const {
+    size_t slot = mix(fp) & mask;
+    while (positions[slot] != 0) {
+        if (fingerprints[slot] == fp) return positions[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+    return std::numeric_limits<size_t>::max();
+}
+
+std::vector<unsigned char> RollingHashEncoder::encode(std::span<const unsigned char> original,
+                                                      std::span<const unsigned char> modified,
+                                                      size_t minMatchLength) {
+    DeltaWriter writer(original.size());
+
+    const size_t blockSize = std::max(minMatchLength, kMinBlockSize);
+    const unsigned char* src = original.data();
+    const unsigned char* dst = modified.data();
+    const size_t srcSize = original.size();
+    const size_t dstSize = modified.size();
+
+    if (srcSize < blockSize || dstSize < blockSize) {
+        writer.insert(dst, dstSize);
+        return writer.finish(dst, dstSize);
+    }
+
+    BlockIndex index(src, srcSize, blockSize);
+
+    // kPrime^blockSize — вес байта, уходящего из окна
+    uint64_t outWeight = 1;
+    for (size_t k = 0; k < blockSize; k++) outWeight *= kPrime;
+
+    size_t insertStart = 0;
+    size_t i = 0;
+    uint64_t h = fingerprint(dst, blockSize);
+
+    while (i + blockSize <= dstSize) {
+        size_t j = index.find(h);
+
+        size_t forward = 0;
+        if (j != std::numeric_limits<size_t>::max()) {
+            // Проверка кандидата и расширение вперёд одним проходом
+            forward = MatchKernels::forward(dst + i, src + j, std::min(dstSize - i, srcSize - j));
+        }
+
+        if (forward >= blockSize) {
+            // Расширяем назад — в пределах ещё не записанной вставки
+            size_t backward = MatchKernels::backward(dst + i, src + j, std::min(i - insertStart, j));
+
+            size_t matchStart = i - backward;
+            size_t matchLen = forward + backward;
+
+            if (matchLen >= minMatchLength) {
+                if (matchStart > insertStart) {
+                    writer.insert(dst + insertStart, matchStart - insertStart);
+                }
+                writer.copy(j - backward, matchLen);
+
+                i = matchStart + matchLen;
+                insertStart = i;
+                if (i + blockSize <= dstSize) {
+                    h = fingerprint(dst + i, blockSize);
+                }
+                continue;
+            }
+        }
+
+        // Сдвигаем окно на один байт
+        if (i + blockSize < dstSize) {
+            h = h * kPrime + dst[i + blockSize] + 1 - outWeight * (dst[i] + 1);
+        }
+        i++;
+    }
+
+    if (insertStart < dstSize) {
+        writer.insert(dst + insertStart, dstSize - insertStart);
+    }
+
+    return writer.finish(dst, dstSize);
+}
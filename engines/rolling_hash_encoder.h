@@ -0,0 +1,38 @@
+#ifndef DELTASYNC_ROLLING_HASH_ENCODER_H
+#define DELTASYNC_ROLLING_HASH_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Кодировщик дельты в стиле rsync/xdelta: original индексируется один раз
+// таблицей отпечатков блоков, modified просматривается скользящим хешем.
+// Найденные кандидаты расширяются вперёд и назад, время работы ~O(n + m).
+class RollingHashEncoder {
+public:
+    static std::vector<unsigned char> encode(std::span<const unsigned char> original,
+                                             std::span<const unsigned char> modified,
+                                             size_t minMatchLength = 8);
+
+private:
+    // Минимальный размер индексируемого блока: меньшие блоки раздувают таблицу
+    static constexpr size_t kMinBlockSize = 16;
+
+    class BlockIndex {
+    public:
+        BlockIndex(const unsigned char* data, size_t size, size_t blockSize);
+
+        // Позиция блока в original с таким отпечатком или SIZE_MAX
+        size_t find(uint64_t fingerprint) const;
+
+    private:
+        std::vector<uint64_t> fingerprints;
+        std::vector<uint64_t> positions; // позиция + 1, 0 — пустой слот
+        size_t mask = 0;
+    };
+
+    static uint64_t fingerprint(const unsigned char* data, size_t length);
+};
+
+#endif //DELTASYNC_ROLLING_HASH_ENCODER_H
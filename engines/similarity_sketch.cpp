@@ -0,0 +1,50 @@
+#include "similarity_sketch.h"
+#include "digest.h"
+#include "fast_cdc.h"
+#include <algorithm>
+
+namespace {
+
+// Куски меньше, чем для хранения: нужен не объём дедупликации, а число образцов
+const FastCdc::Params kSketchChunking{64, 256, 2048};
+
+} // namespace
+
+SimilaritySketch SimilaritySketch::of(std::span<const uint8_t> data) {
+    SimilaritySketch sketch;
+    if (data.empty()) return sketch;
+
+    size_t pos = 0;
+    for (size_t length : FastCdc::split(data, kSketchChunking)) {
+        sketch.hashes.push_back(FastHash::hash64(data.subspan(pos, length)));
+        pos += length;
+    }
+
+    std::sort(sketch.hashes.begin(), sketch.hashes.end());
+    sketch.hashes.erase(std::unique(sketch.hashes.begin(), sketch.hashes.end()), sketch.hashes.end());
+    if (sketch.hashes.size() > kSize) sketch.hashes.resize(kSize);
+    return sketch;
+}
+
+// Среди kSize наименьших хешей объединения считаются присутствующие в обоих наборах
+double SimilaritySketch::similarity(const SimilaritySketch& other) const {
+    size_t i = 0;
+    size_t j = 0;
+    size_t taken = 0;
+    size_t shared = 0;
+
+    while (taken < kSize && (i < hashes.size() || j < other.hashes.size())) {
+        if (j == other.hashes.size() || (i < hashes.size() && hashes[i] < other.hashes[j])) {
+            i++;
+        } else if (i == hashes.size() || other.hashes[j] < hashes[i]) {
+            j++;
+        } else {
+            shared++;
+            i++;
+            j++;
+        }
+        taken++;
+    }
+
+    return taken ? static_cast<double>(shared) / static_cast<double>(taken) : 1.0;
+}
@@ -0,0 +1,23 @@
+#ifndef DELTASYNC_SIMILARITY_SKETCH_H
+#define DELTASYNC_SIMILARITY_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Оценка сходства содержимого для выбора базы дельты без её вычисления:
+// bottom-k MinHash по кускам FastCDC. Куски режутся по содержимому, поэтому
+// общие фрагменты дают общие хеши и после вставок и сдвигов.
+struct SimilaritySketch {
+    static constexpr size_t kSize = 64;
+
+    std::vector<uint64_t> hashes;  // не больше kSize наименьших хешей кусков, по возрастанию
+
+    static SimilaritySketch of(std::span<const uint8_t> data);
+
+    // Оценка доли общих кусков (коэффициент Жаккара) от 0 до 1
+    double similarity(const SimilaritySketch& other) const;
+};
+
+#endif //DELTASYNC_SIMILARITY_SKETCH_H
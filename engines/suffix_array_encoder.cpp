@@ -0,0 +1,240 @@
+#include "suffix_array_encoder.h"
+#include "delta_writer.h"
+#include "match_kernels.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// SA-IS (Nong, Zhang, Chan). Последний символ s — уникальный минимальный сентинел 0.
+template <typename T>
+void getBuckets(const T* s, std::vector<int32_t>& bkt, int32_t n, int32_t alphabet, bool end) {
+    std::fill(bkt.begin(), bkt.begin() + alphabet, 0);
+    for (int32_t i = 0; i < n; i++) bkt[s[i]]++;
+
+    int32_t sum = 0;
+    for (int32_t i = 0; i < alphabet; i++) {
+        sum += bkt[i];
+        bkt[i] = end ? sum : sum - bkt[i];
+    }
+}
+
+template <typename T>
+void induceL(const std::vector<uint8_t>& t, int32_t* sa, const T* s, std::vector<int32_t>& bkt,
+             int32_t n, int32_t alphabet) {
+    getBuckets(s, bkt, n, alphabet, false);
+    for (int32_t i = 0; i < n; i++) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && !t[j]) sa[bkt[s[j]]++] = j;
+    }
+}
+
+template <typename T>
+void induceS(const std::vector<uint8_t>& t, int32_t* sa, const T* s, std::vector<int32_t>& bkt,
+             int32_t n, int32_t alphabet) {
+    getBuckets(s, bkt, n, alphabet, true);
+    for (int32_t i = n - 1; i >= 0; i--) {
+        int32_t j = sa[i] - 1;
+        if (j >= 0 && t[j]) sa[--bkt[s[j]]] = j;
+    }
+}
+
+template <typename T>
+void sais(const T* s, int32_t* sa, int32_t n, int32_t alphabet) {
+    // t[i] == 1 — S-тип, 0 — L-тип
+    std::vector<uint8_t> t(n);
+    t[n - 1] = 1;
+    for (int32_t i = n - 2; i >= 0; i--) {
+        t[i] = (s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1])) ? 1 : 0;
+    }
+    auto isLMS = [&t](int32_t i) { return i > 0 && t[i] && !t[i - 1]; };
+
+    std::vector<int32_t> bkt(alphabet);
+
+    // Этап 1: сортировка LMS-подстрок
+    getBuckets(s, bkt, n, alphabet, true);
+    std::fill(sa, sa + n, -1);
+    for (int32_t i = 1; i < n; i++) {
+        if (isLMS(i)) sa[--bkt[s[i]]] = i;
+    }
+    induceL(t, sa, s, bkt, n, alphabet);
+    induceS(t, sa, s, bkt, n, alphabet);
+
+    int32_t n1 = 0;
+    for (int32_t i = 0; i < n; i++) {
+        if (isLMS(sa[i])) sa[n1++] = sa[i];
+    }
+
+    // Именование LMS-подстрок
+    std::fill(sa + n1, sa + n, -1);
+    int32_t name = 0;
+    int32_t prev = -1;
+    for (int32_t i = 0; i < n1; i++) {
+        int32_t pos = sa[i];
+        bool diff = false;
+        for (int32_t d = 0; d < n; d++) {
+            if (prev == -1 || s[pos + d] != s[prev + d] || t[pos + d] != t[prev + d]) {
+                diff = true;
+                break;
+            }
+            if (d > 0 && (isLMS(pos + d) || isLMS(prev + d))) break;
+        }
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for (int32_t i = n - 1, j = n - 1; i >= n1; i--) {
+        if (sa[i] >= 0) sa[j--] = sa[i];
+    }
+
+    // Этап 2: рекурсия, если имена не уникальны
+    int32_t* s1 = sa + n - n1;
+    if (name < n1) {
+        sais(s1, sa, n1, name);
+    } else {
+        for (int32_t i = 0; i < n1; i++) sa[s1[i]] = i;
+    }
+
+    // Этап 3: индукция полного массива из отсортированных LMS-суффиксов
+    getBuckets(s, bkt, n, alphabet, true);
+    for (int32_t i = 1, j = 0; i < n; i++) {
+        if (isLMS(i)) s1[j++] = i;
+    }
+    for (int32_t i = 0; i < n1; i++) sa[i] = s1[sa[i]];
+    std::fill(sa + n1, sa + n, -1);
+    for (int32_t i = n1 - 1; i >= 0; i--) {
+        int32_t j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[s[j]]] = j;
+    }
+    induceL(t, sa, s, bkt, n, alphabet);
+    induceS(t, sa, s, bkt, n, alphabet);
+}
+
+size_t matchLength(const unsigned char* a, size_t aSize, const unsigned char* b, size_t bSize) {
+    return MatchKernels::forward(a, b, std::min(aSize, bSize));
+}
+
+} // namespace
+
+std::vector<int32_t> SuffixArrayEncoder::buildSuffixArray(const unsigned char* data, size_t size) {
+    if (size >= static_cast<size_t>(std::numeric_limits<int32_t>::max()))
+        throw std::runtime_error("Input too large for suffix array");
+
+    // Сдвигаем алфавит на 1, чтобы освободить 0 под сентинел
+    int32_t n = static_cast<int32_t>(size) + 1;
+    std::vector<uint16_t> text(n);
+    for (size_t i = 0; i < size; i++) text[i] = static_cast<uint16_t>(data[i]) + 1;
+    text[size] = 0;
+
+    std::vector<int32_t> sa(n);
+    sais(text.data(), sa.data(), n, 257);
+
+    // sa[0] — всегда сентинел
+    sa.erase(sa.begin());
+    return sa;
+}
+
+SuffixArrayEncoder::Match SuffixArrayEncoder::longestMatch(const std::vector<int32_t>& sa,
+                                                           const unsigned char* src, size_t srcSize,
+                                                           const unsigned char* dst, size_t dstSize) {
+    // Двоичный поиск по суффиксному массиву, как в bsdiff
+    size_t lo = 0;
+    size_t hi = sa.size() - 1;
+    while (hi - lo >= 2) {
+        size_t mid = lo + (hi - lo) / 2;
+        size_t pos = sa[mid];
+        size_t len = std::min(srcSize - pos, dstSize);
+        if (MatchKernels::compare(src + pos, dst, len) < 0) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    Match best;
+    for (size_t idx : {lo, hi}) {
+        size_t pos = sa[idx];
+        size_t len = matchLength(src + pos, srcSize - pos, dst, dstSize);
+        if (len > best.length) {
+            best.length = len;
+            best.position = pos;
+        }
+    }
+    return best;
+}
+
+std::vector<unsigned char> SuffixArrayEncoder::encode(std::span<const unsigned char> original,
+                                                      std::span<const unsigned char> modified,
+                                                      size_t minMatchLength) {
+    DeltaWriter writer(original.size());
+
+    const unsigned char* src = original.data();
+    const unsigned char* dst = modified.data();
+    const size_t srcSize = original.size();
+    const size_t dstSize = modified.size();
+
+    if (srcSize == 0 || dstSize < minMatchLength) {
+        writer.insert(dst, dstSize);
+        return writer.finish(dst, dstSize);
+    }
+
+    std::vector<int32_t> sa = buildSuffixArray(src, srcSize);
+
+    size_t insertStart = 0;
+    size_t lastCopyEnd = 0;
+    size_t i = 0;
+
+    auto findAt = [&](size_t pos) {
+        Match m = longestMatch(sa, src, srcSize, dst + pos, dstSize - pos);
+
+        // При равной длине предпочитаем продолжение предыдущего копирования
+        if (lastCopyEnd < srcSize) {
+            size_t cont = matchLength(src + lastCopyEnd, srcSize - lastCopyEnd, dst + pos, dstSize - pos);
+            if (cont >= m.length) {
+                m.position = lastCopyEnd;
+                m.length = cont;
+            }
+        }
+        return m;
+    };
+
+    Match current = findAt(0);
+    while (i < dstSize) {
+        if (current.length < minMatchLength) {
+            i++;
+            if (i < dstSize) current = findAt(i);
+            continue;
+        }
+
+        // Ленивое сопоставление: если со следующего байта совпадение заметно длиннее,
+        // выгоднее вставить один байт и взять его
+        if (i + 1 < dstSize) {
+            Match next = findAt(i + 1);
+            if (next.length > current.length + 1) {
+                i++;
+                current = next;
+                continue;
+            }
+        }
+
+        if (i > insertStart) {
+            writer.insert(dst + insertStart, i - insertStart);
+        }
+        writer.copy(current.position, current.length);
+
+        i += current.length;
+        lastCopyEnd = current.position + current.length;
+        insertStart = i;
+        if (i < dstSize) current = findAt(i);
+    }
+
+    if (insertStart < dstSize) {
+        writer.insert(dst + insertStart, dstSize - insertStart);
+    }
+
+    return writer.finish(dst, dstSize);
+}
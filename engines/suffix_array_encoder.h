@@ -0,0 +1,33 @@
+#ifndef DELTASYNC_SUFFIX_ARRAY_ENCODER_H
+#define DELTASYNC_SUFFIX_ARRAY_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Кодировщик дельты класса bsdiff: суффиксный массив (SA-IS) над original
+// позволяет находить действительно самое длинное совпадение для каждой позиции.
+// Медленнее RollingHashEncoder, но даёт заметно меньшие дельты для бинарников
+// с множеством мелких разбросанных правок.
+class SuffixArrayEncoder {
+public:
+    static std::vector<unsigned char> encode(std::span<const unsigned char> original,
+                                             std::span<const unsigned char> modified,
+                                             size_t minMatchLength = 8);
+
+    // Построение суффиксного массива алгоритмом SA-IS за O(n)
+    static std::vector<int32_t> buildSuffixArray(const unsigned char* data, size_t size);
+
+private:
+    struct Match {
+        size_t position = 0;
+        size_t length = 0;
+    };
+
+    static Match longestMatch(const std::vector<int32_t>& sa,
+                              const unsigned char* src, size_t srcSize,
+                              const unsigned char* dst, size_t dstSize);
+};
+
+#endif //DELTASYNC_SUFFIX_ARRAY_ENCODER_H
@@ -0,0 +1,104 @@
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <utility>
+
+namespace {
+
+uint64_t threadCpuNanos() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000u + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+size_t resolveThreads(size_t threads) {
+    if (threads != 0) return threads;
+    return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Общее состояние parallelFor; помощники, запущенные после окончания работы, просто выходят
+struct ParallelForState {
+    std::atomic<size_t> next{0};
+    size_t count = 0;
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t done = 0;
+    std::exception_ptr error;
+
+    void run(const std::function<void(size_t)>& body) {
+        size_t index;
+        while ((index = next.fetch_add(1)) < count) {
+            std::exception_ptr failure;
+            try {
+                body(index);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (failure && !error) error = failure;
+            if (++done == count) finished.notify_all();
+        }
+    }
+};
+
+} // namespace
+
+CpuAccount::Scope::Scope(CpuAccount& account) : previous(std::exchange(current(), &account)) {}
+
+CpuAccount::Scope::~Scope() {
+    current() = previous;
+}
+
+CpuAccount*& CpuAccount::current() {
+    thread_local CpuAccount* account = nullptr;
+    return account;
+}
+
+// Задачи пула не бросают исключений (их ловят PoolTask и parallelFor).
+// Вложенная работа (parallelFor внутри задачи) учитывается тем же счётом
+void CpuAccount::run(CpuAccount* account, const std::function<void()>& task) {
+    if (!account) {
+        task();
+        return;
+    }
+
+    Scope scope(*account);
+    uint64_t start = threadCpuNanos();
+    task();
+    account->nanos += threadCpuNanos() - start;
+}
+
+WorkerPool::WorkerPool(size_t threads) : threadCount(resolveThreads(threads)), pool(threadCount) {}
+
+WorkerPool::~WorkerPool() {
+    pool.join();
+}
+
+void WorkerPool::parallelFor(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 0) return;
+
+    auto state = std::make_shared<ParallelForState>();
+    state->count = count;
+
+    size_t helpers = std::min(threadCount, count - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        // body живёт, пока вызывающий ждёт done == count; позже помощник его не трогает
+        boost::asio::post(pool, [state, &body, account = CpuAccount::current()] {
+            CpuAccount::run(account, [&] { state->run(body); });
+        });
+    }
+
+    state->run(body);
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&] { return state->done == state->count; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
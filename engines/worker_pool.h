@@ -0,0 +1,123 @@
+#ifndef DELTASYNC_WORKER_POOL_H
+#define DELTASYNC_WORKER_POOL_H
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+// Результат задачи WorkerPool::submit. Задачу, которую пул ещё не начал, выполняет
+// сам ожидающий: ожидание из потока этого же пула не блокируется на занятых потоках
+template <typename Result>
+class PoolTask {
+public:
+    PoolTask() = default;
+
+    bool valid() const { return state != nullptr; }
+
+    Result get() {
+        auto current = std::move(state);
+        current->run();
+        return current->future.get();
+    }
+
+    // Не начатая задача отменяется, начатая — дожидается завершения
+    void cancel() {
+        auto current = std::move(state);
+        if (current && current->claimed.exchange(true)) {
+            current->future.wait();
+        }
+    }
+
+private:
+    friend class WorkerPool;
+
+    struct State {
+        explicit State(std::packaged_task<Result()> task) : task(std::move(task)), future(this->task.get_future()) {}
+
+        std::atomic<bool> claimed{false};
+        std::packaged_task<Result()> task;
+        std::future<Result> future;
+
+        void run() {
+            if (!claimed.exchange(true)) task();
+        }
+    };
+
+    std::shared_ptr<State> state;
+};
+
+// Процессорное время, затраченное потоками пула на работу, которую отдали им потоки
+// под действием CpuAccount::Scope (время самих отдающих потоков сюда не входит)
+class CpuAccount {
+public:
+    class Scope {
+    public:
+        explicit Scope(CpuAccount& account);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        CpuAccount* previous;
+    };
+
+    double seconds() const { return static_cast<double>(nanos.load()) * 1e-9; }
+
+private:
+    friend class WorkerPool;
+
+    std::atomic<uint64_t> nanos{0};
+
+    // Счёт текущего потока; nullptr — работа не учитывается
+    static CpuAccount*& current();
+
+    // task на потоке пула под счётом account
+    static void run(CpuAccount* account, const std::function<void()>& task);
+};
+
+// Пул потоков для тяжёлых вычислений (сжатие, хеширование, дельты)
+class WorkerPool {
+public:
+    // threads = 0 — по числу ядер
+    explicit WorkerPool(size_t threads = 0);
+
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return threadCount; }
+
+    // Исполнитель пула для asio (co_spawn, post)
+    boost::asio::thread_pool::executor_type executor() { return pool.get_executor(); }
+
+    template <typename F>
+    auto submit(F&& task) -> PoolTask<std::invoke_result_t<std::decay_t<F>>> {
+        using Result = std::invoke_result_t<std::decay_t<F>>;
+        PoolTask<Result> handle;
+        handle.state = std::make_shared<typename PoolTask<Result>::State>(
+                std::packaged_task<Result()>(std::forward<F>(task)));
+        boost::asio::post(pool, [state = handle.state, account = CpuAccount::current()] {
+            CpuAccount::run(account, [&state] { state->run(); });
+        });
+        return handle;
+    }
+
+    // body(i) для i из [0, count). Вызывающий поток тоже выполняет итерации, поэтому
+    // вызов из задачи этого же пула не блокируется на занятых потоках.
+    // Первое исключение из body пробрасывается после завершения всех итераций.
+    void parallelFor(size_t count, const std::function<void(size_t)>& body);
+
+private:
+    size_t threadCount;
+    boost::asio::thread_pool pool;
+};
+
+#endif //DELTASYNC_WORKER_POOL_H
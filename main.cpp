@@ -18,12 +18,44 @@
 #include "engines/repository.h"
 #include "servers/mini_git_server.h"
 
+using deltasync::MiniGitServer;
+using deltasync::ServerOptions;
+
+// "шаблон=режим", режим — fast или max-ratio
+static std::pair<std::string, DeltaMode> parseDeltaMode(const std::string& value) {
+    size_t eq = value.rfind('=');
+    if (eq == std::string::npos || eq == 0) {
+        throw std::invalid_argument("Expected <name or pattern>=<fast|max-ratio>: " + value);
+    }
+
+    std::string mode = value.substr(eq + 1);
+    if (mode == "fast") return {value.substr(0, eq), DeltaMode::Fast};
+    if (mode == "max-ratio") return {value.substr(0, eq), DeltaMode::MaxRatio};
+    throw std::invalid_argument("Unknown delta mode: " + mode);
+}
+
+static ObjectBackend parseBackend(const std::string& value) {
+    if (value == "pack") return ObjectBackend::Pack;
+    if (value == "loose") return ObjectBackend::Loose;
+    throw std::invalid_argument("Unknown object backend: " + value);
+}
+
+static Compression parseCompression(const std::string& value) {
+    if (value == "none") return Compression::None;
+    if (value == "zlib") return Compression::Zlib;
+    if (value == "zstd") return Compression::Zstd;
+    throw std::invalid_argument("Unknown compression: " + value);
+}
+
 int main(int argc, char* argv[]) {
     try {
         int port = 8080;
 
         std::string repoPath = "./minigit_repo";
 
+        ServerOptions options;
+        bool repackOnce = false;
+
         for (int i = 1; i < argc; i++) {
             std::string arg = argv[i];
 
@@ -31,13 +63,73 @@ int main(int argc, char* argv[]) {
                 port = std::stoi(argv[++i]);
             } else if (arg == "--repo" && i + 1 < argc) {
                 repoPath = argv[++i];
+            } else if (arg == "--io-threads" && i + 1 < argc) {
+                options.ioThreads = std::stoul(argv[++i]);
+            } else if (arg == "--compute-threads" && i + 1 < argc) {
+                options.repository.workerThreads = std::stoul(argv[++i]);
+            } else if (arg == "--cache-mb" && i + 1 < argc) {
+                options.repository.cacheBytes = std::stoull(argv[++i]) << 20;
+            } else if (arg == "--delta-cache-mb" && i + 1 < argc) {
+                options.repository.deltaCacheBytes = std::stoull(argv[++i]) << 20;
+            } else if (arg == "--max-chain-depth" && i + 1 < argc) {
+                options.repository.maxChainDepth = std::stoul(argv[++i]);
+            } else if (arg == "--max-chain-ratio" && i + 1 < argc) {
+                options.repository.maxChainSizeRatio = std::stod(argv[++i]);
+            } else if (arg == "--backend" && i + 1 < argc) {
+                options.repository.objectBackend = parseBackend(argv[++i]);
+            } else if (arg == "--max-pack-mb" && i + 1 < argc) {
+                options.repository.maxPackBytes = std::stoull(argv[++i]) << 20;
+            } else if (arg == "--compression" && i + 1 < argc) {
+                options.repository.compression = parseCompression(argv[++i]);
+            } else if (arg == "--compression-level" && i + 1 < argc) {
+                options.repository.compressionLevel = std::stoi(argv[++i]);
+            } else if (arg == "--sync-metadata") {
+                options.repository.syncMetadata = true;
+            } else if (arg == "--max-in-flight" && i + 1 < argc) {
+                options.maxInFlight = std::stoul(argv[++i]);
+            } else if (arg == "--idle-timeout" && i + 1 < argc) {
+                options.idleTimeout = std::chrono::seconds(std::stoul(argv[++i]));
+            } else if (arg == "--max-upload-mb" && i + 1 < argc) {
+                options.maxUploadBytes = std::stoull(argv[++i]) << 20;
+            } else if (arg == "--stats-interval" && i + 1 < argc) {
+                options.statsInterval = std::chrono::seconds(std::stoul(argv[++i]));
+            } else if (arg == "--branch-delta-mode" && i + 1 < argc) {
+                options.branchDeltaModes.push_back(parseDeltaMode(argv[++i]));
+            } else if (arg == "--file-delta-mode" && i + 1 < argc) {
+                options.fileDeltaModes.push_back(parseDeltaMode(argv[++i]));
+            } else if (arg == "--repack") {
+                repackOnce = true;
+            } else if (arg == "--repack-interval" && i + 1 < argc) {
+                options.repackInterval = std::chrono::seconds(std::stoul(argv[++i]));
+            } else if (arg == "--repack-window" && i + 1 < argc) {
+                options.repack.window = std::stoul(argv[++i]);
+            } else if (arg == "--repack-io-mb" && i + 1 < argc) {
+                options.repack.ioBytesPerSecond = std::stoull(argv[++i]) << 20;
+            } else if (arg == "--repack-cpu" && i + 1 < argc) {
+                options.repack.cpuShare = std::stod(argv[++i]);
+            } else if (arg == "--repack-dict" && i + 1 < argc) {
+                options.repack.dictionaryExtensions.push_back(argv[++i]);
+            }
+        }
+
+        // Переупаковка без сервера: один проход и выход
+        if (repackOnce) {
+            Repository repo(repoPath, options.repository);
+            RepackStats stats = repo.repack(options.repack);
+            if (stats.dictionariesTrained > 0) {
+                std::cout << "Trained " << stats.dictionariesTrained << " compression dictionaries" << std::endl;
             }
+            std::cout << "Repacked " << stats.filesRepacked << " of " << stats.filesScanned << " files, "
+                      << stats.versionsRewritten << " versions rewritten" << std::endl;
+            std::cout << "Replaced objects: " << stats.replacedBytes << " -> " << stats.writtenBytes << " bytes, "
+                      << stats.objectsRemoved << " removed, " << stats.bytesFreed << " bytes freed" << std::endl;
+            return 0;
         }
 
         std::cout << "Starting MiniGit server on port " << port << std::endl;
         std::cout << "Repository path: " << repoPath << std::endl;
 
-        MiniGitServer server(repoPath, port);
+        MiniGitServer server(repoPath, port, options);
         server.run();
 
     } catch (const std::exception& e) {
@@ -1,36 +1,53 @@
 #ifndef DELTASYNC_FILE_VERSION_H
 #define DELTASYNC_FILE_VERSION_H
 
+#include "../engines/digest.h"
 #include <chrono>
+#include <cstdint>
 #include <string>
 #include <ostream>
 
 namespace deltasync {
 
 struct FileVersion {
-    std::string hash;          
-    std::string parentHash;    
+    Digest hash;               // ключ объекта версии (дельты или полного снимка)
+    Digest parentHash;         // пустой у первой версии
+    Digest contentHash;        // хеш восстановленного содержимого (для дельт отличается от hash)
     std::chrono::system_clock::time_point timestamp; 
     std::string author;        
     std::string message;       
     bool isDelta;              
+    bool isDeleted = false;
+    uint32_t chainDepth = 0;   // число дельт до ближайшего полного снимка
+    uint64_t chainBytes = 0;   // суммарный размер этих дельт
+    Digest objectHash;         // ключ объекта, если переупаковка заменила его; пустой — hash
+    Digest deltaBase;          // версия, от которой взята дельта, если это не parentHash
 
 
     FileVersion() = default;
 
     FileVersion(
-        std::string hash,
-        std::string parentHash,
+        Digest hash,
+        Digest parentHash,
         std::chrono::system_clock::time_point timestamp,
         std::string author,
         std::string message,
-        bool isDelta
-    ) : hash(std::move(hash)),
-        parentHash(std::move(parentHash)),
+        bool isDelta,
+        uint32_t chainDepth = 0,
+        uint64_t chainBytes = 0
+    ) : hash(hash),
+        parentHash(parentHash),
         timestamp(timestamp),
         author(std::move(author)),
         message(std::move(message)),
-        isDelta(isDelta) {}
+        isDelta(isDelta),
+        chainDepth(chainDepth),
+        chainBytes(chainBytes) {}
+
+
+    const Digest& objectKey() const { return objectHash.empty() ? hash : objectHash; }
+
+    const Digest& baseHash() const { return deltaBase.empty() ? parentHash : deltaBase; }
 
 
     friend std::ostream& operator<<(std::ostream& os, const FileVersion& version) {
@@ -42,6 +59,7 @@ struct FileVersion {
            << ", author: " << version.author
            << ", message: " << version.message
            << ", isDelta: " << (version.isDelta ? "true" : "false")
+           << ", chainDepth: " << version.chainDepth
            << "}";
         return os;
     }
@@ -1,55 +1,320 @@
 #include "mini_git_server.h"
+#include "../engines/mapped_file.h"
+#include <deque>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
 
 namespace deltasync {
 
-MiniGitServer::MiniGitServer(const std::filesystem::path& repoPath, int port)
-    : repo(repoPath),
-      acceptor(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)) {
-    
+namespace {
+
+// "DSF1" в первых байтах соединения; типы запросов одиночного режима малы и с ним не совпадают
+constexpr uint32_t kFramedMagic = 0x31465344;
+
+// Размер заголовка кадра после поля длины: id и тип запроса
+constexpr size_t kFrameHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+
+// Длина содержимого в ответе — uint32
+constexpr uint64_t kMaxResponseContent = UINT32_MAX;
+
+// Один вызов sendfile передаёт не больше этого
+constexpr size_t kSendfileStep = 1u << 30;
+
+// Буфер версии, собираемой из дельты по ходу отправки
+constexpr size_t kStreamBufferBytes = 1u << 20;
+
+size_t threadsOrCores(size_t threads) {
+    return threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Чтение полей запроса из тела кадра (порядок байт — как у одиночного режима)
+class FrameReader {
+public:
+    explicit FrameReader(std::span<const uint8_t> data) : data(data) {}
+
+    template <typename T>
+    T value() {
+        T result;
+        need(sizeof(T));
+        memcpy(&result, data.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return result;
+    }
+
+    std::string string() {
+        auto length = value<uint32_t>();
+        need(length);
+        std::string result(reinterpret_cast<const char*>(data.data() + pos), length);
+        pos += length;
+        return result;
+    }
+
+    std::vector<uint8_t> bytes() {
+        auto length = value<uint32_t>();
+        need(length);
+        std::vector<uint8_t> result(data.begin() + pos, data.begin() + pos + length);
+        pos += length;
+        return result;
+    }
+
+    // Остаток кадра без копирования
+    std::span<const uint8_t> rest() {
+        auto result = data.subspan(pos);
+        pos = data.size();
+        return result;
+    }
+
+private:
+    std::span<const uint8_t> data;
+    size_t pos = 0;
+
+    void need(size_t n) const {
+        if (n > data.size() - pos) throw std::runtime_error("Truncated request frame");
+    }
+};
+
+template <typename T>
+void appendValue(std::vector<uint8_t>& out, T value) {
+    const auto* p = reinterpret_cast<const uint8_t*>(&value);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+void appendString(std::vector<uint8_t>& out, const std::string& str) {
+    appendValue(out, static_cast<uint32_t>(str.size()));
+    out.insert(out.end(), str.begin(), str.end());
+}
+
+} // namespace
+
+struct MiniGitServer::Upload {
+    Request request;  // метаданные из SAVE_FILE_BEGIN
+    std::filesystem::path path;
+    int fd = -1;
+    uint64_t limit = 0;  // объявленный размер либо maxUploadBytes
+    bool sizeKnown = false;
+    uint64_t received = 0;
+    Sha256Hasher hasher;
+    std::string error;   // первая ошибка; сообщается в ответе на SAVE_FILE_END
+
+    ~Upload() {
+        if (fd >= 0) ::close(fd);
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+
+    // Выполняется в вычислительном пуле
+    void append(std::span<const uint8_t> data) {
+        hasher.update(data);
+
+        const uint8_t* p = data.data();
+        size_t size = data.size();
+        while (size > 0) {
+            ssize_t written = ::write(fd, p, size);
+            if (written < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error("Failed to write upload spool");
+            }
+            p += written;
+            size -= static_cast<size_t>(written);
+        }
+        received += data.size();
+    }
+};
+
+struct MiniGitServer::Connection {
+    // Готовый ответ: head ссылается на содержимое response при записи
+    struct Outgoing {
+        std::vector<uint8_t> head;
+        Response response;
+    };
+
+    explicit Connection(Socket socket)
+        : socket(std::move(socket)),
+          idleTimer(this->socket.get_executor()),
+          slotTimer(this->socket.get_executor()) {}
+
+    Socket socket;
+    boost::asio::steady_timer idleTimer;
+    boost::asio::steady_timer slotTimer;  // ожидание освободившегося места под запрос
+    std::deque<Outgoing> outbox;
+    std::vector<std::vector<uint8_t>> spareHeads;  // буферы заголовков для повторного использования
+    std::map<uint64_t, std::shared_ptr<Upload>> uploads;  // незавершённые загрузки по id
+    bool writing = false;
+    bool readerDone = false;
+    size_t inFlight = 0;
+    std::chrono::steady_clock::time_point lastActivity = std::chrono::steady_clock::now();
+
+    void close() {
+        boost::system::error_code ignored;
+        socket.close(ignored);
+        idleTimer.cancel();
+        slotTimer.cancel();
+    }
+
+    // Клиент закончил отправку, все ответы ушли
+    void closeIfDone() {
+        if (readerDone && inFlight == 0 && !writing && outbox.empty()) close();
+    }
+
+    void enqueue(Response response, uint64_t id) {
+        Outgoing outgoing;
+        if (!spareHeads.empty()) {
+            outgoing.head = std::move(spareHeads.back());
+            spareHeads.pop_back();
+        }
+        outgoing.response = std::move(response);
+        encodeResponse(outgoing.head, outgoing.response, id);
+        outbox.push_back(std::move(outgoing));
+    }
+
+    void recycle(std::vector<uint8_t>&& head) {
+        // Раздутые большой историей буферы не держим
+        if (head.capacity() <= kMaxSpareHeadBytes && spareHeads.size() < kMaxSpareHeads) {
+            spareHeads.push_back(std::move(head));
+        }
+    }
+
+    static constexpr size_t kMaxSpareHeadBytes = 1u << 20;
+    static constexpr size_t kMaxSpareHeads = 16;
+};
+
+MiniGitServer::MiniGitServer(const std::filesystem::path& repoPath, int port, ServerOptions options)
+    : repo(repoPath, options.repository),
+      options(options),
+      io_context(static_cast<int>(threadsOrCores(options.ioThreads))),
+      acceptor(io_context, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port)),
+      uploadDir(options.uploadDir.empty() ? repoPath / "uploads" : options.uploadDir),
+      statsTimer(io_context) {
+
+    // Принятый файл должен помещаться в ответ GET_LATEST/GET_VERSION
+    this->options.maxUploadBytes = std::min(options.maxUploadBytes, kMaxResponseContent);
+
+    for (const auto& [branch, mode] : options.branchDeltaModes) {
+        repo.setBranchDeltaMode(branch, mode);
+    }
+    for (const auto& [fileName, mode] : options.fileDeltaModes) {
+        repo.setFileDeltaMode(fileName, mode);
+    }
+
+    // Незавершённые загрузки прошлого запуска продолжить нельзя
+    std::filesystem::remove_all(uploadDir);
+    std::filesystem::create_directories(uploadDir);
+
     startAccept();
+    if (options.statsInterval.count() > 0) {
+        boost::asio::co_spawn(io_context, statsLoop(), boost::asio::detached);
+    }
 }
 
 void MiniGitServer::run() {
-    std::cout << "MiniGit server started on port " << acceptor.local_endpoint().port() << std::endl;
-    running = true;
+    size_t threads = threadsOrCores(options.ioThreads);
+    std::cout << "MiniGit server started on port " << acceptor.local_endpoint().port()
+              << " (" << threads << " io threads, " << repo.workerPool().size() << " compute threads)"
+              << std::endl;
+
+    if (options.repackInterval.count() > 0) {
+        repackThread = std::thread([this] { repackLoop(); });
+    }
+
+    for (size_t i = 1; i < threads; i++) {
+        io_threads.emplace_back([this] { io_context.run(); });
+    }
     io_context.run();
+
+    for (auto& thread : io_threads) {
+        thread.join();
+    }
+    io_threads.clear();
+
+    if (repackThread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(repackMutex);
+            repackCancel = true;
+        }
+        repackWake.notify_all();
+        repackThread.join();
+    }
+
+    std::cout << "MiniGit server stopped" << std::endl;
 }
 
 void MiniGitServer::stop() {
     running = false;
+    {
+        std::lock_guard<std::mutex> lock(repackMutex);
+        repackCancel = true;
+    }
+    repackWake.notify_all();
+    boost::asio::post(io_context, [this] {
+        boost::system::error_code ignored;
+        acceptor.close(ignored);
+        statsTimer.cancel();
+    });
     io_context.stop();
-    
-    for (auto& thread : worker_threads) {
-        if (thread.joinable()) {
-            thread.join();
+}
+
+// Переупаковка идёт в своём потоке, а не в вычислительном пуле: она долгая и ограничена
+// собственным бюджетом, запросы клиентов её не ждут
+void MiniGitServer::repackLoop() {
+    std::unique_lock<std::mutex> lock(repackMutex);
+    while (!repackWake.wait_for(lock, options.repackInterval, [this] { return repackCancel.load(); })) {
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        try {
+            RepackStats stats = repo.repack(options.repack, &repackCancel);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Repack: " << stats.filesRepacked << " of " << stats.filesScanned << " files, "
+                      << stats.versionsRewritten << " versions rewritten, " << stats.replacedBytes << " -> "
+                      << stats.writtenBytes << " bytes of objects, " << stats.objectsRemoved << " objects removed, "
+                      << stats.bytesFreed << " bytes freed in " << seconds << " s" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Repack failed: " << e.what() << std::endl;
         }
+
+        lock.lock();
+    }
+}
+
+boost::asio::awaitable<void> MiniGitServer::statsLoop() {
+    while (running) {
+        statsTimer.expires_after(options.statsInterval);
+        boost::system::error_code error;
+        co_await statsTimer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, error));
+        if (error || !running) break;
+
+        ContentCache::Stats stats = repo.cacheStats();
+        uint64_t lookups = stats.hits + stats.misses;
+        std::cout << "Cache: " << stats.hits << " hits, " << stats.misses << " misses ("
+                  << (lookups ? 100 * stats.hits / lookups : 0) << "% hit rate), " << stats.evictions
+                  << " evictions, " << stats.bytes << " bytes in " << stats.entries << " entries" << std::endl;
     }
-    worker_threads.clear();
-    
-    std::cout << "MiniGit server stopped" << std::endl;
 }
 
 void MiniGitServer::startAccept() {
-    auto socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context);
-    
-    acceptor.async_accept(*socket, [this, socket](const boost::system::error_code& error) {
-        if (!error && running) {
-            auto thread = std::thread(&MiniGitServer::handleClient, this, socket);
-            
-            worker_threads.push_back(std::move(thread));
+    boost::asio::co_spawn(io_context, acceptLoop(), boost::asio::detached);
+}
 
-            if (worker_threads.back().joinable()) {
-                worker_threads.back().detach();
-            }
-        }
+boost::asio::awaitable<void> MiniGitServer::acceptLoop() {
+    while (running) {
+        // У каждого соединения свой strand: в кадровом режиме с сокетом работают несколько корутин
+        boost::system::error_code error;
+        Socket socket = co_await acceptor.async_accept(boost::asio::make_strand(io_context),
+                                                       boost::asio::redirect_error(boost::asio::use_awaitable, error));
 
-        if (running) {
-            startAccept();
+        if (error == boost::asio::error::operation_aborted || !acceptor.is_open()) {
+            break;
         }
-    });
+        if (!error && running) {
+            // Соединение — корутина на пуле io_context, без собственного потока
+            auto executor = socket.get_executor();
+            boost::asio::co_spawn(executor, handleClient(std::move(socket)), boost::asio::detached);
+        }
+    }
 }
 
-Response MiniGitServer::processRequest(const Request& request) {
+MiniGitServer::Response MiniGitServer::processRequest(const Request& request) {
     Response response;
     
     try {
@@ -60,27 +325,111 @@ Response MiniGitServer::processRequest(const Request& request) {
                     request.content,
                     request.author, 
                     request.message, 
-                    request.branch
+                    request.branch,
+                    std::nullopt,
+                    request.contentHash
                 );
                 response.success = true;
                 response.message = "File saved with hash: " + hash;
                 break;
             }
                 
+            case RequestType::SAVE_DELTA: {
+                // content — дельта от baseHash
+                auto hash = repo.saveFileDelta(request.fileName, request.content, request.author, request.message,
+                                               request.branch, request.baseHash, *request.contentHash);
+                if (hash) {
+                    response.success = true;
+                    response.message = "File saved with hash: " + *hash;
+                } else {
+                    response.message = "Base version is not the branch tip; send the full file";
+                }
+                break;
+            }
+
+            case RequestType::SAVE_BATCH: {
+                std::vector<Repository::BatchFile> files;
+                files.reserve(request.files.size());
+                for (const auto& entry : request.files) {
+                    files.push_back({entry.fileName, entry.content, std::nullopt});
+                }
+
+                auto batch = repo.saveBatch(files, request.author, request.message, request.branch);
+                response.success = batch.committed;
+                response.message = batch.committed ? "Committed " + std::to_string(files.size()) +
+                                                     " files to branch " + batch.branch
+                                                   : "Batch rejected; no files were committed";
+                response.batch = std::move(batch.files);
+                break;
+            }
+
             case RequestType::GET_LATEST: {
-                response.content = repo.getLatestVersion(request.fileName, request.branch);
+                std::string hash = repo.getCurrentVersionHash(request.fileName, request.branch);
+                response.content = openContent(request.fileName, hash);
                 response.success = true;
                 response.message = "Latest version retrieved";
                 break;
             }
                 
             case RequestType::GET_VERSION: {
-                response.content = repo.getFileContent(request.fileName, request.version);
+                response.content = openContent(request.fileName, request.version);
                 response.success = true;
                 response.message = "Version retrieved";
                 break;
             }
                 
+            case RequestType::GET_DELTA: {
+                auto download = repo.getLatestDelta(request.fileName, request.branch, request.baseHash);
+                response.delta = DeltaHeader{download.delta != nullptr, download.versionHash,
+                                             download.contentHash.hex()};
+                if (download.delta) {
+                    auto source = std::make_shared<Repository::ContentSource>();
+                    source->size = download.delta->size();
+                    source->content = std::move(download.delta);
+                    response.content = std::move(source);
+                    response.message = "Delta retrieved";
+                } else {
+                    response.content = openContent(request.fileName, download.versionHash);
+                    response.message = "Latest version retrieved";
+                }
+                response.success = true;
+                break;
+            }
+
+            case RequestType::GET_MANIFEST: {
+                auto manifest = repo.getChunkManifest(request.fileName, request.version);
+                response.manifest = ManifestHeader{manifest.has_value(),
+                                                   manifest ? std::move(*manifest) : ChunkManifest{}};
+                response.success = true;
+                response.message = manifest ? "Chunk manifest retrieved" : "Version is not stored as chunks";
+                break;
+            }
+
+            case RequestType::GET_CHUNKS: {
+                std::vector<Digest> hashes;
+                uint64_t total = 0;
+                for (const auto& chunk : request.chunks) {
+                    hashes.push_back(chunk.hash);
+                    total += chunk.length;
+                }
+                auto missing = repo.findMissingChunks(hashes);
+                if (!missing.empty()) {
+                    throw std::runtime_error("Unknown chunk: " + missing.front().hex());
+                }
+                if (total > kMaxResponseContent) {
+                    throw std::runtime_error("Requested chunks exceed the response limit");
+                }
+
+                // Куски читаются по одному при отправке; длина сверяется с запрошенной
+                auto source = std::make_shared<Repository::ContentSource>();
+                source->size = total;
+                source->chunks = request.chunks;
+                response.content = std::move(source);
+                response.success = true;
+                response.message = "Chunks retrieved";
+                break;
+            }
+
             case RequestType::GET_BRANCHES: {
                 response.branches = repo.getBranches();
                 response.success = true;
@@ -94,6 +443,11 @@ Response MiniGitServer::processRequest(const Request& request) {
                 response.message = "History retrieved";
                 break;
             }
+
+            default:
+                // Загрузки по частям обрабатываются соединением, не здесь
+                response.message = "Unsupported request type";
+                break;
         }
     } catch (const std::exception& e) {
         response.success = false;
@@ -103,137 +457,757 @@ Response MiniGitServer::processRequest(const Request& request) {
     return response;
 }
 
-void MiniGitServer::handleClient(std::shared_ptr<boost::asio::ip::tcp::socket> socket) {
+std::shared_ptr<const Repository::ContentSource> MiniGitServer::openContent(const std::string& fileName,
+                                                                            const std::string& hash) {
+    auto source = std::make_shared<Repository::ContentSource>(repo.openFileContent(fileName, hash));
+    if (source->size > kMaxResponseContent) {
+        throw std::runtime_error("File of " + std::to_string(source->size) + " bytes exceeds the response limit");
+    }
+    return source;
+}
+
+boost::asio::awaitable<void> MiniGitServer::handleClient(Socket socket) {
+    std::optional<std::string> failure;
+    bool responding = false;
     try {
         uint32_t requestTypeInt;
-        boost::asio::read(*socket, boost::asio::buffer(&requestTypeInt, sizeof(requestTypeInt)));
+        co_await boost::asio::async_read(socket, boost::asio::buffer(&requestTypeInt, sizeof(requestTypeInt)),
+                                         boost::asio::use_awaitable);
+
+        if (requestTypeInt == kFramedMagic) {
+            co_await serveFramed(std::make_shared<Connection>(std::move(socket)));
+            co_return;
+        }
+
         RequestType requestType = static_cast<RequestType>(requestTypeInt);
 
         Request request;
         request.type = requestType;
 
         switch (requestType) {
-            case RequestType::SAVE_FILE:
-                readString(*socket, request.fileName);
-                readString(*socket, request.branch);
-                readString(*socket, request.author);
-                readString(*socket, request.message);
-                readBinaryData(*socket, request.content);
+            case RequestType::SAVE_FILE: {
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.branch);
+                co_await readString(socket, request.author);
+                co_await readString(socket, request.message);
+
+                Sha256Hasher hasher;
+                co_await readBinaryData(socket, request.content, &hasher);
+                request.contentHash = hasher.finish();
                 break;
+            }
 
             case RequestType::GET_LATEST:
-                readString(*socket, request.fileName);
-                readString(*socket, request.branch);
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.branch);
                 break;
 
             case RequestType::GET_VERSION:
-                readString(*socket, request.fileName);
-                readString(*socket, request.version);
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.version);
                 break;
 
             case RequestType::GET_BRANCHES:
                 break;
 
             case RequestType::GET_HISTORY:
-                readString(*socket, request.fileName);
+                co_await readString(socket, request.fileName);
+                break;
+
+            case RequestType::GET_DELTA:
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.branch);
+                co_await readString(socket, request.baseHash);
+                break;
+
+            case RequestType::GET_MANIFEST:
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.version);
+                break;
+
+            case RequestType::GET_CHUNKS: {
+                uint32_t count;
+                co_await boost::asio::async_read(socket, boost::asio::buffer(&count, sizeof(count)),
+                                                 boost::asio::use_awaitable);
+                for (uint32_t i = 0; i < count; i++) {
+                    std::string hash;
+                    ChunkManifest::Entry chunk;
+                    co_await readString(socket, hash);
+                    co_await boost::asio::async_read(socket, boost::asio::buffer(&chunk.length, sizeof(chunk.length)),
+                                                     boost::asio::use_awaitable);
+                    chunk.hash = Digest::fromHex(hash);
+                    request.chunks.push_back(chunk);
+                }
+                break;
+            }
+
+            case RequestType::SAVE_DELTA: {
+                co_await readString(socket, request.fileName);
+                co_await readString(socket, request.branch);
+                co_await readString(socket, request.author);
+                co_await readString(socket, request.message);
+                co_await readString(socket, request.baseHash);
+
+                std::string contentHash;
+                co_await readString(socket, contentHash);
+                request.contentHash = Digest::fromHex(contentHash);
+                co_await readBinaryData(socket, request.content);
+                break;
+            }
+
+            case RequestType::SAVE_BATCH: {
+                co_await readString(socket, request.branch);
+                co_await readString(socket, request.author);
+                co_await readString(socket, request.message);
+
+                uint32_t count;
+                co_await boost::asio::async_read(socket, boost::asio::buffer(&count, sizeof(count)),
+                                                 boost::asio::use_awaitable);
+                // Весь пакет ограничен так же, как один кадр
+                uint64_t total = 0;
+                for (uint32_t i = 0; i < count; i++) {
+                    BatchEntry entry;
+                    co_await readString(socket, entry.fileName);
+                    co_await readBinaryData(socket, entry.content);
+                    total += entry.fileName.size() + entry.content.size();
+                    if (total > options.maxFrameBytes) {
+                        throw std::runtime_error("Batch exceeds " + std::to_string(options.maxFrameBytes) + " bytes");
+                    }
+                    request.files.push_back(std::move(entry));
+                }
                 break;
+            }
+
+            default:
+                throw std::runtime_error("Request type requires framed mode");
         }
 
-        Response response = processRequest(request);
+        Response response = co_await execute(request);
 
-        sendResponse(*socket, response);
+        responding = true;
+        co_await sendResponse(socket, response);
 
     } catch (const std::exception& e) {
         std::cerr << "Error handling client: " << e.what() << std::endl;
-        
+        failure = e.what();
+    }
+
+    // co_await внутри catch недопустим — ответ об ошибке отправляется после него.
+    // Сбой посреди отправленного ответа клиент увидит как обрыв соединения.
+    if (failure && !responding) {
         try {
             Response errorResponse;
             errorResponse.success = false;
-            errorResponse.message = "Server error: " + std::string(e.what());
-            sendResponse(*socket, errorResponse);
+            errorResponse.message = "Server error: " + *failure;
+            co_await sendResponse(socket, errorResponse);
         } catch (...) {
         }
     }
+
+    boost::system::error_code ignored;
+    socket.close(ignored);
+}
+
+// Запрос выполняется в вычислительном пуле; корутина продолжится на исполнителе соединения
+boost::asio::awaitable<MiniGitServer::Response> MiniGitServer::execute(const Request& request) {
+    Response response = co_await boost::asio::co_spawn(
+            repo.workerPool().executor(),
+            [this, &request]() -> Awaitable<Response> { co_return processRequest(request); },
+            boost::asio::use_awaitable);
+    co_return response;
+}
+
+// Чтение кадров; каждый запрос выполняется отдельной корутиной, поэтому медленный
+// запрос не задерживает ответы на следующие
+boost::asio::awaitable<void> MiniGitServer::serveFramed(std::shared_ptr<Connection> connection) {
+    auto executor = co_await boost::asio::this_coro::executor;
+    boost::asio::co_spawn(executor, idleWatchdog(connection), boost::asio::detached);
+
     try {
-        socket->close();
-    } catch (...) {
+        std::vector<uint8_t> frame;
+        while (running) {
+            // Предел запросов в работе: сокет не читается, клиент упирается в окно TCP
+            while (connection->inFlight >= options.maxInFlight && connection->socket.is_open()) {
+                connection->slotTimer.expires_at(std::chrono::steady_clock::time_point::max());
+                boost::system::error_code ignored;
+                co_await connection->slotTimer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable,
+                                                                                      ignored));
+            }
+            if (!connection->socket.is_open()) break;
+
+            uint32_t length;
+            co_await boost::asio::async_read(connection->socket, boost::asio::buffer(&length, sizeof(length)),
+                                             boost::asio::use_awaitable);
+            if (length < kFrameHeaderSize || length > options.maxFrameBytes) {
+                throw std::runtime_error("Invalid frame length: " + std::to_string(length));
+            }
+
+            frame.resize(length);
+            co_await boost::asio::async_read(connection->socket, boost::asio::buffer(frame),
+                                             boost::asio::use_awaitable);
+            connection->lastActivity = std::chrono::steady_clock::now();
+
+            // Части загрузки пишутся по порядку, до чтения следующего кадра
+            uint32_t frameType;
+            memcpy(&frameType, frame.data() + sizeof(uint64_t), sizeof(frameType));
+            if (static_cast<RequestType>(frameType) == RequestType::SAVE_FILE_CHUNK) {
+                co_await receiveChunk(connection, frame);
+                continue;
+            }
+
+            Request request;
+            try {
+                request = decodeRequest(frame);
+            } catch (const std::exception& e) {
+                // Границы кадра известны — соединение остаётся рабочим
+                Response errorResponse;
+                errorResponse.message = "Bad request: " + std::string(e.what());
+                uint64_t id;
+                memcpy(&id, frame.data(), sizeof(id));
+                postResponse(connection, std::move(errorResponse), id);
+                continue;
+            }
+
+            if (request.type == RequestType::SAVE_FILE_BEGIN) {
+                startUpload(connection, request);
+                continue;
+            }
+
+            connection->inFlight++;
+            boost::asio::co_spawn(executor, runFramedRequest(connection, std::move(request)), boost::asio::detached);
+        }
+    } catch (const boost::system::system_error& e) {
+        if (e.code() != boost::asio::error::eof && e.code() != boost::asio::error::operation_aborted) {
+            std::cerr << "Error reading request frame: " << e.what() << std::endl;
+        }
+    } catch (const std::exception& e) {
+        // Неверная длина кадра: дальнейший поток не разобрать
+        std::cerr << "Error reading request frame: " << e.what() << std::endl;
+        connection->close();
     }
+
+    // Ответы на уже принятые запросы досылаются, затем соединение закрывается
+    connection->readerDone = true;
+    connection->closeIfDone();
 }
 
-void MiniGitServer::readString(boost::asio::ip::tcp::socket& socket, std::string& str) {
-    uint32_t length;
-    boost::asio::read(socket, boost::asio::buffer(&length, sizeof(length)));
+boost::asio::awaitable<void> MiniGitServer::runFramedRequest(std::shared_ptr<Connection> connection,
+                                                             Request request) {
+    // co_await внутри условного выражения GCC 12 компилирует неверно
+    Response response;
+    if (request.type == RequestType::SAVE_FILE_END) {
+        response = co_await finishUpload(connection, request);
+    } else {
+        response = co_await execute(request);
+    }
 
-    str.resize(length);
-    if (length > 0) {
-        boost::asio::read(socket, boost::asio::buffer(str.data(), length));
+    connection->enqueue(std::move(response), request.id);
+    connection->inFlight--;
+    connection->slotTimer.cancel();
+
+    if (!connection->writing) {
+        connection->writing = true;
+        co_await flushResponses(connection);
     }
 }
 
-void MiniGitServer::readBinaryData(boost::asio::ip::tcp::socket& socket, std::vector<uint8_t>& data) {
-    uint32_t length;
-    boost::asio::read(socket, boost::asio::buffer(&length, sizeof(length)));
+boost::asio::awaitable<void> MiniGitServer::flushResponses(std::shared_ptr<Connection> connection) {
+    // Все готовые к этому моменту ответы уходят одной векторной записью
+    std::vector<Connection::Outgoing> batch;
+    std::vector<boost::asio::const_buffer> buffers;
 
-    data.resize(length);
-    if (length > 0) {
-        boost::asio::read(socket, boost::asio::buffer(data.data(), length));
+    while (!connection->outbox.empty() && connection->socket.is_open()) {
+        batch.clear();
+        buffers.clear();
+        // Ответ с содержимым из файла хранилища замыкает пакет: тело идёт за его заголовком
+        while (!connection->outbox.empty()) {
+            batch.push_back(std::move(connection->outbox.front()));
+            connection->outbox.pop_front();
+            if (hasFileContent(batch.back().response)) break;
+        }
+        for (const auto& outgoing : batch) {
+            appendResponseBuffers(buffers, outgoing.head, outgoing.response);
+        }
+
+        boost::system::error_code error;
+        co_await boost::asio::async_write(connection->socket, buffers,
+                                          boost::asio::redirect_error(boost::asio::use_awaitable, error));
+
+        const Response& last = batch.back().response;
+        bool failed = static_cast<bool>(error);
+        if (!failed && hasFileContent(last)) {
+            try {
+                co_await sendFileContent(connection->socket, *last.content);
+            } catch (const std::exception& e) {
+                // Кадр уже начат — продолжить поток ответов нельзя
+                std::cerr << "Error sending file content: " << e.what() << std::endl;
+                failed = true;
+            }
+        }
+        if (failed) {
+            connection->outbox.clear();
+            connection->close();
+            break;
+        }
+        connection->lastActivity = std::chrono::steady_clock::now();
+
+        for (auto& outgoing : batch) {
+            connection->recycle(std::move(outgoing.head));
+        }
     }
+
+    connection->writing = false;
+    connection->closeIfDone();
 }
 
-void MiniGitServer::writeString(boost::asio::ip::tcp::socket& socket, const std::string& str) {
-    uint32_t length = static_cast<uint32_t>(str.size());
-    boost::asio::write(socket, boost::asio::buffer(&length, sizeof(length)));
-    
-    if (length > 0) {
-        boost::asio::write(socket, boost::asio::buffer(str.data(), str.size()));
+// Соединение без запросов в работе закрывается после idleTimeout без чтения и записи
+boost::asio::awaitable<void> MiniGitServer::idleWatchdog(std::shared_ptr<Connection> connection) {
+    while (connection->socket.is_open()) {
+        connection->idleTimer.expires_at(connection->lastActivity + options.idleTimeout);
+
+        boost::system::error_code ignored;
+        co_await connection->idleTimer.async_wait(boost::asio::redirect_error(boost::asio::use_awaitable, ignored));
+
+        bool busy = connection->inFlight > 0 || connection->writing;
+        if (!busy && std::chrono::steady_clock::now() >= connection->lastActivity + options.idleTimeout) {
+            connection->close();
+        }
     }
 }
 
-void MiniGitServer::writeBinaryData(boost::asio::ip::tcp::socket& socket, const std::vector<uint8_t>& data) {
-    uint32_t length = static_cast<uint32_t>(data.size());
-    boost::asio::write(socket, boost::asio::buffer(&length, sizeof(length)));
-    
-    if (length > 0) {
-        boost::asio::write(socket, boost::asio::buffer(data.data(), data.size()));
+void MiniGitServer::postResponse(const std::shared_ptr<Connection>& connection, Response response, uint64_t id) {
+    connection->enqueue(std::move(response), id);
+    if (!connection->writing) {
+        // Флаг ставится до запуска: co_spawn лишь планирует корутину, и до её старта
+        // другой запрос не должен начать вторую запись в сокет
+        connection->writing = true;
+        boost::asio::co_spawn(connection->socket.get_executor(), flushResponses(connection), boost::asio::detached);
+    }
+}
+
+void MiniGitServer::startUpload(const std::shared_ptr<Connection>& connection, const Request& request) {
+    Response response;
+    bool sizeKnown = request.totalSize != UINT64_MAX;
+
+    if (sizeKnown && request.totalSize > options.maxUploadBytes) {
+        response.message = "Upload exceeds the maximum size of " + std::to_string(options.maxUploadBytes) + " bytes";
+    } else if (connection->uploads.size() >= options.maxInFlight) {
+        response.message = "Too many concurrent uploads";
+    } else {
+        auto upload = std::make_shared<Upload>();
+        upload->request = request;
+        upload->limit = sizeKnown ? request.totalSize : options.maxUploadBytes;
+        upload->sizeKnown = sizeKnown;
+        upload->path = uploadDir / ("upload-" + std::to_string(uploadCounter.fetch_add(1)) + ".part");
+        upload->fd = ::open(upload->path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+        if (upload->fd < 0) {
+            response.message = "Failed to create upload spool";
+        } else {
+            connection->uploads[request.id] = std::move(upload);
+            response.success = true;
+            response.message = "Upload started";
+        }
+    }
+
+    postResponse(connection, std::move(response), request.id);
+}
+
+boost::asio::awaitable<void> MiniGitServer::receiveChunk(std::shared_ptr<Connection> connection,
+                                                         std::span<const uint8_t> frame) {
+    FrameReader in(frame);
+    uint64_t id = in.value<uint64_t>();
+    in.value<uint32_t>();
+
+    std::shared_ptr<Upload> upload;
+    std::string error;
+    if (frame.size() < kFrameHeaderSize + sizeof(uint64_t)) {
+        error = "Truncated upload chunk";
+    } else if (auto it = connection->uploads.find(in.value<uint64_t>()); it == connection->uploads.end()) {
+        error = "Unknown upload";
+    } else {
+        upload = it->second;
+    }
+
+    std::span<const uint8_t> data = in.rest();
+    if (upload) {
+        // После первой ошибки части молча отбрасываются до SAVE_FILE_END
+        if (!upload->error.empty()) co_return;
+
+        if (data.size() > upload->limit - upload->received) {
+            upload->error = upload->sizeKnown ? "Upload is larger than declared"
+                                              : "Upload exceeds the maximum size of " +
+                                                std::to_string(options.maxUploadBytes) + " bytes";
+            error = upload->error;
+        } else {
+            try {
+                co_await boost::asio::co_spawn(
+                        repo.workerPool().executor(),
+                        [&upload, data]() -> Awaitable<void> {
+                            upload->append(data);
+                            co_return;
+                        },
+                        boost::asio::use_awaitable);
+            } catch (const std::exception& e) {
+                upload->error = e.what();
+                error = upload->error;
+            }
+        }
+    }
+
+    if (!error.empty()) {
+        Response response;
+        response.message = error;
+        postResponse(connection, std::move(response), id);
+    }
+}
+
+boost::asio::awaitable<MiniGitServer::Response> MiniGitServer::finishUpload(std::shared_ptr<Connection> connection,
+                                                                           const Request& request) {
+    Response response;
+
+    auto it = connection->uploads.find(request.uploadId);
+    if (it == connection->uploads.end()) {
+        response.message = "Unknown upload";
+        co_return response;
+    }
+    std::shared_ptr<Upload> upload = std::move(it->second);
+    connection->uploads.erase(it);
+
+    if (!upload->error.empty()) {
+        response.message = upload->error;
+        co_return response;
+    }
+    if (upload->sizeKnown && upload->received != upload->limit) {
+        response.message = "Upload is smaller than declared";
+        co_return response;
+    }
+
+    // Захват по значению в лямбде-корутине GCC 12 разрушает дважды — только ссылки
+    response = co_await boost::asio::co_spawn(
+            repo.workerPool().executor(),
+            [this, &upload, &request]() -> Awaitable<Response> { co_return saveUpload(*upload, request.version); },
+            boost::asio::use_awaitable);
+    co_return response;
+}
+
+// Сохранение из отображённого временного файла: в память процесса файл не копируется
+MiniGitServer::Response MiniGitServer::saveUpload(Upload& upload, const std::string& expectedHash) {
+    Response response;
+    try {
+        Digest contentHash = upload.hasher.finish();
+        if (!expectedHash.empty() && Digest::fromHex(expectedHash) != contentHash) {
+            throw std::runtime_error("Upload hash mismatch");
+        }
+
+        ::close(upload.fd);
+        upload.fd = -1;
+        auto spool = upload.received ? MappedFile::open(upload.path) : nullptr;
+        std::span<const uint8_t> content = spool ? spool->bytes() : std::span<const uint8_t>();
+
+        const Request& meta = upload.request;
+        std::string hash = repo.saveFile(meta.fileName, content, meta.author, meta.message, meta.branch,
+                                         std::nullopt, contentHash);
+        response.success = true;
+        response.message = "File saved with hash: " + hash;
+    } catch (const std::exception& e) {
+        response.message = e.what();
     }
+    return response;
 }
 
-void MiniGitServer::sendResponse(boost::asio::ip::tcp::socket& socket, const Response& response) {
-    uint8_t success = response.success ? 1 : 0;
-    boost::asio::write(socket, boost::asio::buffer(&success, sizeof(success)));
+MiniGitServer::Request MiniGitServer::decodeRequest(std::span<const uint8_t> frame) {
+    FrameReader in(frame);
+
+    Request request;
+    request.id = in.value<uint64_t>();
+    request.type = static_cast<RequestType>(in.value<uint32_t>());
+
+    switch (request.type) {
+        case RequestType::SAVE_FILE:
+            request.fileName = in.string();
+            request.branch = in.string();
+            request.author = in.string();
+            request.message = in.string();
+            request.content = in.bytes();
+            break;
+
+        case RequestType::SAVE_BATCH: {
+            request.branch = in.string();
+            request.author = in.string();
+            request.message = in.string();
+            uint32_t count = in.value<uint32_t>();
+            for (uint32_t i = 0; i < count; i++) {
+                BatchEntry entry;
+                entry.fileName = in.string();
+                entry.content = in.bytes();
+                request.files.push_back(std::move(entry));
+            }
+            break;
+        }
+
+        case RequestType::GET_LATEST:
+            request.fileName = in.string();
+            request.branch = in.string();
+            break;
 
-    writeString(socket, response.message);
+        case RequestType::GET_VERSION:
+            request.fileName = in.string();
+            request.version = in.string();
+            break;
 
+        case RequestType::GET_BRANCHES:
+            break;
+
+        case RequestType::GET_HISTORY:
+            request.fileName = in.string();
+            break;
+
+        case RequestType::SAVE_FILE_BEGIN:
+            request.fileName = in.string();
+            request.branch = in.string();
+            request.author = in.string();
+            request.message = in.string();
+            request.totalSize = in.value<uint64_t>();
+            break;
+
+        case RequestType::SAVE_FILE_END:
+            request.uploadId = in.value<uint64_t>();
+            request.version = in.string();  // ожидаемый хеш содержимого
+            break;
+
+        case RequestType::GET_DELTA:
+            request.fileName = in.string();
+            request.branch = in.string();
+            request.baseHash = in.string();
+            break;
+
+        case RequestType::SAVE_DELTA:
+            request.fileName = in.string();
+            request.branch = in.string();
+            request.author = in.string();
+            request.message = in.string();
+            request.baseHash = in.string();
+            request.contentHash = Digest::fromHex(in.string());
+            request.content = in.bytes();
+            break;
+
+        case RequestType::GET_MANIFEST:
+            request.fileName = in.string();
+            request.version = in.string();
+            break;
+
+        case RequestType::GET_CHUNKS: {
+            uint32_t count = in.value<uint32_t>();
+            for (uint32_t i = 0; i < count; i++) {
+                ChunkManifest::Entry chunk;
+                chunk.hash = Digest::fromHex(in.string());
+                chunk.length = in.value<uint64_t>();
+                request.chunks.push_back(chunk);
+            }
+            break;
+        }
+
+        default:
+            throw std::runtime_error("Unknown request type");
+    }
+
+    return request;
+}
+
+void MiniGitServer::encodeResponse(std::vector<uint8_t>& head, const Response& response,
+                                   std::optional<uint64_t> frameId) {
+    head.clear();
+    if (frameId) {
+        appendValue(head, uint32_t{0});  // длина кадра, заполняется в конце
+        appendValue(head, *frameId);
+    }
+
+    appendValue(head, static_cast<uint8_t>(response.success ? 1 : 0));
+    appendString(head, response.message);
+
+    if (response.batch) {
+        appendValue(head, static_cast<uint32_t>(response.batch->size()));
+        for (const auto& file : *response.batch) {
+            bool saved = file.error.empty();
+            appendValue(head, static_cast<uint8_t>(saved ? 1 : 0));
+            appendString(head, saved ? file.hash : file.error);
+        }
+    }
+
+    uint64_t payloadBytes = 0;
     if (response.success) {
-        if (!response.content.empty()) {
-            writeBinaryData(socket, response.content);
-        } 
-        else if (!response.branches.empty()) {
-            uint32_t count = static_cast<uint32_t>(response.branches.size());
-            boost::asio::write(socket, boost::asio::buffer(&count, sizeof(count)));
+        if (response.delta) {
+            appendValue(head, static_cast<uint8_t>(response.delta->isDelta ? 1 : 0));
+            appendString(head, response.delta->versionHash);
+            appendString(head, response.delta->contentHash);
+        }
 
-            for (const auto& branch : response.branches) {
-                writeString(socket, branch);
+        if (response.manifest) {
+            appendValue(head, static_cast<uint8_t>(response.manifest->chunked ? 1 : 0));
+            if (response.manifest->chunked) {
+                const ChunkManifest& manifest = response.manifest->manifest;
+                appendValue(head, manifest.totalSize);
+                appendValue(head, static_cast<uint32_t>(manifest.chunks.size()));
+                for (const auto& chunk : manifest.chunks) {
+                    appendString(head, chunk.hash.hex());
+                    appendValue(head, chunk.length);
+                }
             }
-        } 
-        else if (!response.history.empty()) {
-            uint32_t count = static_cast<uint32_t>(response.history.size());
-            boost::asio::write(socket, boost::asio::buffer(&count, sizeof(count)));
+        }
 
+        uint64_t contentSize = response.content ? response.content->size : 0;
+        // Пустой файл в GET_LATEST/GET_VERSION исторически передаётся без поля длины
+        if (contentSize > 0 || response.delta) {
+            appendValue(head, static_cast<uint32_t>(contentSize));
+            payloadBytes = contentSize;
+        } else if (!response.branches.empty()) {
+            appendValue(head, static_cast<uint32_t>(response.branches.size()));
+            for (const auto& branch : response.branches) {
+                appendString(head, branch);
+            }
+        } else if (!response.history.empty()) {
+            appendValue(head, static_cast<uint32_t>(response.history.size()));
             for (const auto& version : response.history) {
-                writeString(socket, version.hash);
-                writeString(socket, version.parentHash);
+                appendString(head, version.hash.hex());
+                appendString(head, version.parentHash.empty() ? std::string() : version.parentHash.hex());
+                appendValue(head, std::chrono::system_clock::to_time_t(version.timestamp));
+                appendString(head, version.author);
+                appendString(head, version.message);
+                appendValue(head, static_cast<uint8_t>(version.isDelta ? 1 : 0));
+            }
+        }
+    }
+
+    if (frameId) {
+        uint32_t length = static_cast<uint32_t>(head.size() - sizeof(uint32_t) + payloadBytes);
+        memcpy(head.data(), &length, sizeof(length));
+    }
+}
+
+void MiniGitServer::appendResponseBuffers(std::vector<boost::asio::const_buffer>& buffers,
+                                          const std::vector<uint8_t>& head, const Response& response) {
+    buffers.push_back(boost::asio::buffer(head));
+    if (response.success && response.content && response.content->content) {
+        buffers.push_back(boost::asio::buffer(*response.content->content));
+    }
+}
+
+bool MiniGitServer::hasFileContent(const Response& response) {
+    return response.success && response.content && !response.content->content && response.content->size > 0;
+}
+
+boost::asio::awaitable<void> MiniGitServer::readString(Socket& socket, std::string& str) {
+    uint32_t length;
+    co_await boost::asio::async_read(socket, boost::asio::buffer(&length, sizeof(length)), boost::asio::use_awaitable);
+
+    str.resize(length);
+    if (length > 0) {
+        co_await boost::asio::async_read(socket, boost::asio::buffer(str.data(), length), boost::asio::use_awaitable);
+    }
+}
+
+boost::asio::awaitable<void> MiniGitServer::readBinaryData(Socket& socket, std::vector<uint8_t>& data,
+                                                           Sha256Hasher* hasher) {
+    uint32_t length;
+    co_await boost::asio::async_read(socket, boost::asio::buffer(&length, sizeof(length)), boost::asio::use_awaitable);
+    if (length > options.maxFrameBytes) {
+        throw std::runtime_error("Content exceeds " + std::to_string(options.maxFrameBytes) +
+                                 " bytes; use a chunked upload");
+    }
+
+    data.resize(length);
+    if (!hasher) {
+        if (length > 0) {
+            co_await boost::asio::async_read(socket, boost::asio::buffer(data.data(), length),
+                                             boost::asio::use_awaitable);
+        }
+        co_return;
+    }
+
+    // Кусок хешируется, пока он ещё в кэше процессора
+    constexpr size_t kPiece = 256 * 1024;
+    for (size_t pos = 0; pos < length; ) {
+        size_t n = std::min<size_t>(kPiece, length - pos);
+        co_await boost::asio::async_read(socket, boost::asio::buffer(data.data() + pos, n), boost::asio::use_awaitable);
+        hasher->update({data.data() + pos, n});
+        pos += n;
+    }
+}
+
+boost::asio::awaitable<void> MiniGitServer::sendResponse(Socket& socket, const Response& response) {
+    std::vector<uint8_t> head;
+    encodeResponse(head, response);
 
-                auto timestamp = std::chrono::system_clock::to_time_t(version.timestamp);
-                boost::asio::write(socket, boost::asio::buffer(&timestamp, sizeof(timestamp)));
+    std::vector<boost::asio::const_buffer> buffers;
+    appendResponseBuffers(buffers, head, response);
+    co_await boost::asio::async_write(socket, buffers, boost::asio::use_awaitable);
 
-                writeString(socket, version.author);
-                writeString(socket, version.message);
+    if (hasFileContent(response)) {
+        co_await sendFileContent(socket, *response.content);
+    }
+}
+
+boost::asio::awaitable<void> MiniGitServer::sendFileContent(Socket& socket, const Repository::ContentSource& source) {
+    if (source.region) {
+        // Данные идут из page cache в сокет ядром; на занятом сокете ждём готовности к записи
+        const FileRegion& region = *source.region;
+        socket.native_non_blocking(true);
 
-                uint8_t isDelta = version.isDelta ? 1 : 0;
-                boost::asio::write(socket, boost::asio::buffer(&isDelta, sizeof(isDelta)));
+        auto offset = static_cast<off_t>(region.offset);
+        uint64_t remaining = region.length;
+        while (remaining > 0) {
+            ssize_t sent = ::sendfile(socket.native_handle(), region.fd, &offset,
+                                      static_cast<size_t>(std::min<uint64_t>(remaining, kSendfileStep)));
+            if (sent > 0) {
+                remaining -= static_cast<uint64_t>(sent);
+            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                co_await socket.async_wait(Socket::wait_write, boost::asio::use_awaitable);
+            } else if (sent < 0 && errno == EINTR) {
+                continue;
+            } else {
+                throw std::runtime_error(sent == 0 ? "Object file is shorter than its index entry"
+                                                   : "sendfile failed: " + std::string(strerror(errno)));
             }
         }
+        co_return;
+    }
+
+    if (source.stream) {
+        // Дельта применяется порциями в буфер ограниченного размера, следующая порция
+        // готовится после отправки предыдущей; повреждённая дельта обрывает ответ
+        std::vector<uint8_t> buffer(static_cast<size_t>(std::min<uint64_t>(source.size, kStreamBufferBytes)));
+        DeltaReader& reader = source.stream->reader;
+        size_t filled = 0;
+        while (true) {
+            co_await boost::asio::co_spawn(
+                    repo.workerPool().executor(),
+                    [&reader, &buffer, &filled]() -> Awaitable<void> {
+                        filled = reader.read(buffer);
+                        co_return;
+                    },
+                    boost::asio::use_awaitable);
+            if (filled == 0) break;
+            co_await boost::asio::async_write(socket, boost::asio::buffer(buffer.data(), filled),
+                                              boost::asio::use_awaitable);
+        }
+        co_return;
+    }
+
+    // Список кусков: в памяти один кусок, он читается в вычислительном пуле
+    std::vector<uint8_t> data;
+    for (const auto& chunk : source.chunks) {
+        co_await boost::asio::co_spawn(
+                repo.workerPool().executor(),
+                [this, &chunk, &data]() -> Awaitable<void> {
+                    data = repo.readChunk(chunk.hash);
+                    co_return;
+                },
+                boost::asio::use_awaitable);
+        if (data.size() != chunk.length) {
+            throw std::runtime_error("Chunk size mismatch: " + chunk.hash.hex());
+        }
+        co_await boost::asio::async_write(socket, boost::asio::buffer(data), boost::asio::use_awaitable);
     }
 }
 
@@ -4,6 +4,7 @@
 #include "../engines/repository.h"
 #include "file_version.h"
 #include "../engines/diff_engine.h"
+#include "../engines/worker_pool.h"
 
 #include <boost/asio.hpp>
 #include <cstdint>
@@ -11,10 +12,12 @@
 #include <thread>
 #include <mutex>
 #include <chrono>
+#include <condition_variable>
 #include <optional>
 #include <algorithm>
 #include <filesystem>
 #include <memory>
+#include <span>
 #include <string>
 #include <map>
 #include <vector>
@@ -23,12 +26,90 @@
 
 namespace deltasync {
 
+struct ServerOptions {
+    // Потоки, выполняющие io_context::run (сокеты); 0 — по числу ядер
+    size_t ioThreads = 0;
+
+    // Настройки репозитория: кэш, цепочки дельт, хранилище, сжатие. Запросы выполняются
+    // на его пуле вычислений (repository.workerThreads; 0 — по числу ядер) — отдельного
+    // пула у сервера нет
+    RepositoryOptions repository;
+
+    // Кадровый режим: предел одновременно выполняемых запросов соединения
+    // (дальше сервер перестаёт читать сокет), закрытие после простоя, предельный размер кадра
+    size_t maxInFlight = 64;
+    std::chrono::seconds idleTimeout{60};
+    uint32_t maxFrameBytes = 256u << 20;
+
+    // Загрузка по частям: предельный размер файла и каталог временных файлов
+    // (пустой — <repo>/uploads; очищается при запуске). Размер не больше UINT32_MAX:
+    // длина содержимого в ответе — uint32, и больший файл нельзя было бы получить обратно
+    uint64_t maxUploadBytes = UINT32_MAX;
+    std::filesystem::path uploadDir;
+
+    // Режим дельты для веток и файлов: имя или шаблон fnmatch -> режим
+    // (см. Repository::setBranchDeltaMode); остальные сохраняются в DeltaMode::Fast
+    std::vector<std::pair<std::string, DeltaMode>> branchDeltaModes;
+    std::vector<std::pair<std::string, DeltaMode>> fileDeltaModes;
+
+    // Период строки журнала со статистикой кэша содержимого (0 — выключена)
+    std::chrono::seconds statsInterval{0};
+
+    // Фоновая переупаковка истории с этим периодом (0 — выключена) и её бюджет
+    std::chrono::seconds repackInterval{0};
+    RepackOptions repack;
+};
+
+// Соединения обслуживаются корутинами на фиксированном пуле потоков io_context;
+// работа с репозиторием выносится в его пул вычислений,
+// чтобы долгие дельты не задерживали приём и передачу данных.
+//
+// Протокол. Без префикса соединение несёт один запрос: uint32 тип | поля, затем ответ и закрытие.
+// Кадровый режим включается первыми четырьмя байтами "DSF1"; дальше соединение несёт
+// сколько угодно запросов:
+//   запрос: uint32 длина | uint64 id | uint32 тип | поля
+//   ответ:  uint32 длина | uint64 id | тело ответа как в одиночном режиме
+// Запросы выполняются параллельно, ответы приходят по мере готовности, клиент
+// сопоставляет их по id.
+//
+// Загрузка файла до maxUploadBytes по частям (только кадровый режим):
+//   SAVE_FILE_BEGIN: имя | ветка | автор | сообщение | uint64 размер (UINT64_MAX — неизвестен);
+//                    id этого запроса становится идентификатором загрузки
+//   SAVE_FILE_CHUNK: uint64 id загрузки | данные до конца кадра; ответ только при ошибке
+//   SAVE_FILE_END:   uint64 id загрузки | строка ожидаемого hex-хеша (может быть пустой)
+// Части пишутся во временный файл и хешируются по мере приёма; память на загрузку
+// ограничена размером кадра.
+//
+// GET_DELTA: имя | ветка | hex-хеш версии, которая уже есть у клиента. Ответ после сообщения:
+//   uint8 вид (1 — дельта DiffEngine от версии клиента, 0 — содержимое целиком) |
+//   hex-хеш последней версии | hex-хеш SHA-256 содержимого | uint32 длина | данные
+// Содержимое целиком приходит, если сервер не знает версию клиента или дельта не меньше файла.
+//
+// SAVE_DELTA: имя | ветка | автор | сообщение | hex-хеш базовой версии |
+//             hex-хеш SHA-256 нового содержимого | uint32 длина | дельта DiffEngine от базы.
+// Принимается, только если база — последняя версия файла в ветке; иначе ответ с ошибкой,
+// и клиент отправляет файл целиком через SAVE_FILE.
+//
+// SAVE_BATCH: ветка | автор | сообщение | uint32 число файлов | для каждого: имя | uint32 длина | содержимое.
+// Файлы публикуются одним коммитом или не публикуются вовсе. Ответ после сообщения
+// (в том числе неуспешный): uint32 число файлов | для каждого: uint8 успех | hex-хеш версии либо ошибка.
+//
+// Синхронизация по кускам (большие файлы, хранимые списком кусков FastCDC):
+//   GET_MANIFEST: имя | hex-хеш версии. Ответ после сообщения: uint8 хранится ли версия кусками;
+//                 если да — uint64 размер содержимого | uint32 число кусков |
+//                 для каждого: hex-идентификатор | uint64 длина
+//   GET_CHUNKS:   uint32 число | для каждого: hex-идентификатор | uint64 длина (из GET_MANIFEST).
+//                 Ответ после сообщения: uint32 длина | куски подряд в порядке запроса
+// Клиент запрашивает только куски, которых у него нет; общие для файлов и веток куски
+// (вендорные библиотеки, общие бинарники) передаются один раз.
 class MiniGitServer {
 public:
-    MiniGitServer(const std::filesystem::path& repoPath, int port);
+    MiniGitServer(const std::filesystem::path& repoPath, int port, ServerOptions options = {});
 
+    // Блокирует вызывающий поток до stop(); он становится одним из потоков ввода-вывода
     void run();
 
+    // Можно вызывать из любого потока, в том числе из обработчика запроса
     void stop();
 
 private:
@@ -37,48 +118,156 @@ private:
         GET_LATEST,     
         GET_VERSION,    
         GET_BRANCHES,   
-        GET_HISTORY    
+        GET_HISTORY,
+        SAVE_FILE_BEGIN,
+        SAVE_FILE_CHUNK,
+        SAVE_FILE_END,
+        GET_DELTA,
+        SAVE_DELTA,
+        SAVE_BATCH,
+        GET_MANIFEST,
+        GET_CHUNKS
+    };
+
+    struct BatchEntry {
+        std::string fileName;
+        std::vector<uint8_t> content;
     };
 
     struct Request {
         RequestType type;
+        uint64_t id = 0;  // только в кадровом режиме
         std::string fileName;
         std::string branch;
         std::string version;
+        std::string baseHash;  // GET_DELTA, SAVE_DELTA
         std::string author;
         std::string message;
         std::vector<uint8_t> content;
+        std::optional<Digest> contentHash;  // SHA-256 content, посчитанный при приёме; SAVE_DELTA — от клиента
+        uint64_t uploadId = 0;              // SAVE_FILE_END
+        uint64_t totalSize = 0;             // SAVE_FILE_BEGIN
+        std::vector<BatchEntry> files;      // SAVE_BATCH
+        std::vector<ChunkManifest::Entry> chunks;  // GET_CHUNKS
+    };
+
+    // Поля ответа GET_DELTA перед данными
+    struct DeltaHeader {
+        bool isDelta = false;
+        std::string versionHash;
+        std::string contentHash;
+    };
+
+    // Ответ GET_MANIFEST; список пуст, если версия хранится не кусками
+    struct ManifestHeader {
+        bool chunked = false;
+        ChunkManifest manifest;
     };
 
     struct Response {
         bool success = false;
         std::string message;
-        std::vector<uint8_t> content;
+        std::shared_ptr<const Repository::ContentSource> content;  // GET_LATEST, GET_VERSION, GET_DELTA
+        std::optional<DeltaHeader> delta;                          // GET_DELTA
+        std::optional<std::vector<Repository::BatchFileResult>> batch;  // SAVE_BATCH
+        std::optional<ManifestHeader> manifest;                         // GET_MANIFEST
         std::vector<std::string> branches;
         std::vector<FileVersion> history;
     };
 
+    using Socket = boost::asio::ip::tcp::socket;
+    template <typename T>
+    using Awaitable = boost::asio::awaitable<T>;
+
     Repository repo;
+    ServerOptions options;
     boost::asio::io_context io_context;
     boost::asio::ip::tcp::acceptor acceptor;
+    std::filesystem::path uploadDir;
+    std::atomic<uint64_t> uploadCounter{0};
     std::atomic<bool> running{true};
-    std::vector<std::thread> worker_threads;
+    std::vector<std::thread> io_threads;
+    boost::asio::steady_timer statsTimer;
+
+    // Поток переупаковки; stop() прерывает её и будит поток
+    std::thread repackThread;
+    std::mutex repackMutex;
+    std::condition_variable repackWake;
+    std::atomic<bool> repackCancel{false};
+
+    // Состояние соединения в кадровом режиме; все корутины соединения работают на его strand
+    struct Connection;
+
+    // Загрузка по частям: временный файл, принятый объём и хеш
+    struct Upload;
 
     void startAccept();
 
-    void handleClient(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+    void repackLoop();
+
+    // Статистика кэша в журнал каждые options.statsInterval
+    Awaitable<void> statsLoop();
+
+    Awaitable<void> acceptLoop();
+
+    Awaitable<void> handleClient(Socket socket);
+
+    Awaitable<void> serveFramed(std::shared_ptr<Connection> connection);
+
+    Awaitable<void> runFramedRequest(std::shared_ptr<Connection> connection, Request request);
+
+    // Отправка накопленных ответов; одновременно работает не больше одного писателя.
+    // Запускающий ставит connection->writing = true сам, до запуска; сбрасывает его писатель
+    Awaitable<void> flushResponses(std::shared_ptr<Connection> connection);
+
+    Awaitable<void> idleWatchdog(std::shared_ptr<Connection> connection);
+
+    Awaitable<Response> execute(const Request& request);
 
+    // Ответ вне runFramedRequest (ошибки разбора, загрузки)
+    void postResponse(const std::shared_ptr<Connection>& connection, Response response, uint64_t id);
+
+    void startUpload(const std::shared_ptr<Connection>& connection, const Request& request);
+
+    Awaitable<void> receiveChunk(std::shared_ptr<Connection> connection, std::span<const uint8_t> frame);
+
+    Awaitable<Response> finishUpload(std::shared_ptr<Connection> connection, const Request& request);
+
+    // Выполняется в вычислительном пуле
+    Response saveUpload(Upload& upload, const std::string& expectedHash);
+
+    // Выполняется в вычислительном пуле
     Response processRequest(const Request& request);
 
-    void readString(boost::asio::ip::tcp::socket& socket, std::string& str);
+    // Содержимое версии для GET_LATEST/GET_VERSION; исключение, если не помещается в ответ
+    std::shared_ptr<const Repository::ContentSource> openContent(const std::string& fileName,
+                                                                 const std::string& hash);
+
+    Awaitable<void> readString(Socket& socket, std::string& str);
+
+    // hasher: хешировать данные по мере чтения из сокета
+    Awaitable<void> readBinaryData(Socket& socket, std::vector<uint8_t>& data, Sha256Hasher* hasher = nullptr);
+
+    // Одиночный режим: ответ уходит одной векторной записью, тело из файла хранилища — следом
+    Awaitable<void> sendResponse(Socket& socket, const Response& response);
+
+    // Тело ответа, не лежащее в памяти: участок файла через sendfile либо куски по одному
+    Awaitable<void> sendFileContent(Socket& socket, const Repository::ContentSource& source);
 
-    void readBinaryData(boost::asio::ip::tcp::socket& socket, std::vector<uint8_t>& data);
+    // Тело ответа отправляется отдельно от векторной записи заголовков
+    static bool hasFileContent(const Response& response);
 
-    void writeString(boost::asio::ip::tcp::socket& socket, const std::string& str);
+    // Разбор тела кадра (id, тип, поля); исключение при неверном формате
+    static Request decodeRequest(std::span<const uint8_t> frame);
 
-    void writeBinaryData(boost::asio::ip::tcp::socket& socket, const std::vector<uint8_t>& data);
+    // Сериализация ответа в head (с заголовком кадра, если задан frameId). Содержимое файла
+    // не копируется: оно передаётся вторым буфером сразу за head (см. appendResponseBuffers)
+    // либо отдельно через sendFileContent.
+    static void encodeResponse(std::vector<uint8_t>& head, const Response& response,
+                               std::optional<uint64_t> frameId = std::nullopt);
 
-    void sendResponse(boost::asio::ip::tcp::socket& socket, const Response& response);
+    static void appendResponseBuffers(std::vector<boost::asio::const_buffer>& buffers,
+                                      const std::vector<uint8_t>& head, const Response& response);
 };
 
 } // namespace deltasync
@@ -0,0 +1,298 @@
+// Проверки формата дельты: обратимость в обоих режимах, граничные размеры,
+// чтение v1 и отказ на повреждённых дельтах.
+#include "../engines/delta_format.h"
+#include "../engines/diff_engine.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+using Bytes = std::vector<unsigned char>;
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "  FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Исключение с сообщением, содержащим expected
+void checkThrows(const std::function<void()>& action, const std::string& expected, const std::string& what) {
+    try {
+        action();
+        check(false, what + ": no exception");
+    } catch (const std::exception& e) {
+        check(std::string(e.what()).find(expected) != std::string::npos,
+              what + ": unexpected error \"" + e.what() + "\"");
+    }
+}
+
+Bytes randomBytes(size_t size, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Bytes data(size);
+    for (auto& byte : data) byte = static_cast<unsigned char>(rng());
+    return data;
+}
+
+// Правки в духе текстового файла: вставки, удаления и замены участков
+Bytes mutate(const Bytes& base, uint32_t seed) {
+    std::mt19937 rng(seed);
+    Bytes result = base;
+    for (int edit = 0; edit < 32 && !result.empty(); edit++) {
+        size_t pos = rng() % result.size();
+        size_t length = std::min<size_t>(1 + rng() % 64, result.size() - pos);
+        switch (rng() % 3) {
+            case 0:
+                result.erase(result.begin() + static_cast<ptrdiff_t>(pos),
+                             result.begin() + static_cast<ptrdiff_t>(pos + length));
+                break;
+            case 1: {
+                Bytes inserted = randomBytes(length, static_cast<uint32_t>(rng()));
+                result.insert(result.begin() + static_cast<ptrdiff_t>(pos), inserted.begin(), inserted.end());
+                break;
+            }
+            default:
+                for (size_t i = pos; i < pos + length; i++) result[i] ^= 0x5A;
+                break;
+        }
+    }
+    return result;
+}
+
+// Результат всеми вариантами applyDelta
+void checkRoundTrip(const Bytes& base, const Bytes& target, DeltaMode mode, const std::string& what) {
+    Bytes delta = DiffEngine::computeDelta(base, target, mode);
+    check(DeltaFormat::isVersion2(delta.data(), delta.size()), what + ": delta is v2");
+    check(DiffEngine::deltaTargetSize(base, delta) == target.size(), what + ": declared size");
+
+    check(DiffEngine::applyDelta(base, delta) == target, what + ": vector applyDelta");
+
+    Bytes output(target.size());
+    size_t written = DiffEngine::applyDelta(std::span<const unsigned char>(base), delta, output, true);
+    check(written == target.size() && output == target, what + ": span applyDelta");
+
+    Bytes streamed;
+    DiffEngine::applyDeltaStreaming(base, delta, [&](const unsigned char* data, size_t size) {
+        streamed.insert(streamed.end(), data, data + size);
+    }, true);
+    check(streamed == target, what + ": streaming applyDelta");
+
+    // Порции меньше операций и на их границах
+    for (size_t portion : {size_t{1}, size_t{7}, size_t{4096}}) {
+        DeltaReader reader(base, delta);
+        check(reader.size() == target.size(), what + ": reader size");
+
+        Bytes read;
+        Bytes buffer(portion);
+        while (size_t n = reader.read(buffer)) read.insert(read.end(), buffer.begin(), buffer.begin() + n);
+        check(read == target, what + ": reader by " + std::to_string(portion) + " bytes");
+    }
+}
+
+void testRoundTrip() {
+    Bytes base = randomBytes(256 * 1024, 1);
+    for (DeltaMode mode : {DeltaMode::Fast, DeltaMode::MaxRatio}) {
+        std::string name = mode == DeltaMode::Fast ? "fast" : "max-ratio";
+
+        checkRoundTrip(base, mutate(base, 2), mode, name + " edited");
+        checkRoundTrip(base, base, mode, name + " identical");
+        checkRoundTrip(base, randomBytes(4096, 3), mode, name + " unrelated");
+        checkRoundTrip({}, {}, mode, name + " empty base and target");
+        checkRoundTrip({}, randomBytes(1000, 4), mode, name + " empty base");
+        checkRoundTrip(base, {}, mode, name + " empty target");
+        checkRoundTrip(Bytes(1, 'a'), Bytes(3, 'a'), mode, name + " shorter than a match");
+    }
+}
+
+// Дельта из одинаковых copy-операций по всему original
+Bytes repeatedCopyDelta(const Bytes& original, uint64_t copies, uint32_t checksum) {
+    Bytes delta;
+    DeltaFormat::writeHeader(delta, original.size(), copies * original.size(), checksum);
+    for (uint64_t i = 0; i < copies; i++) {
+        DeltaFormat::putVarint(delta, static_cast<uint64_t>(original.size()) << 1 | DeltaFormat::kOpCopy);
+        // Смещение относительно конца предыдущего copy: каждый раз снова с начала original
+        DeltaFormat::putVarint(delta, DeltaFormat::zigzagEncode(i == 0 ? 0 : -static_cast<int64_t>(original.size())));
+    }
+    return delta;
+}
+
+void testLargeSizes() {
+    constexpr uint64_t kBaseSize = 5ull << 30;
+    constexpr uint64_t kTargetSize = (6ull << 30) + 12345;
+
+    Bytes header;
+    DeltaFormat::writeHeader(header, kBaseSize, kTargetSize, 0xDEADBEEF);
+    DeltaHeader parsed = DeltaFormat::parseHeader(header.data(), header.size());
+    check(parsed.version == 2, "large header: version");
+    check(parsed.baseSize == kBaseSize, "large header: base size");
+    check(parsed.targetSize == kTargetSize, "large header: target size");
+    check(parsed.checksum == 0xDEADBEEF, "large header: checksum");
+    check(parsed.opsOffset == header.size(), "large header: ops offset");
+
+    // Размер из заголовка, который операции не могут дать, отвергается до выделения памяти
+    Bytes small(16, 'x');
+    Bytes lying;
+    DeltaFormat::writeHeader(lying, small.size(), kTargetSize, 0);
+    DeltaFormat::putVarint(lying, static_cast<uint64_t>(small.size()) << 1 | DeltaFormat::kOpCopy);
+    DeltaFormat::putVarint(lying, 0);
+    checkThrows([&] { DiffEngine::deltaTargetSize(small, lying); }, "more data than its operations",
+                "large header: unreachable target size");
+
+    // Результат больше 4 ГБ из повторных copy: размер и контрольная сумма считаются в 64 битах,
+    // данные отдаются потоком без сборки в памяти
+    Bytes original = randomBytes(1 << 20, 5);
+    uint64_t copies = (4ull << 30) / original.size() + 1;
+    uint32_t checksum = 0;
+    for (uint64_t i = 0; i < copies; i++) {
+        checksum = DeltaFormat::checksum(original.data(), original.size(), checksum);
+    }
+    Bytes delta = repeatedCopyDelta(original, copies, checksum);
+    uint64_t expectedSize = copies * original.size();
+
+    check(expectedSize > UINT32_MAX, "large result: above 4 GB");
+    check(DiffEngine::deltaTargetSize(original, delta) == expectedSize, "large result: declared size");
+    checkThrows([&] { DiffEngine::deltaTargetSize(original, delta, UINT32_MAX); }, "size limit",
+                "large result: size limit");
+    checkThrows([&] { DiffEngine::applyDeltaBounded(original, delta, UINT32_MAX); }, "size limit",
+                "large result: bounded applyDelta");
+
+    uint64_t streamed = 0;
+    uint64_t returned = DiffEngine::applyDeltaStreaming(original, delta, [&](const unsigned char*, size_t size) {
+        streamed += size;
+    }, true);
+    check(streamed == expectedSize && returned == expectedSize, "large result: streamed size");
+}
+
+// Формат v1: op | uint32 offset | uint32 length (copy), op | uint32 length | данные (insert)
+void appendV1Copy(Bytes& delta, uint32_t offset, uint32_t length) {
+    delta.push_back(0);
+    delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&offset), reinterpret_cast<unsigned char*>(&offset) + 4);
+    delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&length), reinterpret_cast<unsigned char*>(&length) + 4);
+}
+
+void appendV1Insert(Bytes& delta, const std::string& data) {
+    auto length = static_cast<uint32_t>(data.size());
+    delta.push_back(1);
+    delta.insert(delta.end(), reinterpret_cast<unsigned char*>(&length), reinterpret_cast<unsigned char*>(&length) + 4);
+    delta.insert(delta.end(), data.begin(), data.end());
+}
+
+void testVersion1() {
+    std::string baseText = "hello, world";
+    Bytes base(baseText.begin(), baseText.end());
+
+    Bytes delta;
+    appendV1Copy(delta, 0, 7);
+    appendV1Insert(delta, "brave new ");
+    appendV1Copy(delta, 7, 5);
+    std::string expectedText = "hello, brave new world";
+    Bytes expected(expectedText.begin(), expectedText.end());
+
+    check(!DeltaFormat::isVersion2(delta.data(), delta.size()), "v1: not detected as v2");
+    check(DiffEngine::deltaTargetSize(base, delta) == expected.size(), "v1: size from operations");
+    check(DiffEngine::applyDelta(base, delta) == expected, "v1: vector applyDelta");
+
+    Bytes streamed;
+    DiffEngine::applyDeltaStreaming(base, delta, [&](const unsigned char* data, size_t size) {
+        streamed.insert(streamed.end(), data, data + size);
+    }, true);
+    check(streamed == expected, "v1: streaming applyDelta");
+
+    DeltaReader reader(base, delta);
+    Bytes read(expected.size() + 1);
+    check(reader.size() == expected.size() && reader.read(read) == expected.size() &&
+          std::equal(expected.begin(), expected.end(), read.begin()), "v1: reader");
+
+    Bytes outOfRange;
+    appendV1Copy(outOfRange, 8, 5);
+    checkThrows([&] { DiffEngine::applyDelta(base, outOfRange); }, "Invalid offset/length",
+                "v1: copy past the end of base");
+
+    Bytes truncated;
+    appendV1Insert(truncated, "abc");
+    truncated.pop_back();
+    checkThrows([&] { DiffEngine::applyDelta(base, truncated); }, "Invalid data length",
+                "v1: truncated insert");
+}
+
+void testCorruption() {
+    Bytes base = randomBytes(64 * 1024, 6);
+    Bytes target = mutate(base, 7);
+    Bytes delta = DiffEngine::computeDelta(base, target);
+    DeltaHeader header = DeltaFormat::parseHeader(delta.data(), delta.size());
+
+    // Неверная контрольная сумма в заголовке
+    Bytes badChecksum = delta;
+    badChecksum[header.opsOffset - 1] ^= 0x01;
+    checkThrows([&] { DiffEngine::applyDelta(base, badChecksum); }, "checksum mismatch",
+                "corrupted checksum: vector applyDelta");
+    check(DiffEngine::applyDelta(base, badChecksum, false) == target, "corrupted checksum: verification off");
+    checkThrows([&] {
+        DeltaReader reader(base, badChecksum);
+        Bytes buffer(1000);
+        while (reader.read(buffer)) {}
+    }, "checksum mismatch", "corrupted checksum: reader");
+    checkThrows([&] {
+        DiffEngine::applyDeltaStreaming(base, badChecksum, [](const unsigned char*, size_t) {});
+    }, "checksum mismatch", "corrupted checksum: streaming applyDelta");
+
+    // Повреждённые данные вставки: размеры сходятся, расходится только сумма
+    Bytes original(100, 'a');
+    Bytes inserted = randomBytes(50, 8);
+    Bytes modified = original;
+    modified.insert(modified.begin() + 50, inserted.begin(), inserted.end());
+    Bytes insertDelta = DiffEngine::computeDelta(original, modified);
+    auto at = std::search(insertDelta.begin(), insertDelta.end(), inserted.begin(), inserted.end());
+    check(at != insertDelta.end(), "corrupted insert: inserted bytes stored verbatim");
+    if (at != insertDelta.end()) {
+        *(at + 10) ^= 0xFF;
+        checkThrows([&] { DiffEngine::applyDelta(original, insertDelta); }, "checksum mismatch",
+                    "corrupted insert: vector applyDelta");
+
+        Bytes output(modified.size());
+        checkThrows([&] {
+            DiffEngine::applyDelta(std::span<const unsigned char>(original), insertDelta, output);
+        }, "checksum mismatch", "corrupted insert: span applyDelta");
+    }
+
+    // Заголовок обещает другую базу или обрывается
+    checkThrows([&] { DiffEngine::applyDelta(Bytes(base.begin(), base.end() - 1), delta); },
+                "base size mismatch", "wrong base size");
+    checkThrows([&] { DiffEngine::applyDelta(base, Bytes(delta.begin(), delta.begin() + 5)); },
+                "Invalid delta header", "truncated header");
+    checkThrows([&] { DiffEngine::applyDelta(base, Bytes(delta.begin(), delta.end() - 1)); },
+                "", "truncated operations");
+}
+
+} // namespace
+
+int main() {
+    const std::pair<const char*, void (*)()> tests[] = {
+        {"round trip", testRoundTrip},
+        {"large sizes", testLargeSizes},
+        {"version 1", testVersion1},
+        {"corruption", testCorruption},
+    };
+
+    for (const auto& [name, test] : tests) {
+        std::cout << name << std::endl;
+        try {
+            test();
+        } catch (const std::exception& e) {
+            std::cerr << "  FAILED: unexpected exception: " << e.what() << std::endl;
+            failures++;
+        }
+    }
+
+    std::cout << (failures ? "FAILED: " + std::to_string(failures) + " checks" : std::string("OK")) << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,348 @@
+// Проверки параллельных сохранений в Repository: одновременные писатели одного файла
+// (в одной ветке и в двух), разных файлов и пакетов. Ни одна версия не теряется,
+// отставшая ветка уходит в новую, пакет публикуется целиком или не публикуется.
+#include "../engines/repository.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+using Bytes = std::vector<uint8_t>;
+
+int failures = 0;
+std::mutex failuresMutex;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::lock_guard<std::mutex> lock(failuresMutex);
+        std::cerr << "  FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// Каталог репозитория теста; удаляется при выходе
+class TempRepo {
+public:
+    explicit TempRepo(const std::string& name)
+        : path(std::filesystem::temp_directory_path() /
+               ("deltasync_" + name + "_" + std::to_string(::getpid()))) {
+        std::filesystem::remove_all(path);
+    }
+
+    ~TempRepo() { std::filesystem::remove_all(path); }
+
+    // Пустая ветка; репозиторий подхватывает её при открытии
+    void addBranch(const std::string& branch) const {
+        std::filesystem::create_directories(path / "branches");
+        std::ofstream(path / "branches" / branch);
+    }
+
+    std::filesystem::path path;
+};
+
+// Содержимое, похожее на соседние версии, чтобы сохранения шли дельтами
+Bytes variant(const Bytes& base, uint32_t writer, uint32_t index) {
+    Bytes content = base;
+    std::mt19937 rng(writer * 1000 + index);
+    for (int edit = 0; edit < 8; edit++) {
+        content[rng() % content.size()] = static_cast<uint8_t>(rng());
+    }
+    content.push_back(static_cast<uint8_t>(writer));
+    content.push_back(static_cast<uint8_t>(index));
+    return content;
+}
+
+Bytes baseContent(size_t size) {
+    Bytes content(size);
+    for (size_t i = 0; i < size; i++) content[i] = static_cast<uint8_t>(i * 131 + i / 977);
+    return content;
+}
+
+// Запуск body(writer) в threads потоках
+void race(size_t threads, const std::function<void(uint32_t)>& body) {
+    std::vector<std::thread> workers;
+    for (uint32_t writer = 0; writer < threads; writer++) {
+        workers.emplace_back([&body, writer] {
+            try {
+                body(writer);
+            } catch (const std::exception& e) {
+                check(false, std::string("writer failed: ") + e.what());
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+}
+
+// Версии, достижимые по родителям от указателей всех веток
+std::set<Digest> reachableVersions(Repository& repo, const std::string& fileName,
+                                   const std::vector<FileVersion>& history) {
+    std::map<Digest, Digest> parents;
+    for (const auto& version : history) parents[version.hash] = version.parentHash;
+
+    std::set<Digest> reachable;
+    for (const auto& branch : repo.getBranches()) {
+        std::string tip;
+        try {
+            tip = repo.getCurrentVersionHash(fileName, branch);
+        } catch (const std::exception&) {
+            continue;  // файла в ветке нет
+        }
+        for (Digest hash = Digest::fromHex(tip); !hash.empty() && reachable.insert(hash).second;) {
+            auto parent = parents.find(hash);
+            if (parent == parents.end()) break;
+            hash = parent->second;
+        }
+    }
+    return reachable;
+}
+
+void testSameFileOneBranch() {
+    TempRepo temp("concurrency_same_file");
+    const size_t writers = 8;
+    const size_t saves = 10;
+    Bytes base = baseContent(200000);
+
+    std::mutex savedMutex;
+    std::map<std::string, Bytes> saved;
+    {
+        Repository repo(temp.path);
+        saved[repo.saveFile("same.bin", base, "test", "initial", "master")] = base;
+
+        race(writers, [&](uint32_t writer) {
+            for (uint32_t i = 0; i < saves; i++) {
+                Bytes content = variant(base, writer, i);
+                std::string hash = repo.saveFile("same.bin", content, "test", "save", "master");
+                std::lock_guard<std::mutex> lock(savedMutex);
+                saved[hash] = std::move(content);
+            }
+        });
+
+        // Одна ветка: история линейна, ни одно сохранение не потеряно и не ушло в другую ветку
+        auto history = repo.getFileHistory("same.bin");
+        check(history.size() == 1 + writers * saves, "history holds every save");
+        check(saved.size() == 1 + writers * saves, "every save returned a distinct hash");
+        for (size_t i = 1; i < history.size(); i++) {
+            check(history[i].parentHash == history[i - 1].hash,
+                  "version " + std::to_string(i) + " follows its predecessor");
+        }
+        check(repo.getBranches().size() == 1, "no forks on a single branch");
+        check(repo.getCurrentVersionHash("same.bin", "master") == history.back().hash.hex(), "tip is the last version");
+        for (const auto& [hash, content] : saved) {
+            check(repo.getFileContent("same.bin", hash) == content, "content of " + hash);
+        }
+    }
+
+    // Журнал метаданных сохранил все версии
+    Repository reopened(temp.path);
+    check(reopened.getFileHistory("same.bin").size() == 1 + writers * saves, "history survives reopening");
+}
+
+void testSameFileTwoBranches() {
+    TempRepo temp("concurrency_forks");
+    temp.addBranch("dev");
+    const size_t writersPerBranch = 4;
+    const size_t saves = 10;
+    Bytes base = baseContent(100000);
+
+    Repository repo(temp.path);
+    repo.saveFile("shared.bin", base, "test", "initial", "master");
+    // saveFile дополняет только файл, который уже есть в ветке; в dev его заводит пакет
+    check(repo.saveBatch({{"shared.bin", base, std::nullopt}}, "test", "initial", "dev").committed, "dev seeded");
+
+    std::mutex savedMutex;
+    std::map<std::string, Bytes> saved;
+    race(2 * writersPerBranch, [&](uint32_t writer) {
+        std::string branch = writer % 2 ? "dev" : "master";
+        for (uint32_t i = 0; i < saves; i++) {
+            Bytes content = variant(base, writer, i);
+            std::string hash = repo.saveFile("shared.bin", content, "test", "save", branch);
+            std::lock_guard<std::mutex> lock(savedMutex);
+            saved[hash] = std::move(content);
+        }
+    });
+
+    auto history = repo.getFileHistory("shared.bin");
+    check(history.size() == 2 + 2 * writersPerBranch * saves, "history holds every save");
+    for (const auto& [hash, content] : saved) {
+        check(repo.getFileContent("shared.bin", hash) == content, "content of " + hash);
+    }
+
+    // Родитель каждой версии — более ранняя версия файла
+    std::set<Digest> earlier;
+    for (const auto& version : history) {
+        check(version.parentHash.empty() || earlier.count(version.parentHash), "parent precedes its child");
+        earlier.insert(version.hash);
+    }
+
+    // Отставшие сохранения ушли в ветки от своей ветки, и ни одна версия не осталась без ветки
+    for (const auto& branch : repo.getBranches()) {
+        check(branch == "master" || branch == "dev" || branch.rfind("master-", 0) == 0 || branch.rfind("dev-", 0) == 0,
+              "fork " + branch + " is named after its origin");
+    }
+    auto reachable = reachableVersions(repo, "shared.bin", history);
+    for (const auto& version : history) {
+        check(reachable.count(version.hash), "version " + version.hash.hex() + " is reachable from a branch");
+    }
+}
+
+void testManyFiles() {
+    TempRepo temp("concurrency_many_files");
+    const size_t writers = 8;
+    const size_t files = 4;
+    const size_t saves = 6;
+    Bytes base = baseContent(50000);
+
+    std::mutex savedMutex;
+    std::map<std::pair<std::string, std::string>, Bytes> saved;  // (файл, хеш) -> содержимое
+    {
+        Repository repo(temp.path);
+        // Каждый писатель обходит все файлы со своего смещения: файлы делят и писатели, и полосы блокировок
+        race(writers, [&](uint32_t writer) {
+            for (uint32_t i = 0; i < saves * files; i++) {
+                std::string fileName = "file" + std::to_string((writer + i) % files) + ".bin";
+                Bytes content = variant(base, writer, i);
+                std::string hash = repo.saveFile(fileName, content, "test", "save", "master");
+                std::lock_guard<std::mutex> lock(savedMutex);
+                saved[{fileName, hash}] = std::move(content);
+            }
+        });
+
+        check(saved.size() == writers * saves * files, "every save returned a distinct hash");
+        for (size_t f = 0; f < files; f++) {
+            std::string fileName = "file" + std::to_string(f) + ".bin";
+            auto history = repo.getFileHistory(fileName);
+            check(history.size() == writers * saves, fileName + " holds every save");
+            for (size_t i = 1; i < history.size(); i++) {
+                check(history[i].parentHash == history[i - 1].hash, fileName + " history is linear");
+            }
+        }
+        check(repo.getBranches().size() == 1, "no forks on a single branch");
+        for (const auto& [key, content] : saved) {
+            check(repo.getFileContent(key.first, key.second) == content, "content of " + key.first + " " + key.second);
+        }
+    }
+
+    Repository reopened(temp.path);
+    for (size_t f = 0; f < files; f++) {
+        check(reopened.getFileHistory("file" + std::to_string(f) + ".bin").size() == writers * saves,
+              "history survives reopening");
+    }
+}
+
+void testBatches() {
+    TempRepo temp("concurrency_batches");
+    const size_t writers = 4;
+    const size_t batches = 10;
+    const size_t files = 8;
+    Bytes base = baseContent(20000);
+
+    auto fileName = [](size_t f) { return "batch" + std::to_string(f) + ".bin"; };
+
+    // Пакеты из одних и тех же файлов и одиночные сохранения тех же файлов наперегонки
+    {
+        Repository repo(temp.path, RepositoryOptions{.objectBackend = ObjectBackend::Loose});
+        std::atomic<size_t> singles{0};
+        race(writers + 1, [&](uint32_t writer) {
+            if (writer == writers) {
+                for (uint32_t i = 0; i < batches * 2; i++) {
+                    Bytes content = variant(base, writer, i);
+                    repo.saveFile(fileName(i % files), content, "test", "single", "master");
+                    singles++;
+                }
+                return;
+            }
+            for (uint32_t b = 0; b < batches; b++) {
+                std::vector<Bytes> contents;
+                for (size_t f = 0; f < files; f++) contents.push_back(variant(base, writer * 100 + b, f));
+                std::vector<Repository::BatchFile> batch;
+                for (size_t f = 0; f < files; f++) batch.push_back({fileName(f), contents[f], std::nullopt});
+
+                std::string message = "batch " + std::to_string(writer) + "/" + std::to_string(b);
+                auto result = repo.saveBatch(batch, "test", message, "master");
+                check(result.committed, message + " committed");
+                for (size_t f = 0; f < files && result.committed; f++) {
+                    check(repo.getFileContent(fileName(f), result.files[f].hash) == contents[f],
+                          message + " content of " + fileName(f));
+                }
+            }
+        });
+
+        size_t total = 0;
+        for (size_t f = 0; f < files; f++) total += repo.getFileHistory(fileName(f)).size();
+        check(total == writers * batches * files + singles, "every batch file and single save is in history");
+    }
+
+    // Пакет, в котором один файл не собирается (объект его родителя пропал), не публикует ничего
+    std::string lostHash;
+    {
+        Repository repo(temp.path, RepositoryOptions{.objectBackend = ObjectBackend::Loose});
+        lostHash = repo.saveFile("broken.bin", base, "test", "initial", "master");
+    }
+    std::filesystem::remove(temp.path / "objects" / lostHash);
+
+    Repository repo(temp.path, RepositoryOptions{.objectBackend = ObjectBackend::Loose});
+    std::map<std::string, std::string> tipsBefore;
+    std::map<std::string, size_t> historyBefore;
+    for (size_t f = 0; f < files; f++) {
+        tipsBefore[fileName(f)] = repo.getCurrentVersionHash(fileName(f), "master");
+        historyBefore[fileName(f)] = repo.getFileHistory(fileName(f)).size();
+    }
+
+    std::vector<Bytes> contents;
+    for (size_t f = 0; f < files; f++) contents.push_back(variant(base, 999, f));
+    Bytes brokenContent = variant(base, 999, 999);
+    std::vector<Repository::BatchFile> batch;
+    for (size_t f = 0; f < files; f++) batch.push_back({fileName(f), contents[f], std::nullopt});
+    batch.push_back({"broken.bin", brokenContent, std::nullopt});
+
+    auto result = repo.saveBatch(batch, "test", "doomed", "master");
+    check(!result.committed, "batch with an unbuildable file is rejected");
+    check(!result.files.back().error.empty() && result.files.back().error != "Batch aborted",
+          "the failing file reports its own error");
+    for (size_t f = 0; f < files; f++) {
+        check(result.files[f].error == "Batch aborted", fileName(f) + " is reported as aborted");
+        check(repo.getCurrentVersionHash(fileName(f), "master") == tipsBefore[fileName(f)],
+              fileName(f) + " tip unchanged");
+        check(repo.getFileHistory(fileName(f)).size() == historyBefore[fileName(f)],
+              fileName(f) + " history unchanged");
+    }
+    check(repo.getCurrentVersionHash("broken.bin", "master") == lostHash, "broken.bin tip unchanged");
+}
+
+} // namespace
+
+int main() {
+    const std::pair<const char*, void (*)()> tests[] = {
+        {"same file, one branch", testSameFileOneBranch},
+        {"same file, two branches", testSameFileTwoBranches},
+        {"many files", testManyFiles},
+        {"batches", testBatches},
+    };
+
+    for (const auto& [name, test] : tests) {
+        std::cout << name << std::endl;
+        try {
+            test();
+        } catch (const std::exception& e) {
+            std::cerr << "  FAILED: unexpected exception: " << e.what() << std::endl;
+            failures++;
+        }
+    }
+
+    std::cout << (failures ? "FAILED: " + std::to_string(failures) + " checks" : std::string("OK")) << std::endl;
+    return failures ? 1 : 0;
+}